@@ -0,0 +1,285 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/Client.hpp"
+#include "RESX/ResourceIndex.hpp"
+
+#include <cerrno>
+#include <cstring> // For std::memcpy
+#include <iostream>
+#include <utility> // For std::move
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h> // For fstat()
+#include <sys/un.h>
+#include <unistd.h> // For close(), sysconf()
+
+namespace RESX
+{
+
+Payload::Payload()
+    : mMapping(nullptr),
+    mMappingSize(0),
+    mData(nullptr),
+    mSize(0)
+{
+
+}
+
+Payload::~Payload()
+{
+    release();
+}
+
+Payload::Payload(Payload&& other)
+    : Payload()
+{
+    *this = std::move(other);
+}
+
+Payload& Payload::operator=(Payload&& other)
+{
+    if(this != &other)
+    {
+        release();
+        // Moving a vector keeps its buffer, so mData stays valid.
+        mCopy = std::move(other.mCopy);
+        mMapping = other.mMapping;
+        mMappingSize = other.mMappingSize;
+        mData = other.mData;
+        mSize = other.mSize;
+
+        other.mMapping = nullptr;
+        other.mMappingSize = 0;
+        other.mData = nullptr;
+        other.mSize = 0;
+    }
+
+    return *this;
+}
+
+void Payload::release()
+{
+    if(mMapping != nullptr)
+        ::munmap(mMapping, mMappingSize);
+
+    mCopy.clear();
+    mMapping = nullptr;
+    mMappingSize = 0;
+    mData = nullptr;
+    mSize = 0;
+}
+
+const char* Payload::data() const
+{
+    return mData;
+}
+
+std::size_t Payload::size() const
+{
+    return mSize;
+}
+
+Client::Client(const std::string& socketPath)
+    : mSocket(-1),
+    mSequence(0)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Socket path '" << socketPath << "' is empty or too long!" << std::endl;
+        return;
+    }
+
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+
+    mSocket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(mSocket == -1 ||
+       ::connect(mSocket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        std::cerr << "Could not connect to '" << socketPath << "': " << std::strerror(errno) << std::endl;
+        disconnect();
+        return;
+    }
+
+#ifdef SO_NOSIGPIPE
+    int noSignal = 1;
+    ::setsockopt(mSocket, SOL_SOCKET, SO_NOSIGPIPE, &noSignal, sizeof(noSignal));
+#endif
+}
+
+Client::~Client()
+{
+    disconnect();
+}
+
+void Client::disconnect()
+{
+    if(mSocket != -1)
+        ::close(mSocket);
+
+    mSocket = -1;
+}
+
+bool Client::isConnected() const
+{
+    return mSocket != -1;
+}
+
+Protocol::Status Client::lookup(const ForkLocation& location, const ResourceKey& key, RemoteResource* resource)
+{
+    return request(Protocol::lookup, location, key, resource, nullptr);
+}
+
+Protocol::Status Client::extract(const ForkLocation& location, const ResourceKey& key,
+                                 RemoteResource* resource, Payload* payload)
+{
+    return request(Protocol::extract, location, key, resource, payload);
+}
+
+Protocol::Status Client::forget()
+{
+    return request(Protocol::forget, ForkLocation(std::string()), ResourceKey(std::string(), 0),
+                   nullptr, nullptr);
+}
+
+// The connection is dropped on any error of the exchange itself: the
+// next message could not be told apart from the rest of this one.
+Protocol::Status Client::request(Protocol::Operation operation, const ForkLocation& location,
+                                 const ResourceKey& key, RemoteResource* resource, Payload* payload)
+{
+    if(!isConnected())
+        return Protocol::disconnected;
+
+    if(location.path.size() > Protocol::pathLengthLimit || key.name.size() > Protocol::nameLengthLimit)
+        return Protocol::badRequest;
+
+    Protocol::Request request = {};
+    request.magic = Protocol::magic;
+    request.version = Protocol::version;
+    request.operation = operation;
+    request.sequence = ++mSequence;
+    request.blockSize = location.blockSize;
+    request.startBlock = location.startBlock;
+    request.typeCode = ResourceIndex::typeCode(key.type);
+    request.ID = key.ID;
+    request.flags = (location.decompress ? Protocol::decompressFlag : 0) |
+        (key.name.empty() ? 0 : Protocol::byNameFlag);
+    request.nameLength = static_cast<uint16_t>(key.name.size());
+    request.pathLength = static_cast<uint32_t>(location.path.size());
+
+    // One write for the whole request.
+    std::vector<char> message(sizeof(request) + location.path.size() + key.name.size());
+    std::memcpy(message.data(), &request, sizeof(request));
+    std::memcpy(message.data() + sizeof(request), location.path.data(), location.path.size());
+    std::memcpy(message.data() + sizeof(request) + location.path.size(), key.name.data(), key.name.size());
+
+    Protocol::Reply reply;
+    int fileDescriptor = -1;
+    std::string name;
+    if(!Protocol::sendAll(mSocket, message.data(), message.size()) ||
+       !Protocol::receiveAll(mSocket, reinterpret_cast<char*>(&reply), sizeof(reply), &fileDescriptor) ||
+       reply.magic != Protocol::magic || reply.sequence != request.sequence)
+    {
+        if(fileDescriptor != -1)
+            ::close(fileDescriptor);
+
+        disconnect();
+        return Protocol::disconnected;
+    }
+
+    name.resize(reply.nameLength);
+    if(!Protocol::receiveAll(mSocket, &name[0], name.size()))
+    {
+        if(fileDescriptor != -1)
+            ::close(fileDescriptor);
+
+        disconnect();
+        return Protocol::disconnected;
+    }
+
+    std::vector<char> copy;
+    if(reply.payload == Protocol::inlineData)
+    {
+        copy.resize(static_cast<std::size_t>(reply.size));
+        if(!Protocol::receiveAll(mSocket, copy.data(), copy.size()))
+        {
+            disconnect();
+            return Protocol::disconnected;
+        }
+    }
+
+    if(resource != nullptr && reply.status == Protocol::ok)
+    {
+        resource->ID = reply.ID;
+        resource->attributes = reply.attributes;
+        resource->name = name;
+        resource->size = static_cast<std::size_t>(reply.size);
+    }
+
+    if(payload != nullptr && reply.status == Protocol::ok)
+    {
+        payload->release();
+        payload->mSize = static_cast<std::size_t>(reply.size);
+        if(reply.payload == Protocol::inlineData)
+        {
+            payload->mCopy = std::move(copy);
+            payload->mData = payload->mCopy.data();
+        } else if(reply.payload == Protocol::fileDescriptor && fileDescriptor != -1 && reply.size > 0)
+        {
+            // Mapping past the end of the file would fault on access.
+            struct stat status;
+            if(::fstat(fileDescriptor, &status) != 0 || reply.payloadOffset > static_cast<uint64_t>(status.st_size) ||
+               reply.size > static_cast<uint64_t>(status.st_size) - reply.payloadOffset)
+            {
+                std::cerr << "The resource data extends past the end of the file!" << std::endl;
+                payload->mSize = 0;
+                ::close(fileDescriptor);
+                return Protocol::cannotRead;
+            }
+
+            // Mappings start on a page boundary.
+            uint64_t pageSize = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+            uint64_t mappingStart = reply.payloadOffset / pageSize * pageSize;
+            std::size_t skipped = static_cast<std::size_t>(reply.payloadOffset - mappingStart);
+
+            void* mapping = ::mmap(nullptr, skipped + payload->mSize, PROT_READ, MAP_SHARED, fileDescriptor,
+                                   static_cast<off_t>(mappingStart));
+            if(mapping == MAP_FAILED)
+            {
+                std::cerr << "Could not map the resource data: " << std::strerror(errno) << std::endl;
+                payload->mSize = 0;
+                ::close(fileDescriptor);
+                return Protocol::cannotRead;
+            }
+
+            payload->mMapping = mapping;
+            payload->mMappingSize = skipped + payload->mSize;
+            payload->mData = static_cast<const char*>(mapping) + skipped;
+        }
+    }
+
+    if(fileDescriptor != -1)
+        ::close(fileDescriptor);
+
+    return static_cast<Protocol::Status>(reply.status);
+}
+
+} // namespace RESX
@@ -0,0 +1,666 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/Decompressor.hpp"
+#include "RESX/Decoder.hpp"
+
+#include <cstring> // For std::memcpy
+#include <iostream>
+#include <map>
+#include <memory> // For smart pointers
+#include <mutex>
+#include <utility> // For pair
+#include <vector>
+
+namespace RESX
+{
+
+namespace
+{
+    // Signature (4), header length (2), version (1), attributes (1),
+    // decompressed length (4), then 6 bytes depending on the version.
+    const std::size_t minimumHeaderLength = 18;
+
+    // 'dcmp' (2) parameters: flags
+    const uint8_t dcmp2CustomTable = 1 << 0;
+    const uint8_t dcmp2Tagged = 1 << 1;
+
+    // 'dcmp' (0) tags 0x4B to 0xFD: common 68k instructions and operands.
+    const uint16_t dcmp0Table[0xFE - 0x4B] = {
+        0x0000, 0x4EBA, 0x0008, 0x4E75, 0x000C, 0x4EAD, 0x2053, 0x2F0B,
+        0x6100, 0x0010, 0x7000, 0x2F00, 0x486E, 0x2050, 0x206E, 0x2F2E,
+        0xFFFC, 0x48E7, 0x3F3C, 0x0004, 0xFFF8, 0x2F0C, 0x2006, 0x4EED,
+        0x4E56, 0x2068, 0x4E5E, 0x0001, 0x588F, 0x4FEF, 0x0002, 0x0018,
+        0x6000, 0xFFFF, 0x508F, 0x4E90, 0x0006, 0x266E, 0x0014, 0xFFF4,
+        0x4CEE, 0x000A, 0x000E, 0x41EE, 0x4CDF, 0x48C0, 0xFFF0, 0x2D40,
+        0x0012, 0x302E, 0x7001, 0x2F28, 0x2054, 0x6700, 0x0020, 0x001C,
+        0x205F, 0x1800, 0x266F, 0x4878, 0x0016, 0x41FA, 0x303C, 0x2840,
+        0x7200, 0x286E, 0x200C, 0x6600, 0x206B, 0x2F07, 0x558F, 0x0028,
+        0xFFFE, 0xFFEC, 0x22D8, 0x200B, 0x000F, 0x598F, 0x2F3C, 0xFF00,
+        0x0118, 0x81E1, 0x4A00, 0x4EB0, 0xFFE8, 0x48C7, 0x0003, 0x0022,
+        0x0007, 0x001A, 0x6706, 0x6708, 0x4EF9, 0x0024, 0x2078, 0x0800,
+        0x6604, 0x002A, 0x4ED0, 0x3028, 0x265F, 0x6704, 0x0030, 0x43EE,
+        0x3F00, 0x201F, 0x001E, 0xFFF6, 0x202E, 0x42A7, 0x2007, 0xFFFA,
+        0x6002, 0x3D40, 0x0C40, 0x6606, 0x0026, 0x2D48, 0x2F01, 0x70FF,
+        0x6004, 0x1880, 0x4A40, 0x0040, 0x002C, 0x2F08, 0x0011, 0xFFE4,
+        0x2140, 0x2640, 0xFFF2, 0x426E, 0x4EB9, 0x3D7C, 0x0038, 0x000D,
+        0x6006, 0x422E, 0x203C, 0x670C, 0x2D68, 0x6608, 0x4A2E, 0x4AAE,
+        0x002E, 0x4840, 0x225F, 0x2200, 0x670A, 0x3007, 0x4267, 0x0032,
+        0x2028, 0x0009, 0x487A, 0x0200, 0x2F2B, 0x0005, 0x226E, 0x6602,
+        0xE580, 0x670E, 0x660A, 0x0050, 0x3E00, 0x660C, 0x2E00, 0xFFEE,
+        0x206D, 0x2040, 0xFFE0, 0x5340, 0x6008, 0x0480, 0x0068, 0x0B7C,
+        0x4400, 0x41E8, 0x4841
+    };
+
+    // 'dcmp' (1) tags 0xD5 to 0xFD.
+    const uint16_t dcmp1Table[0xFE - 0xD5] = {
+        0x0000, 0x0001, 0x0002, 0x0003, 0x2E01, 0x3E01, 0x0101, 0x1E01,
+        0xFFFF, 0x0E01, 0x3100, 0x1112, 0x0107, 0x3332, 0x1239, 0xED10,
+        0x0127, 0x2322, 0x0137, 0x0706, 0x0117, 0x0123, 0x00FF, 0x002F,
+        0x070E, 0xFD3C, 0x0135, 0x0115, 0x0102, 0x0007, 0x003E, 0x05D5,
+        0x0201, 0x0607, 0x0708, 0x3001, 0x0133, 0x0010, 0x1716, 0x373E,
+        0x3637
+    };
+
+    // Output and literals shared by 'dcmp' (0) and 'dcmp' (1): they only
+    // differ in how tags are numbered.
+    class Dcmp01Stream
+    {
+    private:
+        const unsigned char* mIn;
+        const unsigned char* mInEnd;
+        char* mOut;
+        char* mOutStart;
+        char* mOutEnd;
+
+        // Remembered literals, as (offset in the output, length).
+        std::vector<std::pair<std::size_t, std::size_t>> mLiterals;
+
+    public:
+        Dcmp01Stream(const char* input, std::size_t inputSize, char* output, std::size_t outputSize)
+            : mIn(reinterpret_cast<const unsigned char*>(input)),
+            mInEnd(mIn + inputSize),
+            mOut(output),
+            mOutStart(output),
+            mOutEnd(output + outputSize)
+        {
+
+        }
+
+        bool atEnd() const { return mIn == mInEnd; }
+        bool full() const { return mOut == mOutEnd; }
+
+        bool readByte(uint8_t* value)
+        {
+            if(mIn == mInEnd)
+                return false;
+
+            *value = *mIn++;
+            return true;
+        }
+
+        bool readU16(uint16_t* value)
+        {
+            if(mInEnd - mIn < 2)
+                return false;
+
+            *value = static_cast<uint16_t>(mIn[0] << 8 | mIn[1]);
+            mIn += 2;
+            return true;
+        }
+
+        // One byte for 0 to 0x7F, two (the first offset by 0xC0) for
+        // 16-bit signed values, or 0xFF then a 32-bit signed value.
+        bool readVariableInteger(int32_t* value)
+        {
+            uint8_t first;
+            if(!readByte(&first))
+                return false;
+
+            if(first == 0xFF)
+            {
+                if(mInEnd - mIn < 4)
+                    return false;
+
+                *value = static_cast<int32_t>(static_cast<uint32_t>(mIn[0]) << 24 | mIn[1] << 16 |
+                                              mIn[2] << 8 | mIn[3]);
+                mIn += 4;
+                return true;
+            }
+
+            if(first >= 0x80)
+            {
+                uint8_t second;
+                if(!readByte(&second))
+                    return false;
+
+                *value = static_cast<int16_t>(static_cast<uint16_t>(
+                    static_cast<uint8_t>(first - 0xC0) << 8 | second));
+                return true;
+            }
+
+            *value = first;
+            return true;
+        }
+
+        bool write(const void* data, std::size_t length)
+        {
+            if(length > static_cast<std::size_t>(mOutEnd - mOut))
+                return false;
+
+            std::memcpy(mOut, data, length);
+            mOut += length;
+            return true;
+        }
+
+        bool writeU16(uint16_t value)
+        {
+            char word[2] = {static_cast<char>(value >> 8), static_cast<char>(value)};
+            return write(word, sizeof(word));
+        }
+
+        bool writeU32(uint32_t value)
+        {
+            return writeU16(static_cast<uint16_t>(value >> 16)) && writeU16(static_cast<uint16_t>(value));
+        }
+
+        // Copies length bytes of input to the output.
+        bool copyLiteral(std::size_t length, bool remember)
+        {
+            if(length > static_cast<std::size_t>(mInEnd - mIn))
+                return false;
+
+            if(remember)
+                mLiterals.push_back(std::make_pair(static_cast<std::size_t>(mOut - mOutStart), length));
+
+            if(!write(mIn, length))
+                return false;
+
+            mIn += length;
+            return true;
+        }
+
+        bool copyRemembered(std::size_t index)
+        {
+            if(index >= mLiterals.size())
+                return false;
+
+            // Earlier in the output, never overlapping what is written.
+            std::size_t length = mLiterals[index].second;
+            if(length > static_cast<std::size_t>(mOutEnd - mOut))
+                return false;
+
+            std::memmove(mOut, mOutStart + mLiterals[index].first, length);
+            mOut += length;
+            return true;
+        }
+
+        // After a 0xFE tag.
+        bool decodeExtended()
+        {
+            uint8_t kind;
+            if(!readByte(&kind))
+                return false;
+
+            switch(kind)
+            {
+            case 0x00:
+            {
+                // Segment loader jump table entries: address, then
+                // "move.w #segment,-(sp)" and "_LoadSeg". The address of the
+                // first entry comes before the tag, the second is stored as
+                // is, and each later one as a difference to the one before,
+                // plus 6.
+                int32_t segment, count, address;
+                if(!readVariableInteger(&segment) || !readVariableInteger(&count) || count < 1 ||
+                   !readVariableInteger(&address))
+                {
+                    return false;
+                }
+
+                if(!writeU16(0x3F3C) || !writeU16(static_cast<uint16_t>(segment)) || !writeU16(0xA9F0))
+                    return false;
+
+                for(int32_t i = 0; i < count; i++)
+                {
+                    int32_t difference;
+                    if(i > 0)
+                    {
+                        if(!readVariableInteger(&difference))
+                            return false;
+
+                        address = static_cast<uint16_t>(address + difference - 6);
+                    }
+
+                    if(!writeU16(static_cast<uint16_t>(address)) || !writeU16(0x3F3C) ||
+                       !writeU16(static_cast<uint16_t>(segment)) || !writeU16(0xA9F0))
+                    {
+                        return false;
+                    }
+                }
+
+                return true;
+            }
+
+            case 0x02:
+            case 0x03:
+            {
+                // A byte (0x02) or word (0x03) repeated count + 1 times.
+                int32_t value, count;
+                if(!readVariableInteger(&value) || !readVariableInteger(&count) || count < 0)
+                    return false;
+
+                if(kind == 0x02 && (value < -0x80 || value > 0xFF))
+                    return false;
+
+                for(int32_t i = 0; i <= count; i++)
+                {
+                    char byte = static_cast<char>(value);
+                    if(!(kind == 0x02 ? write(&byte, 1) : writeU16(static_cast<uint16_t>(value))))
+                        return false;
+                }
+
+                return true;
+            }
+
+            case 0x04:
+            {
+                // Words, each stored as a signed byte added to the previous one.
+                int32_t first, count;
+                if(!readVariableInteger(&first) || !readVariableInteger(&count) || count < 0)
+                    return false;
+
+                uint16_t value = static_cast<uint16_t>(first);
+                if(!writeU16(value))
+                    return false;
+
+                for(int32_t i = 0; i < count; i++)
+                {
+                    uint8_t difference;
+                    if(!readByte(&difference))
+                        return false;
+
+                    value = static_cast<uint16_t>(value + static_cast<int8_t>(difference));
+                    if(!writeU16(value))
+                        return false;
+                }
+
+                return true;
+            }
+
+            case 0x06:
+            {
+                // Longs, each stored as a variable integer added to the previous one.
+                int32_t first, count;
+                if(!readVariableInteger(&first) || !readVariableInteger(&count) || count < 0)
+                    return false;
+
+                uint32_t value = static_cast<uint32_t>(first);
+                if(!writeU32(value))
+                    return false;
+
+                for(int32_t i = 0; i < count; i++)
+                {
+                    int32_t difference;
+                    if(!readVariableInteger(&difference))
+                        return false;
+
+                    value += static_cast<uint32_t>(difference);
+                    if(!writeU32(value))
+                        return false;
+                }
+
+                return true;
+            }
+
+            default:
+                std::cerr << "Unsupported extended tag " << static_cast<int>(kind) << "!" << std::endl;
+                return false;
+            }
+        }
+    };
+
+    std::mutex& registryMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    // Guarded by registryMutex().
+    std::map<int, Decompressor::decompressFunction>& registry()
+    {
+        static std::map<int, Decompressor::decompressFunction> decompressors = {
+            {0, Decompressor::decompressDcmp0},
+            {1, Decompressor::decompressDcmp1},
+            {2, Decompressor::decompressDcmp2}
+        };
+
+        return decompressors;
+    }
+
+    // 512 bytes once set, guarded by registryMutex().
+    std::shared_ptr<const std::vector<unsigned char>>& dcmp2DefaultTable()
+    {
+        static std::shared_ptr<const std::vector<unsigned char>> table;
+        return table;
+    }
+}
+
+const uint32_t Decompressor::signature;
+const uint8_t Decompressor::resourceAttribute;
+const uint32_t Decompressor::maxDecompressedLength;
+const std::size_t Decompressor::dcmp2DefaultTableCount;
+
+// Static
+bool Decompressor::parseHeader(const char* data, std::size_t size, Header* header)
+{
+    Decoder decoder(data, size);
+    if(decoder.readU32() != signature)
+        return false;
+
+    header->headerLength = decoder.readU16();
+    header->headerVersion = decoder.readU8();
+    header->attributes = decoder.readU8();
+    header->decompressedLength = decoder.readU32();
+
+    if(header->headerVersion == 8)
+    {
+        header->parameters[0] = decoder.readU8(); // Working buffer fractional size
+        header->parameters[1] = decoder.readU8(); // Expansion buffer size
+        header->decompressorID = decoder.readS16();
+        header->parameters[2] = decoder.readU8(); // Reserved
+        header->parameters[3] = decoder.readU8();
+    } else if(header->headerVersion == 9)
+    {
+        header->decompressorID = decoder.readU16();
+        for(uint8_t& parameter : header->parameters)
+            parameter = decoder.readU8();
+    } else
+    {
+        return false;
+    }
+
+    return !decoder.overran() && header->headerLength >= minimumHeaderLength && header->headerLength <= size &&
+        header->decompressedLength <= maxDecompressedLength;
+}
+
+// Static
+bool Decompressor::decompress(const Header& header, const char* data, std::size_t size, char* output)
+{
+    decompressFunction function;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        std::map<int, decompressFunction>::const_iterator found = registry().find(header.decompressorID);
+        if(found != registry().end())
+            function = found->second;
+    }
+
+    if(!function)
+    {
+        std::cerr << "No decompressor for 'dcmp' (" << header.decompressorID << ")!" << std::endl;
+        return false;
+    }
+
+    if(!function(header, data + header.headerLength, size - header.headerLength, output))
+    {
+        std::cerr << "Malformed data for 'dcmp' (" << header.decompressorID << ")!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Static
+void Decompressor::registerDecompressor(int ID, decompressFunction function)
+{
+    std::lock_guard<std::mutex> lock(registryMutex());
+    registry()[ID] = function;
+}
+
+// Static
+void Decompressor::setDcmp2DefaultTable(const char* table)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(table);
+    std::shared_ptr<const std::vector<unsigned char>> copy(
+        new std::vector<unsigned char>(bytes, bytes + dcmp2DefaultTableCount * 2));
+
+    std::lock_guard<std::mutex> lock(registryMutex());
+    dcmp2DefaultTable() = copy;
+}
+
+// Static
+bool Decompressor::isRegistered(int ID)
+{
+    std::lock_guard<std::mutex> lock(registryMutex());
+    return registry().find(ID) != registry().end();
+}
+
+// Static
+// Tags 0x00 to 0x1F: literals of 2 * (low nibble) bytes, or of 2 * (next
+// byte) bytes if the nibble is 0, remembered from 0x10 up.
+// 0x20 to 0x4A: remembered literals, 0x23 on for the first 40, 0x20 and
+// 0x21 with the next byte, 0x22 with the next word (then 40 on).
+// 0x4B to 0xFD: words of dcmp0Table. 0xFE: extended. 0xFF: end.
+bool Decompressor::decompressDcmp0(const Header& header, const char* input, std::size_t inputSize, char* output)
+{
+    if(header.headerVersion != 8)
+        return false;
+
+    Dcmp01Stream stream(input, inputSize, output, header.decompressedLength);
+    uint8_t tag;
+    while(stream.readByte(&tag))
+    {
+        if(tag < 0x20)
+        {
+            uint8_t countDiv2 = tag & 0x0F;
+            if(countDiv2 == 0 && !stream.readByte(&countDiv2))
+                return false;
+
+            if(!stream.copyLiteral(countDiv2 * 2U, tag >= 0x10))
+                return false;
+        } else if(tag < 0x4B)
+        {
+            std::size_t index;
+            if(tag == 0x20 || tag == 0x21)
+            {
+                uint8_t low;
+                if(!stream.readByte(&low))
+                    return false;
+
+                index = 0x28 + ((tag - 0x20U) << 8 | low);
+            } else if(tag == 0x22)
+            {
+                uint16_t word;
+                if(!stream.readU16(&word))
+                    return false;
+
+                index = 0x28 + static_cast<std::size_t>(word);
+            } else
+            {
+                index = tag - 0x23U;
+            }
+
+            if(!stream.copyRemembered(index))
+                return false;
+        } else if(tag < 0xFE)
+        {
+            if(!stream.writeU16(dcmp0Table[tag - 0x4B]))
+                return false;
+        } else if(tag == 0xFE)
+        {
+            if(!stream.decodeExtended())
+                return false;
+        } else
+        {
+            break;
+        }
+    }
+
+    return stream.full();
+}
+
+// Static
+// Tags 0x00 to 0x1F: literals of (low nibble) + 1 bytes, remembered from
+// 0x10 up. 0x20 to 0xCF: remembered literals. 0xD0 and 0xD1: literals of
+// (next byte) bytes, remembered if 0xD1. 0xD2 and 0xD3: remembered
+// literals 0xB0 on, with the next byte. 0xD5 to 0xFD: words of
+// dcmp1Table. 0xFE: extended. 0xFF: end.
+bool Decompressor::decompressDcmp1(const Header& header, const char* input, std::size_t inputSize, char* output)
+{
+    if(header.headerVersion != 8)
+        return false;
+
+    Dcmp01Stream stream(input, inputSize, output, header.decompressedLength);
+    uint8_t tag;
+    while(stream.readByte(&tag))
+    {
+        if(tag < 0x20)
+        {
+            if(!stream.copyLiteral((tag & 0x0FU) + 1, tag >= 0x10))
+                return false;
+        } else if(tag < 0xD0)
+        {
+            if(!stream.copyRemembered(tag - 0x20U))
+                return false;
+        } else if(tag == 0xD0 || tag == 0xD1)
+        {
+            uint8_t length;
+            if(!stream.readByte(&length) || !stream.copyLiteral(length, tag == 0xD1))
+                return false;
+        } else if(tag == 0xD2 || tag == 0xD3)
+        {
+            uint8_t low;
+            if(!stream.readByte(&low) || !stream.copyRemembered(0xB0 + ((tag - 0xD2U) << 8 | low)))
+                return false;
+        } else if(tag == 0xD4)
+        {
+            return false;
+        } else if(tag < 0xFE)
+        {
+            if(!stream.writeU16(dcmp1Table[tag - 0xD5]))
+                return false;
+        } else if(tag == 0xFE)
+        {
+            if(!stream.decodeExtended())
+                return false;
+        } else
+        {
+            break;
+        }
+    }
+
+    return stream.full();
+}
+
+// Static
+// The table is 256 words at most, the input a stream of bytes:
+// untagged, each byte is a table index; tagged, each tag byte tells
+// (from its high bit down) whether each of the next 8 items is a table
+// index (1) or a literal word (0). An odd decompressed length ends with
+// a lone literal byte.
+bool Decompressor::decompressDcmp2(const Header& header, const char* input, std::size_t inputSize, char* output)
+{
+    if(header.headerVersion != 9)
+        return false;
+
+    std::size_t tableCount = header.parameters[2] + 1U;
+    uint8_t flags = header.parameters[3];
+
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(input);
+    const unsigned char* inEnd = in + inputSize;
+    const unsigned char* table = in;
+
+    // Kept alive while decompressing, even if replaced meanwhile.
+    std::shared_ptr<const std::vector<unsigned char>> defaultTable;
+    if(flags & dcmp2CustomTable)
+    {
+        if(tableCount * 2 > inputSize)
+            return false;
+
+        in += tableCount * 2;
+    } else
+    {
+        {
+            std::lock_guard<std::mutex> lock(registryMutex());
+            defaultTable = dcmp2DefaultTable();
+        }
+
+        if(defaultTable == nullptr)
+        {
+            std::cerr << "No default table for 'dcmp' (2), see setDcmp2DefaultTable()!" << std::endl;
+            return false;
+        }
+
+        table = defaultTable->data();
+        tableCount = dcmp2DefaultTableCount;
+    }
+
+    char* out = output;
+    char* outEnd = output + header.decompressedLength;
+
+    // Table words and literal words are copied the same way.
+    auto copyWord = [&out, outEnd](const unsigned char* word, std::size_t length)
+    {
+        if(length > static_cast<std::size_t>(outEnd - out))
+            return false;
+
+        std::memcpy(out, word, length);
+        out += length;
+        return true;
+    };
+
+    while(in < inEnd)
+    {
+        if(inEnd - in == 1 && outEnd - out == 1)
+        {
+            *out++ = static_cast<char>(*in++);
+            break;
+        }
+
+        if(!(flags & dcmp2Tagged))
+        {
+            std::size_t index = *in++;
+            if(index >= tableCount || !copyWord(table + index * 2, 2))
+                return false;
+
+            continue;
+        }
+
+        uint8_t tag = *in++;
+        for(int bit = 0; bit < 8 && in < inEnd; bit++, tag <<= 1)
+        {
+            if(tag & 0x80)
+            {
+                std::size_t index = *in++;
+                if(index >= tableCount || !copyWord(table + index * 2, 2))
+                    return false;
+            } else
+            {
+                // Shorter at the very end of odd lengths.
+                std::size_t length = inEnd - in < 2 ? 1 : 2;
+                if(!copyWord(in, length))
+                    return false;
+
+                in += length;
+            }
+        }
+    }
+
+    return out == outEnd;
+}
+
+} // namespace RESX
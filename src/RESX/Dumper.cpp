@@ -0,0 +1,278 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/Dumper.hpp"
+
+#include <cstring> // For std::memcpy
+
+namespace RESX
+{
+
+namespace
+{
+    const char hexDigits[] = "0123456789abcdef";
+    const char base64Digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    // RFC 2045 (MIME) line length, as base64(1) does.
+    const std::size_t base64LineLength = 76;
+
+    // Both hex digits of every byte, one lookup per byte.
+    struct HexPairs
+    {
+        char pairs[256 * 2];
+
+        HexPairs()
+        {
+            for(int i = 0; i < 256; i++)
+            {
+                pairs[i * 2] = hexDigits[i >> 4];
+                pairs[i * 2 + 1] = hexDigits[i & 0xF];
+            }
+        }
+    };
+
+    const HexPairs hexPairs;
+}
+
+const std::size_t Dumper::bufferSize;
+const std::size_t Dumper::bytesPerLine;
+
+Dumper::Dumper(std::FILE* output, Format format, bool showOffsets, bool showASCII)
+    : mOutput(output),
+    mFormat(format),
+    mShowOffsets(showOffsets),
+    mShowASCII(showASCII),
+    mFailed(false),
+    mBuffer(bufferSize),
+    mBufferLength(0),
+    mPendingLength(0),
+    mOffset(0),
+    mLineLength(0)
+{
+
+}
+
+Dumper::~Dumper()
+{
+
+}
+
+void Dumper::flushBuffer()
+{
+    if(mBufferLength > 0 && std::fwrite(mBuffer.data(), 1, mBufferLength, mOutput) != mBufferLength)
+        mFailed = true;
+
+    mBufferLength = 0;
+}
+
+// Makes room for size more chars in the buffer.
+void Dumper::reserve(std::size_t size)
+{
+    if(mBufferLength + size > mBuffer.size())
+        flushBuffer();
+}
+
+// Renders a line of count (up to bytesPerLine) bytes at mOffset:
+// [OFFSET  ]xx xx xx xx xx xx xx xx  xx xx xx xx xx xx xx xx  [|ASCII|]
+void Dumper::appendHexLine(const unsigned char* bytes, std::size_t count)
+{
+    // Offset (16), hex (3 per byte, 2 more per group), gutter (2 + 1 per byte), newline
+    reserve(18 + bytesPerLine * 3 + 2 + bytesPerLine + 3);
+    char* out = mBuffer.data() + mBufferLength;
+
+    if(mShowOffsets)
+    {
+        int digits = mOffset > 0xFFFFFFFFULL ? 16 : 8;
+        for(int i = digits - 1; i >= 0; i--)
+            *out++ = hexDigits[(mOffset >> (i * 4)) & 0xF];
+
+        *out++ = ' ';
+        *out++ = ' ';
+    }
+
+    for(std::size_t i = 0; i < bytesPerLine; i++)
+    {
+        if(i < count)
+        {
+            std::memcpy(out, hexPairs.pairs + bytes[i] * 2, 2);
+        } else if(mShowASCII)
+        {
+            // Keeps the gutter aligned.
+            out[0] = ' ';
+            out[1] = ' ';
+        } else
+        {
+            break;
+        }
+
+        out[2] = ' ';
+        out += 3;
+        if(i % 8 == 7)
+            *out++ = ' ';
+    }
+
+    if(mShowASCII)
+    {
+        *out++ = '|';
+        for(std::size_t i = 0; i < count; i++)
+            *out++ = bytes[i] >= 0x20 && bytes[i] < 0x7F ? static_cast<char>(bytes[i]) : '.';
+
+        *out++ = '|';
+    }
+
+    *out++ = '\n';
+    mBufferLength = out - mBuffer.data();
+    mOffset += count;
+}
+
+// Encodes count bytes: a multiple of 3, except for the very last bytes,
+// which get padded.
+void Dumper::appendBase64(const unsigned char* bytes, std::size_t count)
+{
+    while(count > 0)
+    {
+        reserve(5);
+        char* out = mBuffer.data() + mBufferLength;
+
+        uint32_t quantum = static_cast<uint32_t>(bytes[0]) << 16;
+        if(count > 1)
+            quantum |= static_cast<uint32_t>(bytes[1]) << 8;
+        if(count > 2)
+            quantum |= bytes[2];
+
+        out[0] = base64Digits[(quantum >> 18) & 0x3F];
+        out[1] = base64Digits[(quantum >> 12) & 0x3F];
+        out[2] = count > 1 ? base64Digits[(quantum >> 6) & 0x3F] : '=';
+        out[3] = count > 2 ? base64Digits[quantum & 0x3F] : '=';
+        mBufferLength += 4;
+
+        mLineLength += 4;
+        if(mLineLength == base64LineLength)
+        {
+            mBuffer[mBufferLength++] = '\n';
+            mLineLength = 0;
+        }
+
+        std::size_t consumed = count < 3 ? count : 3;
+        bytes += consumed;
+        count -= consumed;
+    }
+}
+
+bool Dumper::write(const char* data, std::size_t size)
+{
+    if(mFailed)
+        return false;
+
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    if(mFormat == Format::raw)
+    {
+        // Big chunks go straight out, small ones are gathered.
+        if(size >= mBuffer.size() / 2)
+        {
+            flushBuffer();
+            if(std::fwrite(data, 1, size, mOutput) != size)
+                mFailed = true;
+        } else
+        {
+            reserve(size);
+            std::memcpy(mBuffer.data() + mBufferLength, data, size);
+            mBufferLength += size;
+        }
+
+        return !mFailed;
+    }
+
+    // Whole lines for hex, whole quanta for base64.
+    std::size_t unit = mFormat == Format::hex ? bytesPerLine : 3;
+
+    // Complete what the previous chunk left over first.
+    if(mPendingLength > 0)
+    {
+        std::size_t toCopy = unit - mPendingLength < size ? unit - mPendingLength : size;
+        std::memcpy(mPending + mPendingLength, bytes, toCopy);
+        mPendingLength += toCopy;
+        bytes += toCopy;
+        size -= toCopy;
+
+        if(mPendingLength < unit)
+            return true;
+
+        if(mFormat == Format::hex)
+            appendHexLine(mPending, unit);
+        else
+            appendBase64(mPending, unit);
+
+        mPendingLength = 0;
+    }
+
+    std::size_t whole = size - size % unit;
+    if(mFormat == Format::hex)
+    {
+        for(std::size_t i = 0; i < whole; i += bytesPerLine)
+            appendHexLine(bytes + i, bytesPerLine);
+    } else
+    {
+        appendBase64(bytes, whole);
+    }
+
+    std::memcpy(mPending, bytes + whole, size - whole);
+    mPendingLength = size - whole;
+    return !mFailed;
+}
+
+bool Dumper::finish()
+{
+    if(mPendingLength > 0)
+    {
+        if(mFormat == Format::hex)
+            appendHexLine(mPending, mPendingLength);
+        else
+            appendBase64(mPending, mPendingLength);
+
+        mPendingLength = 0;
+    }
+
+    if(mFormat == Format::base64 && mLineLength > 0)
+    {
+        reserve(1);
+        mBuffer[mBufferLength++] = '\n';
+        mLineLength = 0;
+    }
+
+    flushBuffer();
+    if(std::fflush(mOutput) != 0)
+        mFailed = true;
+
+    return !mFailed;
+}
+
+// Static
+bool Dumper::parseFormat(const std::string& text, Format* format)
+{
+    if(text == "hex")
+        *format = Format::hex;
+    else if(text == "raw")
+        *format = Format::raw;
+    else if(text == "base64")
+        *format = Format::base64;
+    else
+        return false;
+
+    return true;
+}
+
+} // namespace RESX
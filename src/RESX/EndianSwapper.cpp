@@ -0,0 +1,213 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/EndianSwapper.hpp"
+
+#include <cstring> // For std::memcpy
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RESX_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 kernels are compiled for their functions only (the rest of the
+// library does not assume AVX2) and used if the CPU has it.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RESX_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define RESX_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+namespace RESX
+{
+
+namespace
+{
+
+using kernel = void (*)(char* data, std::size_t count);
+
+struct Kernels
+{
+    kernel swap16;
+    kernel swap32;
+    kernel swap64;
+    const char* name;
+};
+
+// One value at a time, also the tail of the vector kernels.
+template<typename Unsigned>
+void swapScalar(char* data, std::size_t count)
+{
+    for(std::size_t i = 0; i < count; i++, data += sizeof(Unsigned))
+    {
+        Unsigned value;
+        std::memcpy(&value, data, sizeof(Unsigned));
+        value = Defs::byteSwap(value);
+        std::memcpy(data, &value, sizeof(Unsigned));
+    }
+}
+
+#ifdef RESX_HAVE_SSE2
+// SSE2 has no byte shuffle: swap 16-bit words with word shuffles, then
+// the bytes of each word with shifts.
+inline __m128i swapBytesOfWords(__m128i vector)
+{
+    return _mm_or_si128(_mm_slli_epi16(vector, 8), _mm_srli_epi16(vector, 8));
+}
+
+template<typename Unsigned> __m128i swapLanesSSE2(__m128i vector);
+
+template<> inline __m128i swapLanesSSE2<uint16_t>(__m128i vector)
+{
+    return swapBytesOfWords(vector);
+}
+
+template<> inline __m128i swapLanesSSE2<uint32_t>(__m128i vector)
+{
+    vector = _mm_shufflelo_epi16(vector, _MM_SHUFFLE(2, 3, 0, 1));
+    vector = _mm_shufflehi_epi16(vector, _MM_SHUFFLE(2, 3, 0, 1));
+    return swapBytesOfWords(vector);
+}
+
+template<> inline __m128i swapLanesSSE2<uint64_t>(__m128i vector)
+{
+    vector = _mm_shufflelo_epi16(vector, _MM_SHUFFLE(0, 1, 2, 3));
+    vector = _mm_shufflehi_epi16(vector, _MM_SHUFFLE(0, 1, 2, 3));
+    return swapBytesOfWords(vector);
+}
+
+template<typename Unsigned>
+void swapSSE2(char* data, std::size_t count)
+{
+    std::size_t bytes = count * sizeof(Unsigned);
+    std::size_t i = 0;
+    for(; i + 16 <= bytes; i += 16)
+    {
+        __m128i vector = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), swapLanesSSE2<Unsigned>(vector));
+    }
+
+    swapScalar<Unsigned>(data + i, (bytes - i) / sizeof(Unsigned));
+}
+#endif
+
+#ifdef RESX_HAVE_AVX2
+// One byte shuffle per 32 bytes. The shuffle works within 16-byte
+// halves, so the mask repeats.
+template<typename Unsigned>
+__attribute__((target("avx2")))
+void swapAVX2(char* data, std::size_t count)
+{
+    char shuffle[32];
+    for(std::size_t j = 0; j < sizeof(shuffle); j++)
+        shuffle[j] = static_cast<char>(j % 16 - j % sizeof(Unsigned) + sizeof(Unsigned) - 1 - j % sizeof(Unsigned));
+    const __m256i mask = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(shuffle));
+
+    std::size_t bytes = count * sizeof(Unsigned);
+    std::size_t i = 0;
+    for(; i + 32 <= bytes; i += 32)
+    {
+        __m256i vector = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_shuffle_epi8(vector, mask));
+    }
+
+    swapScalar<Unsigned>(data + i, (bytes - i) / sizeof(Unsigned));
+}
+#endif
+
+#ifdef RESX_HAVE_NEON
+template<typename Unsigned> uint8x16_t swapLanesNEON(uint8x16_t vector);
+
+template<> inline uint8x16_t swapLanesNEON<uint16_t>(uint8x16_t vector)
+{
+    return vrev16q_u8(vector);
+}
+
+template<> inline uint8x16_t swapLanesNEON<uint32_t>(uint8x16_t vector)
+{
+    return vrev32q_u8(vector);
+}
+
+template<> inline uint8x16_t swapLanesNEON<uint64_t>(uint8x16_t vector)
+{
+    return vrev64q_u8(vector);
+}
+
+template<typename Unsigned>
+void swapNEON(char* data, std::size_t count)
+{
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(data);
+    std::size_t size = count * sizeof(Unsigned);
+    std::size_t i = 0;
+    for(; i + 16 <= size; i += 16)
+        vst1q_u8(bytes + i, swapLanesNEON<Unsigned>(vld1q_u8(bytes + i)));
+
+    swapScalar<Unsigned>(data + i, (size - i) / sizeof(Unsigned));
+}
+#endif
+
+Kernels pickKernels()
+{
+#ifdef RESX_HAVE_AVX2
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return {swapAVX2<uint16_t>, swapAVX2<uint32_t>, swapAVX2<uint64_t>, "avx2"};
+#endif
+
+#if defined(RESX_HAVE_SSE2)
+    return {swapSSE2<uint16_t>, swapSSE2<uint32_t>, swapSSE2<uint64_t>, "sse2"};
+#elif defined(RESX_HAVE_NEON)
+    return {swapNEON<uint16_t>, swapNEON<uint32_t>, swapNEON<uint64_t>, "neon"};
+#else
+    return {swapScalar<uint16_t>, swapScalar<uint32_t>, swapScalar<uint64_t>, "scalar"};
+#endif
+}
+
+// Picked on first use, thread-safe.
+const Kernels& kernels()
+{
+    static const Kernels picked = pickKernels();
+    return picked;
+}
+
+} // namespace
+
+void EndianSwapper::swap16(void* values, std::size_t count)
+{
+    kernels().swap16(static_cast<char*>(values), count);
+}
+
+void EndianSwapper::swap32(void* values, std::size_t count)
+{
+    kernels().swap32(static_cast<char*>(values), count);
+}
+
+void EndianSwapper::swap64(void* values, std::size_t count)
+{
+    kernels().swap64(static_cast<char*>(values), count);
+}
+
+const char* EndianSwapper::kernelName()
+{
+    return kernels().name;
+}
+
+} // namespace RESX
@@ -0,0 +1,229 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/ExtentReader.hpp"
+
+#include <algorithm> // For upper_bound()
+
+namespace RESX
+{
+
+ExtentReader::ExtentReader(readerPointer parent, const std::vector<Extent>& extents,
+                           unsigned int blockSize, Defs::addr logicalSize)
+    : mParent(parent),
+    mSize(0)
+{
+    for(const Extent& extent : extents)
+    {
+        if(extent.blockCount == 0)
+            continue;
+
+        Run run;
+        run.logicalStart = mSize;
+        run.physicalStart = static_cast<Defs::addr>(extent.startBlock) * blockSize;
+        run.length = static_cast<Defs::addr>(extent.blockCount) * blockSize;
+
+        // Coalesce with the previous run if it ends where this one starts.
+        if(!mRuns.empty() && mRuns.back().physicalStart + mRuns.back().length == run.physicalStart)
+            mRuns.back().length += run.length;
+        else
+            mRuns.push_back(run);
+
+        mSize += run.length;
+    }
+
+    // The last block is usually not full.
+    if(logicalSize != 0 && logicalSize < mSize)
+        mSize = logicalSize;
+}
+
+ExtentReader::~ExtentReader()
+{
+
+}
+
+// Static
+std::vector<Extent> ExtentReader::parseForkData(const char* forkData, Defs::addr* logicalSize)
+{
+    // logicalSize (8), clumpSize (4), totalBlocks (4), then 8 extent
+    // descriptors: startBlock (4), blockCount (4).
+    if(logicalSize != nullptr)
+        *logicalSize = static_cast<Defs::addr>(Defs::loadBigEndian64(forkData));
+
+    std::vector<Extent> extents;
+    for(int i = 0; i < 8; i++)
+    {
+        const char* descriptor = forkData + 16 + i * 8;
+
+        Extent extent;
+        extent.startBlock = static_cast<uint32_t>(Defs::loadBigEndian32(descriptor));
+        extent.blockCount = static_cast<uint32_t>(Defs::loadBigEndian32(descriptor + 4));
+        if(extent.blockCount == 0)
+            break;
+
+        extents.push_back(extent);
+    }
+
+    return extents;
+}
+
+bool ExtentReader::isOpen() const
+{
+    return mParent->isOpen() && !mRuns.empty();
+}
+
+Defs::addr ExtentReader::size() const
+{
+    return mSize;
+}
+
+int64_t ExtentReader::modificationTime() const
+{
+    return mParent->modificationTime();
+}
+
+std::size_t ExtentReader::readAt(Defs::addr offset, char* destination, std::size_t size) const
+{
+    if(offset >= mSize)
+        return 0;
+
+    if(size > mSize - offset)
+        size = mSize - offset;
+
+    // Last run starting at or before offset.
+    std::vector<Run>::const_iterator run = std::upper_bound(mRuns.begin(), mRuns.end(), offset,
+        [](Defs::addr value, const Run& r) { return value < r.logicalStart; }) - 1;
+
+    std::size_t totalRead = 0;
+    for(; run != mRuns.end() && totalRead < size; run++)
+    {
+        Defs::addr runOffset = offset + totalRead - run->logicalStart;
+        std::size_t toRead = size - totalRead;
+        if(toRead > run->length - runOffset)
+            toRead = run->length - runOffset;
+
+        std::size_t bytesRead = mParent->readAt(run->physicalStart + runOffset,
+                                                destination + totalRead, toRead);
+        totalRead += bytesRead;
+
+        if(bytesRead != toRead) // Parent file is truncated
+            break;
+    }
+
+    return totalRead;
+}
+
+void ExtentReader::readBatch(ReadRequest* requests, std::size_t count) const
+{
+    // Requests to the parent, and which of ours each belongs to.
+    std::vector<ReadRequest> parentRequests;
+    std::vector<std::size_t> owners;
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        ReadRequest& request = requests[i];
+        request.bytesRead = 0;
+        if(request.offset >= mSize)
+            continue;
+
+        std::size_t size = request.size;
+        if(size > mSize - request.offset)
+            size = mSize - request.offset;
+
+        std::vector<Run>::const_iterator run = std::upper_bound(mRuns.begin(), mRuns.end(), request.offset,
+            [](Defs::addr value, const Run& r) { return value < r.logicalStart; }) - 1;
+
+        std::size_t split = 0;
+        for(; run != mRuns.end() && split < size; run++)
+        {
+            Defs::addr runOffset = request.offset + split - run->logicalStart;
+            std::size_t toRead = size - split;
+            if(toRead > run->length - runOffset)
+                toRead = run->length - runOffset;
+
+            ReadRequest parentRequest = {run->physicalStart + runOffset, request.destination + split, toRead, 0};
+            parentRequests.push_back(parentRequest);
+            owners.push_back(i);
+            split += toRead;
+        }
+    }
+
+    mParent->readBatch(parentRequests.data(), parentRequests.size());
+
+    // Pieces are in order: a request got everything up to its first short piece.
+    std::vector<bool> truncated(count, false);
+    for(std::size_t i = 0; i < parentRequests.size(); i++)
+    {
+        std::size_t owner = owners[i];
+        if(truncated[owner])
+            continue;
+
+        requests[owner].bytesRead += parentRequests[i].bytesRead;
+        if(parentRequests[i].bytesRead != parentRequests[i].size) // Parent file is truncated
+            truncated[owner] = true;
+    }
+}
+
+bool ExtentReader::prefersBatches() const
+{
+    return mParent->prefersBatches();
+}
+
+std::size_t ExtentReader::copyToFile(Defs::addr offset, std::size_t size, int outputFileDescriptor) const
+{
+    if(offset >= mSize)
+        return 0;
+
+    if(size > mSize - offset)
+        size = mSize - offset;
+
+    // Last run starting at or before offset.
+    std::vector<Run>::const_iterator run = std::upper_bound(mRuns.begin(), mRuns.end(), offset,
+        [](Defs::addr value, const Run& r) { return value < r.logicalStart; }) - 1;
+
+    std::size_t totalCopied = 0;
+    for(; run != mRuns.end() && totalCopied < size; run++)
+    {
+        Defs::addr runOffset = offset + totalCopied - run->logicalStart;
+        std::size_t toCopy = size - totalCopied;
+        if(toCopy > run->length - runOffset)
+            toCopy = run->length - runOffset;
+
+        std::size_t bytesCopied = mParent->copyToFile(run->physicalStart + runOffset, toCopy,
+                                                      outputFileDescriptor);
+        totalCopied += bytesCopied;
+
+        if(bytesCopied != toCopy)
+            break;
+    }
+
+    return totalCopied;
+}
+
+const char* ExtentReader::data() const
+{
+    if(mRuns.size() != 1 || mParent->data() == nullptr)
+        return nullptr;
+
+    // Don't hand out a view running past the end of the mapping.
+    if(mRuns[0].physicalStart + mSize > mParent->size())
+        return nullptr;
+
+    return mParent->data() + mRuns[0].physicalStart;
+}
+
+} // namespace RESX
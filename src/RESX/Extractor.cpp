@@ -0,0 +1,295 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/Extractor.hpp"
+#include "RESX/ThreadPool.hpp"
+
+#include <atomic>
+#include <algorithm> // For min() and max()
+#include <iostream>
+#include <cerrno>
+#include <fcntl.h> // For open()
+#include <fstream>
+
+#ifdef _WIN32
+#include <direct.h> // For _mkdir()
+#include <sys/stat.h> // For _S_IREAD and _S_IWRITE
+#include <io.h> // For _open() and _close()
+#else
+#include <sys/stat.h> // For mkdir()
+#include <unistd.h> // For close()
+#endif
+
+namespace RESX
+{
+
+namespace
+{
+    // Upper bound on the span of data zone a batch covers. Smaller
+    // batches balance better, larger ones read more sequentially.
+    const Defs::addr maxBatchBytes = 1UL << 20; // 1 MiB
+
+    // Percent-encodes everything but [A-Za-z0-9._-].
+    void appendSafe(std::string& fileName, const std::string& text)
+    {
+        static const char hexDigits[] = "0123456789ABCDEF";
+
+        for(char c : text)
+        {
+            unsigned char u = static_cast<unsigned char>(c);
+            if((u >= 'A' && u <= 'Z') || (u >= 'a' && u <= 'z') || (u >= '0' && u <= '9') ||
+               u == '.' || u == '_' || u == '-')
+            {
+                fileName += c;
+            } else
+            {
+                fileName += '%';
+                fileName += hexDigits[u >> 4];
+                fileName += hexDigits[u & 0xF];
+            }
+        }
+    }
+
+    // Creates missing parent directories too.
+    bool makeDirectory(const std::string& path)
+    {
+        for(std::size_t separator = path.find_first_of("/\\", 1); ;
+            separator = path.find_first_of("/\\", separator + 1))
+        {
+            std::string directory = path.substr(0, separator);
+#ifdef _WIN32
+            int result = _mkdir(directory.c_str());
+#else
+            int result = mkdir(directory.c_str(), 0777);
+#endif
+            if(result != 0 && errno != EEXIST)
+                return false;
+
+            if(separator == std::string::npos)
+                return true;
+        }
+    }
+}
+
+Extractor::Extractor(ResourceFork& resourceFork, const std::string& outputDirectory)
+    : mResourceFork(resourceFork),
+    mOutputDirectory(outputDirectory),
+    mThreadCount(1)
+{
+    if(!makeDirectory(mOutputDirectory))
+        std::cerr << "Could not create output directory '" << mOutputDirectory << "'!" << std::endl;
+}
+
+Extractor::~Extractor()
+{
+
+}
+
+void Extractor::setThreadCount(unsigned int threadCount)
+{
+    mThreadCount = threadCount;
+}
+
+// Static
+std::string Extractor::safeFileName(const std::string& text)
+{
+    std::string fileName;
+    appendSafe(fileName, text);
+    return fileName;
+}
+
+// Static
+std::string Extractor::outputFileName(const ResourceInfo& info)
+{
+    std::string fileName;
+    appendSafe(fileName, info.type);
+    fileName += '_';
+    fileName += std::to_string(info.ID);
+
+    if(!info.name.empty())
+    {
+        fileName += '_';
+        appendSafe(fileName, info.name);
+    }
+
+    return fileName;
+}
+
+// Static
+bool Extractor::writeResource(const ResourceFork& resourceFork, const ResourceInfo& info,
+                              const std::string& outputPath)
+{
+#ifdef _WIN32
+    int file = _open(outputPath.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    int file = open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+#endif
+    if(file < 0)
+    {
+        std::cerr << "Cannot open file '" << outputPath << "' for writing!" << std::endl;
+        return false;
+    }
+
+    bool copied = resourceFork.copyResourceToFile(info, file);
+
+#ifdef _WIN32
+    bool closed = _close(file) == 0;
+#else
+    bool closed = close(file) == 0;
+#endif
+    if(!copied || !closed)
+    {
+        std::cerr << "Writing to '" << outputPath << "' failed!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool Extractor::extractResource(const ResourceInfo& info)
+{
+    return writeResource(mResourceFork, info, mOutputDirectory + "/" + outputFileName(info));
+}
+
+// Reads infos[first] to infos[last - 1] in one batch, then writes them out.
+std::size_t Extractor::extractBatch(const std::vector<ResourceInfo>& infos, std::size_t first, std::size_t last)
+{
+    std::vector<ResourceKey> keys;
+    for(std::size_t i = first; i < last; i++)
+        keys.push_back(ResourceKey(infos[i].type, infos[i].ID));
+
+    ResourceBatch batch = mResourceFork.getResources(keys);
+
+    std::size_t extractedCount = 0;
+    for(std::size_t i = first; i < last; i++)
+    {
+        const ResourceView& view = batch.views[i - first];
+        if(view.data == nullptr)
+            continue; // Error messages already sent.
+
+        std::string outputPath = mOutputDirectory + "/" + outputFileName(infos[i]);
+        std::ofstream file(outputPath, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+        file.write(view.data, view.size);
+        file.close();
+        if(file.fail())
+        {
+            std::cerr << "Writing to '" << outputPath << "' failed!" << std::endl;
+            continue;
+        }
+
+        extractedCount++;
+    }
+
+    return extractedCount;
+}
+
+// infos must be sorted by address.
+std::size_t Extractor::extractResources(const std::vector<ResourceInfo>& infos)
+{
+    if(mThreadCount != 1 && infos.size() > 1)
+        return extractResourcesInParallel(infos);
+
+    std::size_t extractedCount = 0;
+    if(mResourceFork.prefersBatches())
+    {
+        std::size_t batchStart = 0;
+        for(std::size_t i = 1; i <= infos.size(); i++)
+        {
+            if(i == infos.size() || infos[i].address - infos[batchStart].address >= maxBatchBytes)
+            {
+                extractedCount += extractBatch(infos, batchStart, i);
+                batchStart = i;
+            }
+        }
+
+        return extractedCount;
+    }
+
+    for(const ResourceInfo& info : infos)
+    {
+        if(extractResource(info))
+            extractedCount++;
+    }
+
+    return extractedCount;
+}
+
+// infos must be sorted by address.
+std::size_t Extractor::extractResourcesInParallel(const std::vector<ResourceInfo>& infos)
+{
+    ThreadPool threadPool(mThreadCount);
+    std::size_t threadCount = threadPool.threadCount();
+
+    // Aim for a few batches per thread so that stealing can even things out.
+    // The address span between neighbours stands in for resource sizes,
+    // which we don't have without reading the data zone.
+    Defs::addr totalSpan = infos.back().address - infos.front().address;
+    Defs::addr batchBytes = std::max<Defs::addr>(1,
+        std::min<Defs::addr>(maxBatchBytes, totalSpan / (threadCount * 8)));
+
+    // First: index of the first resource of the batch.
+    // Second: one past the last.
+    std::vector<std::pair<std::size_t, std::size_t>> batches;
+    std::size_t batchStart = 0;
+    for(std::size_t i = 1; i <= infos.size(); i++)
+    {
+        if(i == infos.size() || infos[i].address - infos[batchStart].address >= batchBytes)
+        {
+            batches.push_back(std::make_pair(batchStart, i));
+            batchStart = i;
+        }
+    }
+
+    std::atomic<std::size_t> extractedCount(0);
+    for(std::size_t i = 0; i < batches.size(); i++)
+    {
+        std::pair<std::size_t, std::size_t> batch = batches[i];
+
+        // Contiguous runs of batches per thread.
+        threadPool.submit(i * threadCount / batches.size(), [this, &infos, &extractedCount, batch]()
+        {
+            if(mResourceFork.prefersBatches())
+            {
+                extractedCount += extractBatch(infos, batch.first, batch.second);
+                return;
+            }
+
+            for(std::size_t j = batch.first; j < batch.second; j++)
+            {
+                if(extractResource(infos[j]))
+                    extractedCount++;
+            }
+        });
+    }
+
+    threadPool.wait();
+    return extractedCount;
+}
+
+// Extract every resource of the fork.
+std::size_t Extractor::extractAll()
+{
+    return extractResources(mResourceFork.getResourcesInfo());
+}
+
+// Extract every resource of type.
+std::size_t Extractor::extractAll(const std::string& type)
+{
+    return extractResources(mResourceFork.getResourcesInfo(type));
+}
+
+} // namespace RESX
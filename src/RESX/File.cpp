@@ -18,6 +18,8 @@
 #include "RESX/File.hpp"
 #include "RESX/ResourceFork.hpp"
 #include "RESX/Defs.hpp"
+#include "RESX/MappedReader.hpp"
+#include "RESX/PositionalReader.hpp"
 
 #include <iostream>
 
@@ -25,13 +27,32 @@ namespace RESX
 {
 
 // blockSize in bytes
-File::File(const std::string& HFSFileName, unsigned int blockSize)
+File::File(const std::string& HFSFileName, unsigned int blockSize, bool memoryMap)
     : mHFSFileName(HFSFileName),
-    mHFSFile(new std::ifstream), // Create the file stream
     mBlockSize(blockSize)
 {
-    mHFSFile->open(mHFSFileName, std::ios::binary);
-    if( !(*mHFSFile) )
+    if(memoryMap)
+    {
+        readerPointer mappedReader(new MappedReader(mHFSFileName));
+        if(mappedReader->isOpen())
+        {
+            mReader = mappedReader;
+            return;
+        }
+    }
+
+    // Fallback: plain reads, still without a shared cursor
+    mReader = readerPointer(new PositionalReader(mHFSFileName));
+    if(!mReader->isOpen())
+        std::cerr << "Could not open HFS file!" << std::endl;
+}
+
+File::File(const std::string& HFSFileName, unsigned int blockSize, readerPointer reader)
+    : mHFSFileName(HFSFileName),
+    mReader(reader),
+    mBlockSize(blockSize)
+{
+    if(!mReader->isOpen())
         std::cerr << "Could not open HFS file!" << std::endl;
 }
 
@@ -40,11 +61,35 @@ File::~File()
 
 }
 
+bool File::isMemoryMapped() const
+{
+    return mReader->data() != nullptr;
+}
+
+File::readerPointer File::getReader() const
+{
+    return mReader;
+}
+
+void File::setBlockSize(unsigned int blockSize)
+{
+    mBlockSize = blockSize;
+}
+
+// Factory method
+ResourceFork File::loadResourceFork(unsigned int firstBlock, const std::string& indexPath)
+{
+    Defs::addr blockStartAddress = static_cast<Defs::addr>(firstBlock) * mBlockSize;
+    return ResourceFork(mReader, blockStartAddress, indexPath);
+}
+
 // Factory method
-ResourceFork File::loadResourceFork(unsigned int firstBlock)
+ResourceFork File::loadResourceFork(const std::vector<Extent>& extents, Defs::addr logicalSize,
+                                    const std::string& indexPath)
 {
-    Defs::addr blockStartAddress = firstBlock * mBlockSize;
-    return ResourceFork(mHFSFile, blockStartAddress);
+    // The extent reader starts at the start of the fork.
+    readerPointer extentReader(new ExtentReader(mReader, extents, mBlockSize, logicalSize));
+    return ResourceFork(extentReader, 0, indexPath);
 }
 
 } // namespace RESX
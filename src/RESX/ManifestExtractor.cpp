@@ -0,0 +1,308 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/ManifestExtractor.hpp"
+#include "RESX/Extractor.hpp"
+#include "RESX/ThreadPool.hpp"
+
+#include <algorithm> // For sort() and min()
+#include <atomic>
+#include <cerrno>
+#include <climits> // For UINT_MAX
+#include <condition_variable>
+#include <cstdint> // For INT16_MIN and INT16_MAX
+#include <cstdlib> // For strtoll()
+#include <fstream>
+#include <iostream>
+#include <memory> // For smart pointers
+#include <mutex>
+
+namespace RESX
+{
+
+namespace
+{
+    // Records one task writes, in address order. Small enough for the
+    // threads to balance, and for getResources() to hold at once.
+    const std::size_t recordsPerTask = 256;
+
+    // The fork of a group, kept open while its records are written.
+    struct OpenFork
+    {
+        File file;
+        ResourceFork resourceFork;
+        // With their output files, in address order.
+        std::vector<std::pair<ResourceInfo, const std::string*>> resources;
+
+        OpenFork(File openedFile, unsigned int startBlock)
+            : file(std::move(openedFile)),
+            resourceFork(file.loadResourceFork(startBlock))
+        {
+
+        }
+    };
+
+    // Only digits, with an optional '-'.
+    bool parseNumber(const std::string& text, long long* value)
+    {
+        std::size_t first = (!text.empty() && text[0] == '-') ? 1 : 0;
+        if(text.size() == first || text.find_first_not_of("0123456789", first) != std::string::npos)
+            return false;
+
+        errno = 0;
+        *value = std::strtoll(text.c_str(), nullptr, 10);
+        return errno == 0;
+    }
+
+    // Writes resources[first] to resources[last - 1].
+    std::size_t writeResources(const OpenFork& openFork, std::size_t first, std::size_t last)
+    {
+        std::size_t writtenCount = 0;
+        if(!openFork.resourceFork.prefersBatches())
+        {
+            for(std::size_t i = first; i < last; i++)
+            {
+                if(Extractor::writeResource(openFork.resourceFork, openFork.resources[i].first,
+                                            *openFork.resources[i].second))
+                {
+                    writtenCount++;
+                }
+            }
+
+            return writtenCount;
+        }
+
+        std::vector<ResourceKey> keys;
+        for(std::size_t i = first; i < last; i++)
+            keys.push_back(ResourceKey(openFork.resources[i].first.type, openFork.resources[i].first.ID));
+
+        ResourceBatch batch = openFork.resourceFork.getResources(keys);
+        for(std::size_t i = first; i < last; i++)
+        {
+            const ResourceView& view = batch.views[i - first];
+            if(view.data == nullptr)
+                continue; // Error messages already sent.
+
+            const std::string& outputPath = *openFork.resources[i].second;
+            std::ofstream file(outputPath, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+            file.write(view.data, view.size);
+            file.close();
+            if(file.fail())
+            {
+                std::cerr << "Writing to '" << outputPath << "' failed!" << std::endl;
+                continue;
+            }
+
+            writtenCount++;
+        }
+
+        return writtenCount;
+    }
+}
+
+ManifestExtractor::ManifestExtractor(fileOpener openFile)
+    : mOpenFile(openFile),
+    mThreadCount(1),
+    mDecompress(false),
+    mRecordCount(0)
+{
+
+}
+
+ManifestExtractor::~ManifestExtractor()
+{
+
+}
+
+bool ManifestExtractor::addRecord(const std::string& line, std::size_t lineNumber)
+{
+    std::vector<std::string> fields;
+    for(std::size_t start = 0; ; )
+    {
+        std::size_t tab = line.find('\t', start);
+        fields.push_back(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+        if(tab == std::string::npos)
+            break;
+
+        start = tab + 1;
+    }
+
+    if(fields.size() != 5)
+    {
+        std::cerr << "Line " << lineNumber << " of the manifest has " << fields.size() <<
+            " fields instead of 5 (INPUT_FILE, START_BLOCK, TYPE, ID_OR_NAME, OUTPUT_FILE)!" << std::endl;
+        return false;
+    }
+
+    long long startBlock;
+    if(fields[0].empty() || !parseNumber(fields[1], &startBlock) || startBlock < 0 || startBlock > UINT_MAX)
+    {
+        std::cerr << "Invalid input file or start block on line " << lineNumber << " of the manifest!" << std::endl;
+        return false;
+    }
+
+    if(fields[2].size() != 4 || fields[3].empty() || fields[4].empty())
+    {
+        std::cerr << "Invalid type, ID, name or output file on line " << lineNumber << " of the manifest!" <<
+            std::endl;
+        return false;
+    }
+
+    long long ID = 0;
+    bool byID = parseNumber(fields[3], &ID);
+    if(byID && (ID < INT16_MIN || ID > INT16_MAX))
+    {
+        std::cerr << "Invalid ID on line " << lineNumber << " of the manifest!" << std::endl;
+        return false;
+    }
+
+    std::pair<std::string, unsigned int> input(fields[0], static_cast<unsigned int>(startBlock));
+    auto found = mGroupIndices.find(input);
+    if(found == mGroupIndices.end())
+    {
+        found = mGroupIndices.insert(std::make_pair(input, mGroups.size())).first;
+        mGroups.push_back(Group());
+        mGroups.back().inputFile = input.first;
+        mGroups.back().startBlock = input.second;
+    }
+
+    Record record = {byID ? ResourceKey(fields[2], static_cast<int>(ID)) : ResourceKey(fields[2], fields[3]),
+                     fields[4], lineNumber};
+    mGroups[found->second].records.push_back(std::move(record));
+    mRecordCount++;
+    return true;
+}
+
+bool ManifestExtractor::load(std::istream& manifest)
+{
+    std::string line;
+    for(std::size_t lineNumber = 1; std::getline(manifest, line); lineNumber++)
+    {
+        // Written on Windows
+        if(!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        if(line.empty() || line[0] == '#')
+            continue;
+
+        if(!addRecord(line, lineNumber))
+            return false;
+    }
+
+    return true;
+}
+
+std::size_t ManifestExtractor::recordCount() const
+{
+    return mRecordCount;
+}
+
+std::size_t ManifestExtractor::inputCount() const
+{
+    return mGroups.size();
+}
+
+void ManifestExtractor::setThreadCount(unsigned int threadCount)
+{
+    mThreadCount = threadCount;
+}
+
+void ManifestExtractor::setDecompression(bool decompress)
+{
+    mDecompress = decompress;
+}
+
+std::size_t ManifestExtractor::extractAll()
+{
+    ThreadPool threadPool(mThreadCount);
+    std::size_t threadCount = threadPool.threadCount();
+
+    // Forks are opened as groups are queued, and closed when their last
+    // run is written. Past a few per thread, queuing waits, so that a
+    // manifest of many files does not open them all at once.
+    std::size_t openForkLimit = threadCount * 2;
+    std::size_t openForkCount = 0;
+    std::mutex openForkMutex;
+    std::condition_variable forkClosed;
+
+    std::atomic<std::size_t> extractedCount(0);
+    for(std::size_t i = 0; i < mGroups.size(); i++)
+    {
+        {
+            std::unique_lock<std::mutex> lock(openForkMutex);
+            forkClosed.wait(lock, [&]() { return openForkCount < openForkLimit; });
+            openForkCount++;
+        }
+
+        const Group& group = mGroups[i];
+        threadPool.submit(i, [this, &group, &threadPool, &extractedCount, &openForkCount, &openForkMutex,
+                              &forkClosed, i]()
+        {
+            std::shared_ptr<OpenFork> openFork(new OpenFork(mOpenFile(group.inputFile), group.startBlock),
+                [&openForkCount, &openForkMutex, &forkClosed](OpenFork* closedFork)
+            {
+                delete closedFork;
+
+                std::lock_guard<std::mutex> lock(openForkMutex);
+                openForkCount--;
+                forkClosed.notify_one();
+            });
+
+            if(!openFork->file.getReader()->isOpen())
+            {
+                std::cerr << "Skipping the resources of '" << group.inputFile << "'!" << std::endl;
+                return;
+            }
+
+            openFork->resourceFork.setDecompression(mDecompress);
+            for(const Record& record : group.records)
+            {
+                ResourceInfo info;
+                if(!openFork->resourceFork.getResourceInfo(record.key, &info))
+                {
+                    std::cerr << "Skipping line " << record.line << " of the manifest!" << std::endl;
+                    continue;
+                }
+
+                openFork->resources.push_back(std::make_pair(info, &record.outputFile));
+            }
+
+            // Reading in address order scans the input sequentially.
+            std::stable_sort(openFork->resources.begin(), openFork->resources.end(),
+                [](const std::pair<ResourceInfo, const std::string*>& a,
+                   const std::pair<ResourceInfo, const std::string*>& b)
+            {
+                return a.first.address < b.first.address;
+            });
+
+            // Neighbouring runs to neighbouring threads, the first to this one.
+            for(std::size_t first = 0; first < openFork->resources.size(); first += recordsPerTask)
+            {
+                std::size_t last = std::min(openFork->resources.size(), first + recordsPerTask);
+                threadPool.submit(i + first / recordsPerTask, [openFork, first, last, &extractedCount]()
+                {
+                    extractedCount += writeResources(*openFork, first, last);
+                });
+            }
+        });
+    }
+
+    threadPool.wait();
+    return extractedCount;
+}
+
+} // namespace RESX
@@ -0,0 +1,175 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/MappedReader.hpp"
+#include "RESX/PositionalReader.hpp"
+
+#include <cstring> // For std::memcpy
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace RESX
+{
+
+// Failing to map is not an error: check isOpen() and fall back
+// to another reader.
+MappedReader::MappedReader(const std::string& fileName)
+    : mData(nullptr),
+    mSize(0),
+    mModificationTime(0)
+#ifdef _WIN32
+    , mFileHandle(INVALID_HANDLE_VALUE),
+    mMappingHandle(nullptr)
+#else
+    , mFileDescriptor(-1)
+#endif
+{
+#ifdef _WIN32
+    mFileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(mFileHandle == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(mFileHandle, &fileSize) || fileSize.QuadPart == 0)
+        return;
+
+    FILETIME lastWriteTime;
+    if(GetFileTime(mFileHandle, nullptr, nullptr, &lastWriteTime))
+        mModificationTime = (static_cast<int64_t>(lastWriteTime.dwHighDateTime) << 32) | lastWriteTime.dwLowDateTime;
+
+    mMappingHandle = CreateFileMappingA(mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mMappingHandle == nullptr)
+        return;
+
+    mData = static_cast<const char*>(MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if(mData != nullptr)
+        mSize = static_cast<Defs::addr>(fileSize.QuadPart);
+#else
+    mFileDescriptor = open(fileName.c_str(), O_RDONLY);
+    if(mFileDescriptor < 0)
+        return;
+
+    struct stat fileStat;
+    // mmap() refuses empty files.
+    if(fstat(mFileDescriptor, &fileStat) == 0 && fileStat.st_size > 0)
+    {
+        mModificationTime = PositionalReader::modificationTimeOf(fileStat);
+
+        void* mapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_SHARED, mFileDescriptor, 0);
+        if(mapping != MAP_FAILED)
+        {
+            mData = static_cast<const char*>(mapping);
+            mSize = static_cast<Defs::addr>(fileStat.st_size);
+        }
+    }
+#endif
+}
+
+MappedReader::~MappedReader()
+{
+#ifdef _WIN32
+    if(mData != nullptr)
+        UnmapViewOfFile(mData);
+    if(mMappingHandle != nullptr)
+        CloseHandle(mMappingHandle);
+    if(mFileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(mFileHandle);
+#else
+    if(mData != nullptr)
+        munmap(const_cast<char*>(mData), mSize);
+    if(mFileDescriptor >= 0)
+        close(mFileDescriptor);
+#endif
+}
+
+bool MappedReader::isOpen() const
+{
+    return mData != nullptr;
+}
+
+Defs::addr MappedReader::size() const
+{
+    return mSize;
+}
+
+int64_t MappedReader::modificationTime() const
+{
+    return mModificationTime;
+}
+
+std::size_t MappedReader::readAt(Defs::addr offset, char* destination, std::size_t size) const
+{
+    if(offset >= mSize)
+        return 0;
+
+    if(size > mSize - offset)
+        size = mSize - offset;
+
+    std::memcpy(destination, mData + offset, size);
+    return size;
+}
+
+// Through the file descriptor rather than the mapping, so that the pages
+// are never mapped into this process. Where the kernel cannot copy between
+// files, a plain write() from the mapping still avoids a user-space buffer.
+std::size_t MappedReader::copyToFile(Defs::addr offset, std::size_t size, int outputFileDescriptor) const
+{
+#ifdef _WIN32
+    (void)offset; (void)size; (void)outputFileDescriptor;
+    return 0;
+#else
+    if(offset >= mSize)
+        return 0;
+
+    if(size > mSize - offset)
+        size = mSize - offset;
+
+    std::size_t totalCopied = PositionalReader::copyFileRange(mFileDescriptor, offset, size,
+                                                              outputFileDescriptor);
+    while(totalCopied < size)
+    {
+        ssize_t bytesWritten = write(outputFileDescriptor, mData + offset + totalCopied, size - totalCopied);
+        if(bytesWritten < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        totalCopied += static_cast<std::size_t>(bytesWritten);
+    }
+
+    return totalCopied;
+#endif
+}
+
+const char* MappedReader::data() const
+{
+    return mData;
+}
+
+} // namespace RESX
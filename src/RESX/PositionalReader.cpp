@@ -0,0 +1,220 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/PositionalReader.hpp"
+
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+namespace RESX
+{
+
+PositionalReader::PositionalReader(const std::string& fileName)
+    : mSize(0),
+    mModificationTime(0)
+{
+#ifdef _WIN32
+    mFileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    LARGE_INTEGER fileSize;
+    if(mFileHandle != INVALID_HANDLE_VALUE && GetFileSizeEx(mFileHandle, &fileSize))
+        mSize = static_cast<Defs::addr>(fileSize.QuadPart);
+
+    FILETIME lastWriteTime;
+    if(mFileHandle != INVALID_HANDLE_VALUE && GetFileTime(mFileHandle, nullptr, nullptr, &lastWriteTime))
+        mModificationTime = (static_cast<int64_t>(lastWriteTime.dwHighDateTime) << 32) | lastWriteTime.dwLowDateTime;
+#else
+    mFileDescriptor = open(fileName.c_str(), O_RDONLY);
+
+    struct stat fileStat;
+    if(mFileDescriptor >= 0 && fstat(mFileDescriptor, &fileStat) == 0)
+    {
+        mSize = static_cast<Defs::addr>(fileStat.st_size);
+        mModificationTime = modificationTimeOf(fileStat);
+    }
+#endif
+}
+
+PositionalReader::~PositionalReader()
+{
+#ifdef _WIN32
+    if(mFileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(mFileHandle);
+#else
+    if(mFileDescriptor >= 0)
+        close(mFileDescriptor);
+#endif
+}
+
+bool PositionalReader::isOpen() const
+{
+#ifdef _WIN32
+    return mFileHandle != INVALID_HANDLE_VALUE;
+#else
+    return mFileDescriptor >= 0;
+#endif
+}
+
+Defs::addr PositionalReader::size() const
+{
+    return mSize;
+}
+
+int64_t PositionalReader::modificationTime() const
+{
+    return mModificationTime;
+}
+
+// Loops over short reads, until size bytes are read or the end of the file is reached.
+std::size_t PositionalReader::readAt(Defs::addr offset, char* destination, std::size_t size) const
+{
+    std::size_t totalRead = 0;
+
+    while(totalRead < size)
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped = {};
+        Defs::addr position = offset + totalRead;
+        overlapped.Offset = static_cast<DWORD>(position & 0xFFFFFFFFUL);
+        overlapped.OffsetHigh = static_cast<DWORD>(static_cast<unsigned long long>(position) >> 32);
+
+        // ReadFile() takes a 32-bit size.
+        std::size_t remaining = size - totalRead;
+        DWORD toRead = remaining > 0x40000000UL ? 0x40000000UL : static_cast<DWORD>(remaining);
+        DWORD bytesRead = 0;
+        if(!ReadFile(mFileHandle, destination + totalRead, toRead, &bytesRead, &overlapped))
+        {
+            if(GetLastError() != ERROR_HANDLE_EOF)
+                std::cerr << "Read error at offset " << position << "!" << std::endl;
+            break;
+        }
+#else
+        ssize_t bytesRead = pread(mFileDescriptor, destination + totalRead, size - totalRead,
+                                  static_cast<off_t>(offset + totalRead));
+        if(bytesRead < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            std::cerr << "Read error at offset " << offset + totalRead << "!" << std::endl;
+            break;
+        }
+#endif
+
+        if(bytesRead == 0) // End of file
+            break;
+
+        totalRead += static_cast<std::size_t>(bytesRead);
+    }
+
+    return totalRead;
+}
+
+std::size_t PositionalReader::copyToFile(Defs::addr offset, std::size_t size, int outputFileDescriptor) const
+{
+#ifdef _WIN32
+    (void)offset; (void)size; (void)outputFileDescriptor;
+    return 0;
+#else
+    return copyFileRange(mFileDescriptor, offset, size, outputFileDescriptor);
+#endif
+}
+
+#ifndef _WIN32
+// Static
+// In nanoseconds since the epoch.
+int64_t PositionalReader::modificationTimeOf(const struct stat& fileStat)
+{
+#ifdef __APPLE__
+    const struct timespec& modified = fileStat.st_mtimespec;
+#else
+    const struct timespec& modified = fileStat.st_mtim;
+#endif
+    return static_cast<int64_t>(modified.tv_sec) * 1000000000LL + modified.tv_nsec;
+}
+
+// Static
+// copy_file_range() lets the filesystem share or copy the extents itself.
+// It is refused across filesystems on older kernels, where sendfile()
+// still moves the bytes page cache to page cache.
+std::size_t PositionalReader::copyFileRange(int inputFileDescriptor, Defs::addr offset, std::size_t size,
+                                            int outputFileDescriptor)
+{
+#ifdef __linux__
+    std::size_t totalCopied = 0;
+#ifdef SYS_copy_file_range
+    bool useCopyFileRange = true;
+#endif
+
+    while(totalCopied < size)
+    {
+        ssize_t bytesCopied = -1;
+
+#ifdef SYS_copy_file_range
+        if(useCopyFileRange)
+        {
+            loff_t inputOffset = static_cast<loff_t>(offset + totalCopied);
+            bytesCopied = syscall(SYS_copy_file_range, inputFileDescriptor, &inputOffset, outputFileDescriptor,
+                                  nullptr, size - totalCopied, 0U);
+            if(bytesCopied < 0 && errno != EINTR)
+            {
+                // ENOSYS, EXDEV, EINVAL...: not for this pair of files.
+                useCopyFileRange = false;
+                continue;
+            }
+        } else
+#endif
+        {
+            off_t sendfileOffset = static_cast<off_t>(offset + totalCopied);
+            bytesCopied = sendfile(outputFileDescriptor, inputFileDescriptor, &sendfileOffset,
+                                   size - totalCopied);
+            if(bytesCopied < 0 && errno != EINTR)
+                break; // Let the caller fall back to reads
+        }
+
+        if(bytesCopied < 0) // EINTR
+            continue;
+
+        if(bytesCopied == 0) // End of file
+            break;
+
+        totalCopied += static_cast<std::size_t>(bytesCopied);
+    }
+
+    return totalCopied;
+#else
+    (void)inputFileDescriptor; (void)offset; (void)size; (void)outputFileDescriptor;
+    return 0;
+#endif
+}
+#endif
+
+} // namespace RESX
@@ -0,0 +1,150 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/Protocol.hpp"
+
+#include <cerrno>
+#include <cstring> // For std::memcpy
+
+#include <sys/socket.h>
+#include <unistd.h> // For close()
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // Not on macOS, where SO_NOSIGPIPE is set on the socket instead
+#endif
+
+namespace RESX
+{
+
+// Static
+const char* Protocol::statusString(uint16_t status)
+{
+    switch(status)
+    {
+        case ok: return "ok";
+        case badRequest: return "bad request";
+        case cannotOpen: return "cannot open the resource fork";
+        case notFound: return "resource not found";
+        case cannotRead: return "cannot read the resource";
+        case disconnected: return "disconnected";
+        default: return "unknown status";
+    }
+}
+
+// Static
+bool Protocol::sendAll(int socket, const char* data, std::size_t size, int fileDescriptor)
+{
+    while(size > 0)
+    {
+        iovec vector;
+        vector.iov_base = const_cast<char*>(data);
+        vector.iov_len = size;
+
+        msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+
+        // The descriptor goes with the first bytes only.
+        char control[CMSG_SPACE(sizeof(int))];
+        if(fileDescriptor != -1)
+        {
+            std::memset(control, 0, sizeof(control));
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+
+            cmsghdr* header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(header), &fileDescriptor, sizeof(int));
+        }
+
+        ssize_t sent = ::sendmsg(socket, &message, MSG_NOSIGNAL);
+        if(sent < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        data += sent;
+        size -= static_cast<std::size_t>(sent);
+        fileDescriptor = -1;
+    }
+
+    return true;
+}
+
+// Static
+bool Protocol::receiveAll(int socket, char* data, std::size_t size, int* fileDescriptor)
+{
+    if(fileDescriptor != nullptr)
+        *fileDescriptor = -1;
+
+    while(size > 0)
+    {
+        iovec vector;
+        vector.iov_base = data;
+        vector.iov_len = size;
+
+        char control[CMSG_SPACE(sizeof(int))];
+        msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t received = ::recvmsg(socket, &message, 0);
+        if(received < 0 && errno == EINTR)
+            continue;
+
+        if(received <= 0)
+        {
+            if(fileDescriptor != nullptr && *fileDescriptor != -1)
+            {
+                ::close(*fileDescriptor);
+                *fileDescriptor = -1;
+            }
+
+            return false;
+        }
+
+        for(cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr;
+            header = CMSG_NXTHDR(&message, header))
+        {
+            if(header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+                continue;
+
+            int receivedDescriptor;
+            std::memcpy(&receivedDescriptor, CMSG_DATA(header), sizeof(int));
+            if(fileDescriptor != nullptr && *fileDescriptor == -1)
+                *fileDescriptor = receivedDescriptor;
+            else
+                ::close(receivedDescriptor);
+        }
+
+        data += received;
+        size -= static_cast<std::size_t>(received);
+    }
+
+    return true;
+}
+
+} // namespace RESX
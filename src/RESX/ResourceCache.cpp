@@ -0,0 +1,90 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/ResourceCache.hpp"
+
+namespace RESX
+{
+
+ResourceCache::ResourceCache(std::size_t budget)
+    : mBudget(budget),
+    mBytes(0),
+    mHits(0),
+    mMisses(0),
+    mEvictions(0)
+{
+
+}
+
+ResourceCache::~ResourceCache()
+{
+
+}
+
+bool ResourceCache::find(Defs::addr address, ResourceBuffer* buffer)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    std::unordered_map<Defs::addr, std::list<Entry>::iterator>::iterator found = mLookup.find(address);
+    if(found == mLookup.end())
+    {
+        mMisses++;
+        return false;
+    }
+
+    // Move to the front, no allocation.
+    mEntries.splice(mEntries.begin(), mEntries, found->second);
+    *buffer = found->second->buffer;
+    mHits++;
+    return true;
+}
+
+void ResourceCache::insert(Defs::addr address, const ResourceBuffer& buffer)
+{
+    if(buffer.data == nullptr || buffer.size > mBudget)
+        return;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // Another thread may have read it at the same time.
+    if(mLookup.find(address) != mLookup.end())
+        return;
+
+    while(!mEntries.empty() && mBytes + buffer.size > mBudget)
+    {
+        const Entry& leastRecent = mEntries.back();
+        mBytes -= leastRecent.buffer.size;
+        mLookup.erase(leastRecent.address);
+        mEntries.pop_back();
+        mEvictions++;
+    }
+
+    Entry entry = {address, buffer};
+    mEntries.push_front(entry);
+    mLookup[address] = mEntries.begin();
+    mBytes += buffer.size;
+}
+
+ResourceCache::Stats ResourceCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    Stats stats = {mHits, mMisses, mEvictions, mEntries.size(), mBytes, mBudget};
+    return stats;
+}
+
+} // namespace RESX
@@ -16,16 +16,93 @@
 // along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
 
 #include "RESX/ResourceFork.hpp"
+#include "RESX/StreamReader.hpp"
+#include "RESX/Decoder.hpp"
+#include "RESX/Decompressor.hpp"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <cerrno>
+#include <unistd.h>
+#endif
 
 namespace RESX
 {
 
+const std::size_t ResourceFork::defaultChunkSize;
+
+namespace
+{
+    // Requested resources closer than this to each other are read at
+    // once: reading the bytes in between costs less than another read.
+    const Defs::addr maxCoalesceGap = 16UL << 10; // 16 KiB
+
+    // Loops over short writes. Returns false on error.
+    bool writeToFile(int fileDescriptor, const char* data, std::size_t size)
+    {
+        while(size > 0)
+        {
+#ifdef _WIN32
+            // _write() takes a 32-bit size.
+            unsigned int toWrite = size > 0x40000000UL ? 0x40000000U : static_cast<unsigned int>(size);
+            int bytesWritten = _write(fileDescriptor, data, toWrite);
+            if(bytesWritten < 0)
+                return false;
+#else
+            ssize_t bytesWritten = write(fileDescriptor, data, size);
+            if(bytesWritten < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+
+                return false;
+            }
+#endif
+
+            data += bytesWritten;
+            size -= static_cast<std::size_t>(bytesWritten);
+        }
+
+        return true;
+    }
+
+    // Hands data to sink in chunks of at most chunkSize bytes.
+    std::size_t streamBuffer(const char* data, std::size_t size, const ResourceFork::chunkSink& sink,
+                             std::size_t chunkSize)
+    {
+        std::size_t streamed = 0;
+        while(streamed < size)
+        {
+            std::size_t toStream = std::min(chunkSize, size - streamed);
+            if(!sink(data + streamed, toStream))
+                break;
+
+            streamed += toStream;
+        }
+
+        return streamed;
+    }
+}
+
 // Note: It would be chill to have a const HFSFile, but since
 // you always need to modify a file stream to read from it (move
 // the cursor around, etc), a const file stream is pretty much
 // useless.
 ResourceFork::ResourceFork(ifstreamPointer HFSFile, Defs::addr startAddress)
-    : mHFSFile(HFSFile),
+    : ResourceFork(readerPointer(new StreamReader(HFSFile)), startAddress)
+{
+
+}
+
+ResourceFork::ResourceFork(readerPointer reader, Defs::addr startAddress)
+    : ResourceFork(reader, startAddress, std::string())
+{
+
+}
+
+ResourceFork::ResourceFork(readerPointer reader, Defs::addr startAddress, const std::string& indexPath)
+    : mReader(reader),
     mStartAddr(startAddress),
     mResourceDataZoneAddr(0),
     mResourceMapAddr(0),
@@ -34,14 +111,19 @@ ResourceFork::ResourceFork(ifstreamPointer HFSFile, Defs::addr startAddress)
 
     mResourceTypeListAddr(0),
     mResourceNameListAddr(0),
-    mNumberOfTypesMinusOne(0)
+    mNumberOfTypesMinusOne(0),
+
+    mDecompress(false),
+    mLastExpanded(std::make_shared<ExpandedResource>())
 {
+    mLastExpanded->address = 0;
+
     checkFloatingTypes();
 
-    if(mHFSFile->is_open())
+    if(mReader->isOpen())
     {
         parseHeader();
-        parseResourceMapFields();
+        loadResourceMap(indexPath);
     } else
     {
         std::cerr << "HFS file is not open! Cannot create resource fork!" << std::endl;
@@ -53,6 +135,11 @@ ResourceFork::~ResourceFork()
 
 }
 
+bool ResourceFork::isMemoryMapped() const
+{
+    return mReader->data() != nullptr;
+}
+
 // Static inline
 // To make sure reading floating-types from files will work on this system.
 void ResourceFork::checkFloatingTypes()
@@ -73,196 +160,252 @@ void ResourceFork::checkFloatingTypes()
 
 void ResourceFork::parseHeader()
 {
-    // Set cursor to start of resource fork
-    mHFSFile->seekg(mStartAddr, std::ios::beg);
+    RESX_STATS_TIME_PHASE(mStats, parseHeader);
+
+    // The header sits at the start of the resource fork
+    char header[16];
+    readBytes(mStartAddr, header, sizeof(header), "resource fork header");
+    Decoder decoder(header, sizeof(header));
 
-    mResourceDataZoneAddr = mStartAddr +
-                            readSinglePrimitive<Defs::addr>(mHFSFile, 4UL);
-    mResourceMapAddr = mStartAddr +
-                            readSinglePrimitive<Defs::addr>(mHFSFile, 4UL);
-    mResourceDataLength = readSinglePrimitive<Defs::addr>(mHFSFile, 4UL);
-    mResourceMapLength = readSinglePrimitive<Defs::addr>(mHFSFile, 4UL);
+    mResourceDataZoneAddr = mStartAddr + decoder.readU32();
+    mResourceMapAddr = mStartAddr + decoder.readU32();
+    mResourceDataLength = decoder.readU32();
+    mResourceMapLength = decoder.readU32();
 }
 
 // Call after passing header!
 void ResourceFork::parseResourceMapFields()
 {
-    // Set cursor to the start of the resource map
-    mHFSFile->seekg(mResourceMapAddr, std::ios::beg);
-    // Skip reserved and attributes sections
-    mHFSFile->seekg(16 + 4 + 2 + 2, std::ios::cur);
+    char offsets[4];
+    // Skip reserved and attributes sections at the start of the resource map
+    readBytes(mResourceMapAddr + 16 + 4 + 2 + 2, offsets, sizeof(offsets), "resource map fields");
+    Decoder decoder(offsets, sizeof(offsets));
 
     // Documentation was a bit misleading. The resource type list
     // actually starts at the numberOfTypesMinusOne field. Keep this in mind.
-    mResourceTypeListAddr = mResourceMapAddr +
-                                readSinglePrimitive<Defs::addr>(mHFSFile, 2UL);
-    mResourceNameListAddr = mResourceMapAddr +
-                                readSinglePrimitive<Defs::addr>(mHFSFile, 2UL);
-
-    // This field follows right after resourceNameListAddr.
-    // Using seekg() again just to make it clear that resourceTypeListAddr
-    // points to here.
-    // This is the same as mHFSFile.seekg(0UL, std::ios::cur);
-    mHFSFile->seekg(mResourceTypeListAddr, std::ios::beg);
-    mNumberOfTypesMinusOne = readSinglePrimitive<int>(mHFSFile, 2UL); // Can be negative
+    mResourceTypeListAddr = mResourceMapAddr + decoder.readU16();
+    mResourceNameListAddr = mResourceMapAddr + decoder.readU16();
+
+    // This field follows right after resourceNameListAddr, but
+    // reading it through resourceTypeListAddr makes it clear that
+    // resourceTypeListAddr points to here.
+    // Signed: can be negative (-1 if there are no types).
+    char numberOfTypesMinusOne[2];
+    readBytes(mResourceTypeListAddr, numberOfTypesMinusOne, sizeof(numberOfTypesMinusOne),
+              "number of resource types");
+    mNumberOfTypesMinusOne = static_cast<int16_t>(Defs::loadBigEndian16(numberOfTypesMinusOne));
 }
 
-// Find reference list pointer in the resource type list.
-ResourceFork::ReferenceListPointerPair ResourceFork::findReferenceListPointer(const std::string& type)
+// Call after parsing header!
+// Indexes the map, from the sidecar file at indexPath if there is one.
+void ResourceFork::loadResourceMap(const std::string& indexPath)
 {
-    // First: (number of resources -1) of this type in our map.
-    // So, initialize to -1 for safety (in-case type is not found).
-    ReferenceListPointerPair referenceListPointerPair(-1, 0);
-    bool foundType = false;
+    RESX_STATS_TIME_PHASE(mStats, parseResourceMapFields);
 
-    // Set cursor to start of resource type list.
-    // +2 to skip the numberOfTypesMinusOne field.
-    mHFSFile->seekg(mResourceTypeListAddr + 2UL, std::ios::beg);
-
-    // Iterate through all types
-    for(int i = 0; i <= mNumberOfTypesMinusOne; i++)
+    if(indexPath.empty())
     {
-        // Not null-terminated.
-        // Types are case sensitive (Apple HFS+ specification).
-        std::vector<char> rawString = readByteArray<char>(mHFSFile, 4UL);
+        parseResourceMapFields();
+        buildIndex();
+        return;
+    }
 
-        // Makes it all nice and useable.
-        std::string readType(rawString.begin(), rawString.end());
+    // The map is only parsed if the sidecar is missing or stale.
+    ResourceIndex::Fingerprint fingerprint = indexFingerprint();
+    if(mIndex.load(indexPath, fingerprint))
+        return;
 
-        if(type == readType) // String compare
-        {
-            foundType = true;
+    parseResourceMapFields();
+    if(buildIndex())
+        mIndex.save(indexPath, fingerprint);
+}
 
-            // Number of resources -1 of this type in map
-            referenceListPointerPair.first = readSinglePrimitive<int>(mHFSFile, 2UL);
+// Call after parsing resource map fields!
+// Brings the whole map into memory once (in place if memory-mapped)
+// and indexes it. Returns false if the map is malformed.
+bool ResourceFork::buildIndex()
+{
+    if(mResourceTypeListAddr < mResourceMapAddr ||
+       mResourceTypeListAddr - mResourceMapAddr >= mResourceMapLength)
+    {
+        std::cerr << "Resource type list lies outside of the resource map!" << std::endl;
+        return false;
+    }
 
-            // Address of reference list for this type.
-            referenceListPointerPair.second = mResourceTypeListAddr +
-                                readSinglePrimitive<Defs::addr>(mHFSFile, 2UL);
-            break;
-        } else
+    if(mResourceNameListAddr < mResourceMapAddr ||
+       mResourceNameListAddr - mResourceMapAddr > mResourceMapLength)
+    {
+        std::cerr << "Resource name list lies outside of the resource map!" << std::endl;
+        return false;
+    }
+
+    const char* map = nullptr;
+    std::vector<char> mapBuffer;
+
+    if(isMemoryMapped())
+    {
+        if(mResourceMapAddr > mReader->size() || mResourceMapLength > mReader->size() - mResourceMapAddr)
         {
-            // Not our type!
-            // Skip the next 2 fields to go to the next type.
-            mHFSFile->seekg(2UL + 2UL, std::ios::cur);
+            std::cerr << "Resource map extends past the end of the file!" << std::endl;
+            return false;
         }
-    }
 
-    if(!foundType)
-        std::cerr << "Could not find resource type '" << type << "'!" << std::endl;
+        map = mReader->data() + mResourceMapAddr;
+    } else
+    {
+        RESX_STATS_COUNT_ALLOCATION(mStats, mResourceMapLength);
+        mapBuffer.resize(mResourceMapLength, 0);
+        readBytes(mResourceMapAddr, mapBuffer.data(), mResourceMapLength, "resource map");
+        map = mapBuffer.data();
+    }
 
-    return referenceListPointerPair;
+    return mIndex.build(map, mResourceMapLength, mResourceTypeListAddr - mResourceMapAddr,
+                        mResourceNameListAddr - mResourceMapAddr);
 }
 
-// Stream position is restored
-std::string ResourceFork::getResourceName(Defs::addr resourceNameAddr)
+// Find type in the index, cerrs if it does not exist.
+const ResourceIndex::Type* ResourceFork::findType(const std::string& type) const
 {
-    Defs::addr oldAddress = mHFSFile->tellg();
-    mHFSFile->seekg(resourceNameAddr, std::ios::beg);
-    std::size_t nameLength = readSinglePrimitive<std::size_t>(mHFSFile, 1UL);
-    std::vector<char> rawString = readByteArray<char>(mHFSFile, nameLength);
-
-    mHFSFile->seekg(oldAddress, std::ios::beg);
+    const ResourceIndex::Type* indexType = mIndex.findType(type);
+    if(indexType == nullptr)
+        std::cerr << "Could not find resource type '" << type << "'!" << std::endl;
 
-    // Makes it all nice and useable.
-    return std::string(rawString.begin(), rawString.end());
+    return indexType;
 }
 
-// Find resource address by ID in the reference list.
-// Returns 0 if the ID is not.
-Defs::addr ResourceFork::findResourceAddress(const std::string& type, int ID)
+// Find resource by ID in the index.
+// Returns nullptr if the ID is not.
+const ResourceIndex::Resource* ResourceFork::findResource(const std::string& type, int ID) const
 {
-    ReferenceListPointerPair referenceListPointerPair = findReferenceListPointer(type);
+    RESX_STATS_TIME_PHASE(mStats, lookup);
 
-    bool foundResource = false;
-    Defs::addr resourceAddress = 0;
+    const ResourceIndex::Type* indexType = findType(type);
+    if(indexType == nullptr)
+        return nullptr;
 
-    // Move cursor to reference list for this type
-    mHFSFile->seekg(referenceListPointerPair.second, std::ios::beg);
-
-    // Iterate through all resources of this type.
-    for(int i = 0; i <= referenceListPointerPair.first; i++)
+    // IDs are stored on 16 bits, signed: others would alias.
+    if(ID < INT16_MIN || ID > INT16_MAX)
     {
-        // Read resource ID
-        int readID = readSinglePrimitive<unsigned int>(mHFSFile, 2UL);
+        std::cerr << "Resource ID '" << ID << "' is out of range!" << std::endl;
+        return nullptr;
+    }
 
-        if(readID == ID)
-        {
-            // Found our resource!
-            foundResource = true;
+    const ResourceIndex::Resource* resource = mIndex.findResource(*indexType, static_cast<uint16_t>(ID));
+    if(resource == nullptr)
+        std::cerr << "Could not find resource with ID '" << std::to_string(ID) << "'!"
+            << std::endl;
 
-            // Skip resource name (not used here) and resource attributes
-            mHFSFile->seekg(2 + 1, std::ios::cur);
+    return resource;
+}
 
-            resourceAddress = mResourceDataZoneAddr +
-                        readSinglePrimitive<Defs::addr>(mHFSFile, 3UL);
-            break;
-        } else
-        {
-            // Not our resource!
-            // Go to the next resource.
-            mHFSFile->seekg(2 + 1 + 3 + 4, std::ios::cur);
-        }
-    }
+// Find resource by name in the index.
+// Returns nullptr if the name is not.
+const ResourceIndex::Resource* ResourceFork::findResource(const std::string& type,
+                                                          const std::string& name) const
+{
+    RESX_STATS_TIME_PHASE(mStats, lookup);
 
-    if(!foundResource)
-    {
-        std::cerr << "Could not find resource with ID '" << std::to_string(ID) << "'!"
+    const ResourceIndex::Type* indexType = findType(type);
+    if(indexType == nullptr)
+        return nullptr;
+
+    const ResourceIndex::Resource* resource = mIndex.findResource(*indexType, name);
+    if(resource == nullptr)
+        std::cerr << "Could not find resource with name '" << name << "'!"
             << std::endl;
-    }
 
-    return resourceAddress;
+    return resource;
 }
 
-// Find resource address by name in the reference list.
+const ResourceIndex::Resource* ResourceFork::findResource(const ResourceKey& key) const
+{
+    if(key.name.empty())
+        return findResource(key.type, key.ID);
+
+    return findResource(key.type, key.name);
+}
+
+// Find resource address by ID in the index.
+// Returns 0 if the ID is not.
+Defs::addr ResourceFork::findResourceAddress(const std::string& type, int ID) const
+{
+    const ResourceIndex::Resource* resource = findResource(type, ID);
+    return resource == nullptr ? 0 : mResourceDataZoneAddr + resource->dataOffset;
+}
+
+// Find resource address by name in the index.
 // Returns 0 if the name is not.
-Defs::addr ResourceFork::findResourceAddress(const std::string& type, const std::string& name)
+Defs::addr ResourceFork::findResourceAddress(const std::string& type, const std::string& name) const
 {
-    ReferenceListPointerPair referenceListPointerPair = findReferenceListPointer(type);
+    const ResourceIndex::Resource* resource = findResource(type, name);
+    return resource == nullptr ? 0 : mResourceDataZoneAddr + resource->dataOffset;
+}
 
-    bool foundResource = false;
-    Defs::addr resourceAddress = 0;
+Defs::addr ResourceFork::findResourceAddress(const ResourceKey& key) const
+{
+    const ResourceIndex::Resource* resource = findResource(key);
+    return resource == nullptr ? 0 : mResourceDataZoneAddr + resource->dataOffset;
+}
 
-    // Move cursor to reference list for this type
-    mHFSFile->seekg(referenceListPointerPair.second, std::ios::beg);
+// Where the data of the resource at resourceAddress ends at the latest:
+// the start of the next resource, or the end of the data zone.
+Defs::addr ResourceFork::resourceSpanEnd(Defs::addr resourceAddress) const
+{
+    Defs::addr spanEnd = mResourceDataZoneAddr + mResourceDataLength;
 
-    // Iterate through all resources of this type.
-    for(int i = 0; i <= referenceListPointerPair.first; i++)
+    uint32_t nextDataOffset;
+    if(mIndex.nextDataOffset(static_cast<uint32_t>(resourceAddress - mResourceDataZoneAddr),
+                             &nextDataOffset))
     {
-        // Skip resource ID
-        mHFSFile->seekg(2, std::ios::cur);
-        Defs::addr resourceNameAddr = mResourceNameListAddr +
-                        readSinglePrimitive<Defs::addr>(mHFSFile, 2UL);
+        spanEnd = mResourceDataZoneAddr + nextDataOffset;
+    }
 
-        // Get resource name
-        std::string readName = getResourceName(resourceNameAddr);
+    return std::min<Defs::addr>(spanEnd, mReader->size());
+}
 
-        if(readName == name)
-        {
-            // Found our resource!
-            foundResource = true;
+// Everything a sidecar index of this fork depends on.
+ResourceIndex::Fingerprint ResourceFork::indexFingerprint() const
+{
+    ResourceIndex::Fingerprint fingerprint;
+    fingerprint.sourceSize = mReader->size();
+    fingerprint.sourceModificationTime = mReader->modificationTime();
+    fingerprint.forkStart = mStartAddr;
+    fingerprint.dataZoneOffset = mResourceDataZoneAddr - mStartAddr;
+    fingerprint.mapOffset = mResourceMapAddr - mStartAddr;
+    fingerprint.dataLength = mResourceDataLength;
+    fingerprint.mapLength = mResourceMapLength;
+    return fingerprint;
+}
 
-            // Skip resource attributes
-            mHFSFile->seekg(1, std::ios::cur);
+// Every read of the fork goes through here, to be counted.
+std::size_t ResourceFork::readAt(Defs::addr address, char* destination, std::size_t size) const
+{
+    std::size_t bytesRead = mReader->readAt(address, destination, size);
+    RESX_STATS_COUNT_READ(mStats, address, bytesRead);
+    return bytesRead;
+}
 
-            resourceAddress = mResourceDataZoneAddr +
-                        readSinglePrimitive<Defs::addr>(mHFSFile, 3UL);
-            break;
-        } else
-        {
-            // Not our resource!
-            // Go to the next resource.
-            mHFSFile->seekg(1 + 3 + 4, std::ios::cur);
-        }
-    }
+// Reads from the underlying reader, cerrs if we got less than expected.
+void ResourceFork::readBytes(Defs::addr address, char* destination, std::size_t bytesToRead,
+                             const std::string& dataTryingToReadName) const
+{
+    std::size_t bytesRead = readAt(address, destination, bytesToRead);
+    if(bytesRead != bytesToRead)
+        std::cerr << "Expected to read " << bytesToRead << " bytes for " << dataTryingToReadName <<
+            ", but got " << bytesRead << " bytes!" << std::endl;
+}
 
-    if(!foundResource)
+// readBytes() for many reads at once.
+void ResourceFork::readBatch(std::vector<Reader::ReadRequest>& reads, const std::string& dataTryingToReadName) const
+{
+    mReader->readBatch(reads.data(), reads.size());
+
+    for(const Reader::ReadRequest& read : reads)
     {
-        std::cerr << "Could not find resource with name '" << name << "'!"
-            << std::endl;
+        RESX_STATS_COUNT_READ(mStats, read.offset, read.bytesRead);
+        if(read.bytesRead != read.size)
+            std::cerr << "Expected to read " << read.size << " bytes for " << dataTryingToReadName <<
+                ", but got " << read.bytesRead << " bytes!" << std::endl;
     }
-
-    return resourceAddress;
 }
 
 // Static
@@ -290,115 +433,805 @@ void ResourceFork::checkFileReadErrors(ifstreamPointer file, std::size_t bytesEx
             ", but got " << bytesRead << " bytes!" << std::endl;
 }
 
-// Get all IDs for resource type.
-std::vector<unsigned int> ResourceFork::getResourcesIDs(const std::string& type)
+// Get all IDs for resource type, sorted as signed (negative IDs first), but
+// returned as stored: negative IDs come as 32768 to 65535, cast them to
+// int16_t to get them back.
+std::vector<unsigned int> ResourceFork::getResourcesIDs(const std::string& type) const
 {
     std::vector<unsigned int> IDs;
-    ReferenceListPointerPair referenceListPointerPair = findReferenceListPointer(type);
-
-    // Move cursor to reference list for this type
-    mHFSFile->seekg(referenceListPointerPair.second, std::ios::beg);
+    const ResourceIndex::Type* indexType = findType(type);
+    if(indexType == nullptr)
+        return IDs;
 
-    // Iterate through all resources of this type.
-    for(int i = 0; i <= referenceListPointerPair.first; i++)
+    IDs.reserve(indexType->resourceCount);
+    for(const ResourceIndex::Resource* resource = mIndex.resourcesBegin(*indexType);
+        resource != mIndex.resourcesEnd(*indexType); resource++)
     {
-        // Read resource ID
-        int readID = readSinglePrimitive<unsigned int>(mHFSFile, 2UL);
-        IDs.push_back(readID);
-
-        // Go to the next resource.
-        mHFSFile->seekg(2 + 1 + 3 + 4, std::ios::cur);
+        IDs.push_back(resource->ID);
     }
 
     return IDs;
 }
 
-// Get all names for resource type.
-std::vector<std::string> ResourceFork::getResourcesNames(const std::string& type)
+// Get all names for resource type, in ID order.
+// Unnamed resources get an empty name.
+std::vector<std::string> ResourceFork::getResourcesNames(const std::string& type) const
 {
     std::vector<std::string> names;
-    ReferenceListPointerPair referenceListPointerPair = findReferenceListPointer(type);
+    const ResourceIndex::Type* indexType = findType(type);
+    if(indexType == nullptr)
+        return names;
 
-    // Move cursor to reference list for this type
-    mHFSFile->seekg(referenceListPointerPair.second, std::ios::beg);
+    names.reserve(indexType->resourceCount);
+    for(const ResourceIndex::Resource* resource = mIndex.resourcesBegin(*indexType);
+        resource != mIndex.resourcesEnd(*indexType); resource++)
+    {
+        names.push_back(mIndex.name(*resource));
+    }
+
+    return names;
+}
 
-    // Iterate through all resources of this type.
-    for(int i = 0; i <= referenceListPointerPair.first; i++)
+// Types in code order, with their resource counts.
+bool ResourceFork::forEachType(const typeVisitor& visitor) const
+{
+    for(const ResourceIndex::Type* type = mIndex.typesBegin(); type != mIndex.typesEnd(); type++)
     {
-        // Skip resource ID
-        mHFSFile->seekg(2, std::ios::cur);
-        Defs::addr resourceNameAddr = mResourceNameListAddr +
-                        readSinglePrimitive<Defs::addr>(mHFSFile, 2UL);
+        if(!visitor(type->code, type->resourceCount))
+            return false;
+    }
 
-        // Get resource name
-        std::string readName = getResourceName(resourceNameAddr);
-        names.push_back(readName);
+    return true;
+}
 
-        // Go to the next resource.
-        mHFSFile->seekg(1 + 3 + 4, std::ios::cur);
+// All resources, by type code then ID.
+bool ResourceFork::forEachResource(const resourceVisitor& visitor, bool withSizes) const
+{
+    for(const ResourceIndex::Type* type = mIndex.typesBegin(); type != mIndex.typesEnd(); type++)
+    {
+        if(!visitResources(*type, visitor, withSizes))
+            return false;
     }
 
-    return names;
+    return true;
 }
 
-// Get resource data by ID.
-std::unique_ptr<char, freeDelete> ResourceFork::getResourceData(const std::string& type, int ID, std::size_t* size)
+// Resources of a type, by ID.
+bool ResourceFork::forEachResource(const std::string& type, const resourceVisitor& visitor,
+                                   bool withSizes) const
 {
-    // Find the resource!
-    Defs::addr resourceAddress = findResourceAddress(type, ID);
-    mHFSFile->seekg(resourceAddress, std::ios::beg);
+    const ResourceIndex::Type* indexType = findType(type);
+    if(indexType == nullptr)
+        return true; // Error messages already sent
+
+    return visitResources(*indexType, visitor, withSizes);
+}
+
+// One entry, reused for every resource of type.
+bool ResourceFork::visitResources(const ResourceIndex::Type& type, const resourceVisitor& visitor,
+                                  bool withSizes) const
+{
+    ResourceEntry entry;
+    entry.typeCode = type.code;
+    entry.size = 0;
+
+    for(const ResourceIndex::Resource* resource = mIndex.resourcesBegin(type);
+        resource != mIndex.resourcesEnd(type); resource++)
+    {
+        entry.ID = static_cast<int16_t>(resource->ID);
+        entry.attributes = resource->attributes;
+        entry.address = mResourceDataZoneAddr + resource->dataOffset;
+        entry.name = mIndex.nameData(*resource);
+        entry.nameLength = resource->nameLength;
+
+        if(withSizes)
+            entry.size = readResourceSize(entry.address);
+
+        if(!visitor(entry))
+            return false;
+    }
+
+    return true;
+}
+
+ResourceInfo ResourceFork::makeResourceInfo(const std::string& type,
+                                            const ResourceIndex::Resource& resource) const
+{
+    ResourceInfo info;
+    info.type = type;
+    info.ID = static_cast<int16_t>(resource.ID);
+    info.name = mIndex.name(resource);
+    info.attributes = resource.attributes;
+    info.address = mResourceDataZoneAddr + resource.dataOffset;
+    return info;
+}
+
+void ResourceFork::appendResourcesInfo(const ResourceIndex::Type& type,
+                                       std::vector<ResourceInfo>& infos) const
+{
+    std::string typeString = ResourceIndex::typeString(type.code);
+    for(const ResourceIndex::Resource* resource = mIndex.resourcesBegin(type);
+        resource != mIndex.resourcesEnd(type); resource++)
+    {
+        infos.push_back(makeResourceInfo(typeString, *resource));
+    }
+}
+
+// Get info of a single resource. Returns false if it was not found.
+bool ResourceFork::getResourceInfo(const ResourceKey& key, ResourceInfo* info) const
+{
+    const ResourceIndex::Resource* resource = findResource(key);
+    if(resource == nullptr)
+        return false;
+
+    *info = makeResourceInfo(key.type, *resource);
+    return true;
+}
+
+// Get info of all resources, sorted by address.
+std::vector<ResourceInfo> ResourceFork::getResourcesInfo() const
+{
+    std::vector<ResourceInfo> infos;
+    for(const ResourceIndex::Type* type = mIndex.typesBegin(); type != mIndex.typesEnd(); type++)
+        appendResourcesInfo(*type, infos);
+
+    std::sort(infos.begin(), infos.end(),
+        [](const ResourceInfo& a, const ResourceInfo& b) { return a.address < b.address; });
+    return infos;
+}
+
+// Get info of all resources of type, sorted by address.
+std::vector<ResourceInfo> ResourceFork::getResourcesInfo(const std::string& type) const
+{
+    std::vector<ResourceInfo> infos;
+    const ResourceIndex::Type* indexType = findType(type);
+    if(indexType == nullptr)
+        return infos;
 
+    appendResourcesInfo(*indexType, infos);
+
+    std::sort(infos.begin(), infos.end(),
+        [](const ResourceInfo& a, const ResourceInfo& b) { return a.address < b.address; });
+    return infos;
+}
+
+// Reads the length field in front of resource data.
+std::size_t ResourceFork::readResourceSize(Defs::addr resourceAddress) const
+{
+    char resourceSize[4] = {};
+    readBytes(resourceAddress, resourceSize, sizeof(resourceSize), "resource size");
+    return Defs::loadBigEndian32(resourceSize);
+}
+
+// Reads the resource data at resourceAddress (which points at its length field)
+// onto the heap. nullptr (and *size 0) if it extends past the end of the
+// file or cannot be allocated.
+std::unique_ptr<char, freeDelete> ResourceFork::readResourceData(Defs::addr resourceAddress,
+    std::size_t* size) const
+{
     if(resourceAddress == 0)
     {
         // Resource was not found, error messages already sent.
+        *size = 0;
+        return std::unique_ptr<char, freeDelete>();
+    }
+
+    RESX_STATS_TIME_PHASE(mStats, payloadRead);
+    *size = 0;
+    Defs::addr resourceDataAddr = resourceAddress + 4UL;
+    if(resourceDataAddr > mReader->size())
+    {
+        std::cerr << "Resource at " << resourceAddress << " lies past the end of the file!" <<
+            std::endl;
         return std::unique_ptr<char, freeDelete>();
     }
 
-    std::size_t resourceSize = readSinglePrimitive<std::size_t>(mHFSFile, 4UL);
-    /* File cursor now at actual resource data */
+    // A corrupt length must not allocate more than the file holds.
+    std::size_t resourceSize = readResourceSize(resourceAddress);
+    if(resourceSize > mReader->size() - resourceDataAddr)
+    {
+        std::cerr << "Resource at " << resourceAddress << " extends past the end of the file!" <<
+            std::endl;
+        return std::unique_ptr<char, freeDelete>();
+    }
 
-    // void* to unique_ptr<char>
+    // void* to unique_ptr<char>. malloc(0) may return nullptr, which means
+    // "not found" here.
+    RESX_STATS_COUNT_ALLOCATION(mStats, resourceSize);
     std::unique_ptr<char, freeDelete> rawData(static_cast<char*>(
-        std::malloc(resourceSize)
+        std::malloc(resourceSize > 0 ? resourceSize : 1)
     ));
 
-    // Read the data and store on heap.
-    mHFSFile->read(rawData.get(), resourceSize);
-    checkFileReadErrors(mHFSFile, resourceSize, "resource");
+    if(rawData == nullptr)
+    {
+        std::cerr << "Cannot allocate " << resourceSize << " bytes for resource at " << resourceAddress << "!" <<
+            std::endl;
+        return rawData;
+    }
+
+    // Read the data (right after the length) and store on heap.
+    readBytes(resourceAddress + 4UL, rawData.get(), resourceSize, "resource");
 
     *size = resourceSize;
     return rawData;
 }
 
-// Get resource data by name.
-std::unique_ptr<char, freeDelete> ResourceFork::getResourceData(const std::string& type,
-    const std::string& name, std::size_t* size)
+// Resource data from the cache, or read (and cached, if enabled) on a miss.
+ResourceBuffer ResourceFork::sharedResourceData(Defs::addr resourceAddress) const
 {
-    // Find the resource!
-    Defs::addr resourceAddress = findResourceAddress(type, name);
-    mHFSFile->seekg(resourceAddress, std::ios::beg);
-
+    ResourceBuffer buffer = {std::shared_ptr<const char>(), 0};
     if(resourceAddress == 0)
     {
         // Resource was not found, error messages already sent.
+        return buffer;
+    }
+
+    if(mCache != nullptr && mCache->find(resourceAddress, &buffer))
+        return buffer;
+
+    std::unique_ptr<char, freeDelete> rawData = readResourceData(resourceAddress, &buffer.size);
+    if(rawData == nullptr)
+        return buffer; // Not cached, error messages already sent
+
+    if(mDecompress)
+        decompressResourceData(rawData, &buffer.size);
+
+    buffer.data = std::shared_ptr<const char>(rawData.release(), freeDelete());
+    if(mCache != nullptr)
+        mCache->insert(resourceAddress, buffer);
+
+    return buffer;
+}
+
+// readResourceData(), going through the cache if enabled.
+std::unique_ptr<char, freeDelete> ResourceFork::copyResourceData(Defs::addr resourceAddress,
+    std::size_t* size) const
+{
+    if(mCache == nullptr)
+    {
+        std::unique_ptr<char, freeDelete> rawData = readResourceData(resourceAddress, size);
+        if(mDecompress)
+            decompressResourceData(rawData, size);
+
+        return rawData;
+    }
+
+    ResourceBuffer buffer = sharedResourceData(resourceAddress);
+    *size = buffer.size;
+    if(buffer.data == nullptr)
         return std::unique_ptr<char, freeDelete>();
+
+    // The caller owns (and may modify) what it gets, give it a copy.
+    RESX_STATS_COUNT_ALLOCATION(mStats, buffer.size);
+    std::unique_ptr<char, freeDelete> rawData(static_cast<char*>(std::malloc(buffer.size > 0 ? buffer.size : 1)));
+    if(rawData == nullptr)
+    {
+        std::cerr << "Cannot allocate " << buffer.size << " bytes for resource at " << resourceAddress << "!" <<
+            std::endl;
+        *size = 0;
+        return rawData;
     }
 
-    std::size_t resourceSize = readSinglePrimitive<std::size_t>(mHFSFile, 4UL);
-    /* File cursor now at actual resource data */
+    std::memcpy(rawData.get(), buffer.data.get(), buffer.size);
+    return rawData;
+}
 
-    // void* to unique_ptr<char>
-    std::unique_ptr<char, freeDelete> rawData(static_cast<char*>(
-        std::malloc(resourceSize)
+// True if the data of the resource at resourceAddress starts with a
+// compressed resource header naming a registered decompressor.
+bool ResourceFork::isCompressed(Defs::addr resourceAddress) const
+{
+    if(resourceAddress == 0 || resourceAddress + 4UL > mReader->size())
+        return false;
+
+    std::size_t resourceSize = readResourceSize(resourceAddress);
+    char headerData[18];
+    if(resourceSize < sizeof(headerData) ||
+       readAt(resourceAddress + 4UL, headerData, sizeof(headerData)) != sizeof(headerData))
+    {
+        return false;
+    }
+
+    Decompressor::Header header;
+    return Decompressor::parseHeader(headerData, sizeof(headerData), &header) &&
+        header.headerLength <= resourceSize && Decompressor::isRegistered(header.decompressorID);
+}
+
+// Replaces data by its decompressed version, if it is compressed and can
+// be decompressed. The output buffer is allocated once, from the header
+// (which parseHeader() bounds).
+void ResourceFork::decompressResourceData(std::unique_ptr<char, freeDelete>& data, std::size_t* size) const
+{
+    Decompressor::Header header;
+    if(data == nullptr || !Decompressor::parseHeader(data.get(), *size, &header))
+        return;
+
+    // malloc(0) may return nullptr, which means "not found" here.
+    RESX_STATS_COUNT_ALLOCATION(mStats, header.decompressedLength);
+    std::unique_ptr<char, freeDelete> decompressed(static_cast<char*>(
+        std::malloc(header.decompressedLength > 0 ? header.decompressedLength : 1)
     ));
 
-    // Read the data and store on heap.
-    mHFSFile->read(rawData.get(), resourceSize);
-    checkFileReadErrors(mHFSFile, resourceSize, "resource");
+    if(decompressed == nullptr)
+    {
+        std::cerr << "Cannot allocate " << header.decompressedLength << " bytes to decompress resource! " <<
+            "Leaving it compressed." << std::endl;
+        return;
+    }
 
-    *size = resourceSize;
-    return rawData;
+    if(!Decompressor::decompress(header, data.get(), *size, decompressed.get()))
+    {
+        std::cerr << "Leaving resource compressed!" << std::endl;
+        return;
+    }
+
+    data = std::move(decompressed);
+    *size = header.decompressedLength;
+}
+
+// Resource data with decompression on, expanded once for all the pieces
+// read from it: from the cache if enabled, or the last resource expanded.
+// As stored if it cannot be decompressed.
+ResourceBuffer ResourceFork::expandedResourceData(Defs::addr resourceAddress) const
+{
+    if(mCache != nullptr)
+        return sharedResourceData(resourceAddress);
+
+    {
+        std::lock_guard<std::mutex> lock(mLastExpanded->mutex);
+        if(mLastExpanded->address == resourceAddress && mLastExpanded->buffer.data != nullptr)
+            return mLastExpanded->buffer;
+    }
+
+    ResourceBuffer buffer = sharedResourceData(resourceAddress);
+
+    std::lock_guard<std::mutex> lock(mLastExpanded->mutex);
+    mLastExpanded->address = resourceAddress;
+    mLastExpanded->buffer = buffer;
+    return buffer;
+}
+
+// Points into the mapping at the resource data at resourceAddress.
+ResourceView ResourceFork::viewResourceData(Defs::addr resourceAddress) const
+{
+    ResourceView view = {nullptr, 0};
+
+    if(resourceAddress == 0)
+    {
+        // Resource was not found, error messages already sent.
+        return view;
+    }
+
+    if(!isMemoryMapped())
+    {
+        std::cerr << "Cannot view resource, file is not memory-mapped! " <<
+            "Use getResourceData() instead." << std::endl;
+        return view;
+    }
+
+    Defs::addr resourceDataAddr = resourceAddress + 4UL;
+    if(resourceDataAddr > mReader->size())
+    {
+        std::cerr << "Resource at " << resourceAddress << " lies past the end of the file!" <<
+            std::endl;
+        return view;
+    }
+
+    // Straight from the mapping, no copy
+    std::size_t resourceSize = Defs::loadBigEndian32(mReader->data() + resourceAddress);
+    if(resourceSize > mReader->size() - resourceDataAddr)
+    {
+        std::cerr << "Resource at " << resourceAddress << " extends past the end of the file!" <<
+            std::endl;
+        return view;
+    }
+
+    view.data = mReader->data() + resourceDataAddr;
+    view.size = resourceSize;
+    return view;
+}
+
+// Get resource data by ID.
+std::unique_ptr<char, freeDelete> ResourceFork::getResourceData(const std::string& type, int ID, std::size_t* size) const
+{
+    // Find the resource!
+    return copyResourceData(findResourceAddress(type, ID), size);
+}
+
+// Get resource data by name.
+std::unique_ptr<char, freeDelete> ResourceFork::getResourceData(const std::string& type,
+    const std::string& name, std::size_t* size) const
+{
+    // Find the resource!
+    return copyResourceData(findResourceAddress(type, name), size);
+}
+
+// View resource data by ID.
+ResourceView ResourceFork::getResourceView(const std::string& type, int ID) const
+{
+    return viewResourceData(findResourceAddress(type, ID));
+}
+
+// View resource data by name.
+ResourceView ResourceFork::getResourceView(const std::string& type, const std::string& name) const
+{
+    return viewResourceData(findResourceAddress(type, name));
+}
+
+// Get resource data from its info.
+std::unique_ptr<char, freeDelete> ResourceFork::getResourceData(const ResourceInfo& info, std::size_t* size) const
+{
+    return copyResourceData(info.address, size);
+}
+
+// View resource data from its info.
+ResourceView ResourceFork::getResourceView(const ResourceInfo& info) const
+{
+    return viewResourceData(info.address);
+}
+
+void ResourceFork::setDecompression(bool decompress)
+{
+    mDecompress = decompress;
+
+    // Cached data was expanded (or not) with the previous setting.
+    if(mCache != nullptr)
+        mCache = std::make_shared<ResourceCache>(mCache->stats().budget);
+}
+
+void ResourceFork::setCacheBudget(std::size_t budget)
+{
+    if(budget == 0)
+        mCache.reset();
+    else
+        mCache = std::make_shared<ResourceCache>(budget);
+}
+
+ResourceCache::Stats ResourceFork::getCacheStats() const
+{
+    if(mCache == nullptr)
+    {
+        ResourceCache::Stats stats = {0, 0, 0, 0, 0, 0};
+        return stats;
+    }
+
+    return mCache->stats();
+}
+
+// Shared resource data by ID.
+ResourceBuffer ResourceFork::getSharedResourceData(const std::string& type, int ID) const
+{
+    return sharedResourceData(findResourceAddress(type, ID));
+}
+
+// Shared resource data by name.
+ResourceBuffer ResourceFork::getSharedResourceData(const std::string& type, const std::string& name) const
+{
+    return sharedResourceData(findResourceAddress(type, name));
+}
+
+Stats ResourceFork::getStats() const
+{
+    return mStats.snapshot();
+}
+
+void ResourceFork::resetStats()
+{
+    mStats.reset();
+}
+
+// Shared resource data from its info.
+ResourceBuffer ResourceFork::getSharedResourceData(const ResourceInfo& info) const
+{
+    return sharedResourceData(info.address);
+}
+
+std::size_t ResourceFork::getResourceSize(const ResourceInfo& info) const
+{
+    if(info.address == 0 || info.address + 4UL > mReader->size())
+        return 0;
+
+    // Only known once expanded: resources that fail to are handed out as stored.
+    if(mDecompress && isCompressed(info.address))
+        return expandedResourceData(info.address).size;
+
+    return readResourceSize(info.address);
+}
+
+std::size_t ResourceFork::readResource(const ResourceInfo& info, std::size_t offset, char* buffer,
+                                       std::size_t bufferSize) const
+{
+    // Compressed data has to be expanded whole, once for all the pieces.
+    if(mDecompress && isCompressed(info.address))
+    {
+        ResourceBuffer data = expandedResourceData(info.address);
+        if(data.data == nullptr || offset >= data.size)
+            return 0;
+
+        bufferSize = std::min(bufferSize, data.size - offset);
+        std::memcpy(buffer, data.data.get() + offset, bufferSize);
+        return bufferSize;
+    }
+
+    RESX_STATS_TIME_PHASE(mStats, payloadRead);
+    std::size_t resourceSize = getResourceSize(info);
+    if(offset >= resourceSize)
+        return 0;
+
+    if(bufferSize > resourceSize - offset)
+        bufferSize = resourceSize - offset;
+
+    return readAt(info.address + 4UL + offset, buffer, bufferSize);
 }
 
+std::size_t ResourceFork::streamResource(const ResourceInfo& info, const chunkSink& sink,
+                                         std::size_t chunkSize) const
+{
+    if(chunkSize == 0)
+        chunkSize = defaultChunkSize;
+
+    // Compressed data has to be expanded whole.
+    if(mDecompress && isCompressed(info.address))
+    {
+        ResourceBuffer data = expandedResourceData(info.address);
+        return data.data == nullptr ? 0 : streamBuffer(data.data.get(), data.size, sink, chunkSize);
+    }
+
+    RESX_STATS_TIME_PHASE(mStats, payloadRead);
+    std::size_t resourceSize = getResourceSize(info);
+
+    if(isMemoryMapped())
+    {
+        ResourceView view = viewResourceData(info.address);
+        return streamBuffer(view.data, view.size, sink, chunkSize);
+    }
+
+    // The only buffer, reused for every chunk.
+    std::vector<char> chunk(std::min(chunkSize, resourceSize));
+    RESX_STATS_COUNT_ALLOCATION(mStats, chunk.size());
+    std::size_t streamed = 0;
+    while(streamed < resourceSize)
+    {
+        std::size_t bytesRead = readAt(info.address + 4UL + streamed, chunk.data(),
+                                       std::min(chunk.size(), resourceSize - streamed));
+        if(bytesRead == 0)
+        {
+            std::cerr << "Expected to read " << resourceSize << " bytes for resource, but got " <<
+                streamed << " bytes!" << std::endl;
+            break;
+        }
+
+        if(!sink(chunk.data(), bytesRead))
+            break;
+
+        streamed += bytesRead;
+    }
+
+    return streamed;
+}
+
+bool ResourceFork::copyResourceToFile(const ResourceInfo& info, int outputFileDescriptor) const
+{
+    if(info.address == 0)
+        return false;
+
+    // Compressed data has to be expanded whole.
+    if(mDecompress && isCompressed(info.address))
+    {
+        ResourceBuffer data = expandedResourceData(info.address);
+        if(data.data == nullptr)
+            return false; // Error messages already sent.
+
+        if(!writeToFile(outputFileDescriptor, data.data.get(), data.size))
+        {
+            std::cerr << "Write error while copying resource!" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    RESX_STATS_TIME_PHASE(mStats, payloadRead);
+    std::size_t resourceSize = getResourceSize(info);
+    Defs::addr resourceDataAddr = info.address + 4UL;
+    if(resourceDataAddr > mReader->size() || resourceSize > mReader->size() - resourceDataAddr)
+    {
+        std::cerr << "Resource at " << info.address << " extends past the end of the file!" << std::endl;
+        return false;
+    }
+
+    std::size_t copied = mReader->copyToFile(resourceDataAddr, resourceSize, outputFileDescriptor);
+    if(copied > 0)
+        RESX_STATS_COUNT_READ(mStats, resourceDataAddr, copied);
+    if(copied == resourceSize)
+        return true;
+
+    // Whatever the kernel did not copy goes through a chunk buffer.
+    std::vector<char> chunk(std::min(defaultChunkSize, resourceSize - copied));
+    RESX_STATS_COUNT_ALLOCATION(mStats, chunk.size());
+    while(copied < resourceSize)
+    {
+        std::size_t bytesRead = readAt(resourceDataAddr + copied, chunk.data(),
+                                       std::min(chunk.size(), resourceSize - copied));
+        if(bytesRead == 0)
+        {
+            std::cerr << "Expected to read " << resourceSize << " bytes for resource, but got " <<
+                copied << " bytes!" << std::endl;
+            return false;
+        }
+
+        if(!writeToFile(outputFileDescriptor, chunk.data(), bytesRead))
+        {
+            std::cerr << "Write error while copying resource!" << std::endl;
+            return false;
+        }
+
+        copied += bytesRead;
+    }
+
+    return true;
+}
+
+bool ResourceFork::prefersBatches() const
+{
+    return !mDecompress && mReader->prefersBatches();
+}
+
+// Resolves every key, then reads the resources in address order, merging
+// neighbours into single reads. The length of a resource is only known once
+// it is read, so each read covers everything up to the next resource in
+// the data zone; resources that turn out longer are read on their own.
+ResourceBatch ResourceFork::getResources(const std::vector<ResourceKey>& keys) const
+{
+    ResourceBatch batch;
+    ResourceView notFound = {nullptr, 0};
+    batch.views.assign(keys.size(), notFound);
+
+    struct Request
+    {
+        Defs::addr address;
+        Defs::addr spanEnd;
+        std::size_t key;
+        std::size_t run;
+        std::size_t bufferOffset; // Of the data, once read
+        std::size_t size;
+        bool valid;
+    };
+
+    struct Run
+    {
+        Defs::addr start;
+        Defs::addr end;
+        std::size_t bufferOffset;
+    };
+
+    std::vector<Request> requests;
+    requests.reserve(keys.size());
+    for(std::size_t i = 0; i < keys.size(); i++)
+    {
+        Defs::addr resourceAddress = findResourceAddress(keys[i]);
+        if(resourceAddress == 0)
+            continue; // Error messages already sent.
+
+        Request request = {resourceAddress, resourceSpanEnd(resourceAddress), i, 0, 0, 0, false};
+        requests.push_back(request);
+    }
+
+    // Lookups above are timed on their own.
+    RESX_STATS_TIME_PHASE(mStats, payloadRead);
+    std::sort(requests.begin(), requests.end(),
+        [](const Request& a, const Request& b) { return a.address < b.address; });
+
+    std::vector<Run> runs;
+    std::size_t bufferSize = 0;
+    for(Request& request : requests)
+    {
+        if(runs.empty() || request.address > runs.back().end + maxCoalesceGap)
+        {
+            if(!runs.empty())
+                bufferSize += runs.back().end - runs.back().start;
+
+            Run run = {request.address, request.address, bufferSize};
+            runs.push_back(run);
+        }
+
+        runs.back().end = std::max(runs.back().end, request.spanEnd);
+        request.run = runs.size() - 1;
+    }
+
+    if(!runs.empty())
+        bufferSize += runs.back().end - runs.back().start;
+
+    RESX_STATS_COUNT_ALLOCATION(mStats, bufferSize);
+    batch.buffer.reset(static_cast<char*>(std::malloc(bufferSize > 0 ? bufferSize : 1)));
+    if(batch.buffer == nullptr)
+    {
+        std::cerr << "Cannot allocate " << bufferSize << " bytes for a batch of resources!" << std::endl;
+        return batch; // Nothing found
+    }
+
+    // All at once, for readers that keep many reads in flight.
+    std::vector<Reader::ReadRequest> reads;
+    for(const Run& run : runs)
+    {
+        Reader::ReadRequest read = {run.start, batch.buffer.get() + run.bufferOffset, run.end - run.start, 0};
+        reads.push_back(read);
+    }
+
+    readBatch(reads, "batch of resources");
+
+    // Split the runs into resources.
+    std::size_t overflowSize = 0;
+    for(Request& request : requests)
+    {
+        const Run& run = runs[request.run];
+        std::size_t lengthOffset = run.bufferOffset + (request.address - run.start);
+        if(request.spanEnd < request.address + 4UL)
+        {
+            std::cerr << "Resource at " << request.address << " extends past the end of the file!" <<
+                std::endl;
+            continue;
+        }
+
+        request.size = Defs::loadBigEndian32(batch.buffer.get() + lengthOffset);
+        if(request.size <= request.spanEnd - request.address - 4UL)
+        {
+            request.bufferOffset = lengthOffset + 4UL;
+            request.valid = true;
+            continue;
+        }
+
+        if(request.address + 4UL + request.size > mReader->size())
+        {
+            std::cerr << "Resource at " << request.address << " extends past the end of the file!" <<
+                std::endl;
+            continue;
+        }
+
+        // Overlaps the next resource, read it on its own after the runs.
+        request.bufferOffset = bufferSize + overflowSize;
+        request.valid = true;
+        overflowSize += request.size;
+    }
+
+    if(overflowSize > 0)
+    {
+        RESX_STATS_COUNT_ALLOCATION(mStats, overflowSize);
+        // The old block stays owned by the batch until realloc() succeeds.
+        char* grown = static_cast<char*>(std::realloc(batch.buffer.get(), bufferSize + overflowSize));
+        if(grown == nullptr)
+        {
+            std::cerr << "Cannot allocate " << bufferSize + overflowSize << " bytes for a batch of resources!" <<
+                std::endl;
+            batch.buffer.reset();
+            return batch; // Nothing found
+        }
+
+        batch.buffer.release();
+        batch.buffer.reset(grown);
+        reads.clear();
+        for(const Request& request : requests)
+        {
+            if(request.valid && request.bufferOffset >= bufferSize)
+            {
+                Reader::ReadRequest read = {request.address + 4UL, batch.buffer.get() + request.bufferOffset,
+                                            request.size, 0};
+                reads.push_back(read);
+            }
+        }
+
+        readBatch(reads, "resource");
+    }
+
+    for(const Request& request : requests)
+    {
+        if(!request.valid)
+            continue;
+
+        ResourceView view = {batch.buffer.get() + request.bufferOffset, request.size};
+        batch.views[request.key] = view;
+    }
+
+    return batch;
+}
 
 } // namespace RESX
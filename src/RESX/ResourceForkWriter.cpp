@@ -0,0 +1,319 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/ResourceForkWriter.hpp"
+#include "RESX/Decompressor.hpp"
+
+#include <algorithm> // For sort()
+#include <cstdint> // For INT16_MIN and INT16_MAX
+#include <cstdio> // For std::rename() and std::remove()
+#include <fstream>
+#include <iostream>
+#include <memory> // For smart pointers
+#include <random> // For random_device
+
+namespace RESX
+{
+
+namespace
+{
+    // Header (16 bytes), then reserved for system and application use.
+    const std::size_t headerLength = 256;
+    // Header copy (16), handle to next map (4), file reference (2),
+    // attributes (2), type list offset (2), name list offset (2).
+    const std::size_t mapFieldsLength = 28;
+
+    void appendBigEndian(std::string& out, uint32_t value, int bytes)
+    {
+        for(int i = bytes - 1; i >= 0; i--)
+            out += static_cast<char>((value >> (i * 8)) & 0xFF);
+    }
+}
+
+ResourceForkWriter::ResourceForkWriter()
+{
+
+}
+
+ResourceForkWriter::~ResourceForkWriter()
+{
+
+}
+
+bool ResourceForkWriter::addResource(const std::string& type, int ID, const std::string& name,
+                                     uint8_t attributes, const char* data, std::size_t size)
+{
+    // Shared, so that copies of the producer do not copy the data.
+    std::shared_ptr<std::vector<char>> copy = std::make_shared<std::vector<char>>(data, data + size);
+    return addResource(type, ID, name, attributes, size, [copy](const ResourceFork::chunkSink& sink)
+    {
+        return copy->empty() || sink(copy->data(), copy->size());
+    });
+}
+
+bool ResourceForkWriter::addResource(const std::string& type, int ID, const std::string& name,
+                                     uint8_t attributes, std::size_t size, dataProducer producer)
+{
+    if(type.size() != 4)
+    {
+        std::cerr << "Resource type '" << type << "' is not four chars long!" << std::endl;
+        return false;
+    }
+
+    if(name.size() > 255)
+    {
+        std::cerr << "Name of resource with ID '" << ID << "' is longer than 255 chars!" << std::endl;
+        return false;
+    }
+
+    // IDs are stored on 16 bits, signed.
+    if(ID < INT16_MIN || ID > INT16_MAX)
+    {
+        std::cerr << "Resource ID '" << ID << "' is out of range!" << std::endl;
+        return false;
+    }
+
+    Entry entry;
+    entry.typeCode = ResourceIndex::typeCode(type);
+    entry.ID = static_cast<uint16_t>(ID);
+    entry.name = name;
+    entry.attributes = attributes;
+    entry.size = size;
+    entry.producer = producer;
+
+    for(const Entry& other : mEntries)
+    {
+        if(other.typeCode == entry.typeCode && other.ID == entry.ID)
+        {
+            std::cerr << "Resource of type '" << type << "' with ID '" << ID << "' was already added!" <<
+                std::endl;
+            return false;
+        }
+    }
+
+    mEntries.push_back(entry);
+    return true;
+}
+
+bool ResourceForkWriter::addResources(const ResourceFork& resourceFork)
+{
+    for(const ResourceInfo& info : resourceFork.getResourcesInfo())
+    {
+        // Expanded by the fork (decompression on), the data is no longer
+        // compressed: its attributes must not say it is.
+        uint8_t attributes = info.attributes;
+        if(attributes & Decompressor::resourceAttribute)
+        {
+            char headerData[18];
+            Decompressor::Header header;
+            if(resourceFork.readResource(info, 0, headerData, sizeof(headerData)) != sizeof(headerData) ||
+               !Decompressor::parseHeader(headerData, sizeof(headerData), &header))
+            {
+                attributes &= ~Decompressor::resourceAttribute;
+            }
+        }
+
+        const ResourceFork* source = &resourceFork;
+        if(!addResource(info.type, info.ID, info.name, attributes, resourceFork.getResourceSize(info),
+            [source, info](const ResourceFork::chunkSink& sink)
+            {
+                return source->streamResource(info, sink) == source->getResourceSize(info);
+            }))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::size_t ResourceForkWriter::resourceCount() const
+{
+    return mEntries.size();
+}
+
+bool ResourceForkWriter::write(const std::string& path) const
+{
+    std::vector<const Entry*> entries;
+    entries.reserve(mEntries.size());
+    for(const Entry& entry : mEntries)
+        entries.push_back(&entry);
+
+    std::sort(entries.begin(), entries.end(), [](const Entry* a, const Entry* b)
+    {
+        return a->typeCode != b->typeCode ? a->typeCode < b->typeCode :
+            static_cast<int16_t>(a->ID) < static_cast<int16_t>(b->ID);
+    });
+
+    std::size_t typeCount = 0;
+    for(std::size_t i = 0; i < entries.size(); i++)
+    {
+        if(i == 0 || entries[i]->typeCode != entries[i - 1]->typeCode)
+            typeCount++;
+    }
+
+    // Lay out the map first: everything in it is known before any data is written.
+    std::size_t typeListLength = 2 + typeCount * 8 + entries.size() * 12;
+    if(mapFieldsLength + typeListLength > 0xFFFF)
+    {
+        std::cerr << "Too many resources for a resource map!" << std::endl;
+        return false;
+    }
+
+    std::string typeList;
+    std::string referenceLists;
+    std::string nameList;
+    std::size_t dataLength = 0;
+
+    // -1 if there are no types.
+    appendBigEndian(typeList, static_cast<uint32_t>(typeCount - 1), 2);
+    for(std::size_t i = 0; i < entries.size(); i++)
+    {
+        const Entry& entry = *entries[i];
+        if(i == 0 || entry.typeCode != entries[i - 1]->typeCode)
+        {
+            std::size_t resourceCount = 1;
+            while(i + resourceCount < entries.size() && entries[i + resourceCount]->typeCode == entry.typeCode)
+                resourceCount++;
+
+            appendBigEndian(typeList, entry.typeCode, 4);
+            appendBigEndian(typeList, static_cast<uint32_t>(resourceCount - 1), 2);
+            // Relative to the type list.
+            appendBigEndian(typeList, static_cast<uint32_t>(2 + typeCount * 8 + referenceLists.size()), 2);
+        }
+
+        uint32_t nameOffset = ResourceIndex::noName;
+        if(!entry.name.empty())
+        {
+            if(nameList.size() >= ResourceIndex::noName)
+            {
+                std::cerr << "Resource names do not fit in a resource map!" << std::endl;
+                return false;
+            }
+
+            nameOffset = static_cast<uint32_t>(nameList.size());
+            nameList += static_cast<char>(entry.name.size());
+            nameList += entry.name;
+        }
+
+        if(dataLength > 0xFFFFFF || entry.size > 0xFFFFFFFFUL - 4 - dataLength)
+        {
+            std::cerr << "Resource data does not fit in a resource fork!" << std::endl;
+            return false;
+        }
+
+        // ID (2), name offset (2), attributes (1), data offset (3), reserved (4).
+        appendBigEndian(referenceLists, entry.ID, 2);
+        appendBigEndian(referenceLists, nameOffset, 2);
+        appendBigEndian(referenceLists, entry.attributes, 1);
+        appendBigEndian(referenceLists, static_cast<uint32_t>(dataLength), 3);
+        appendBigEndian(referenceLists, 0, 4);
+
+        dataLength += 4 + entry.size;
+    }
+
+    std::size_t mapLength = mapFieldsLength + typeListLength + nameList.size();
+    if(headerLength + dataLength + mapLength > 0xFFFFFFFFUL)
+    {
+        std::cerr << "Resource fork would be larger than 4 GiB!" << std::endl;
+        return false;
+    }
+
+    std::string header;
+    appendBigEndian(header, static_cast<uint32_t>(headerLength), 4);
+    appendBigEndian(header, static_cast<uint32_t>(headerLength + dataLength), 4);
+    appendBigEndian(header, static_cast<uint32_t>(dataLength), 4);
+    appendBigEndian(header, static_cast<uint32_t>(mapLength), 4);
+
+    // The map starts with a copy of the header.
+    std::string map = header;
+    map.append(4 + 2 + 2, '\0'); // Handle, file reference, attributes
+    appendBigEndian(map, static_cast<uint32_t>(mapFieldsLength), 2);
+    appendBigEndian(map, static_cast<uint32_t>(mapFieldsLength + typeListLength), 2);
+    map += typeList;
+    map += referenceLists;
+    map += nameList;
+
+    header.resize(headerLength, '\0');
+
+    // Unique enough that two processes writing at once do not collide.
+    std::string temporaryPath = path + ".tmp" + std::to_string(std::random_device()());
+    std::ofstream file(temporaryPath, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+    if(!file.is_open())
+    {
+        std::cerr << "Cannot open '" << temporaryPath << "'!" << std::endl;
+        return false;
+    }
+
+    file.write(header.data(), header.size());
+
+    for(const Entry* entry : entries)
+    {
+        std::string length;
+        appendBigEndian(length, static_cast<uint32_t>(entry->size), 4);
+        file.write(length.data(), length.size());
+
+        std::size_t written = 0;
+        bool produced = entry->producer([&file, &written](const char* chunk, std::size_t size)
+        {
+            file.write(chunk, size);
+            written += size;
+            return file.good();
+        });
+
+        if(!produced || written != entry->size)
+        {
+            std::cerr << "Resource of type '" << ResourceIndex::typeString(entry->typeCode) << "' with ID '" <<
+                static_cast<int16_t>(entry->ID) << "' produced " << written << " bytes instead of " <<
+                entry->size << "!" << std::endl;
+            file.close();
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+    }
+
+    file.write(map.data(), map.size());
+    file.close();
+    if(file.fail())
+    {
+        std::cerr << "Writing to '" << temporaryPath << "' failed!" << std::endl;
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    // rename() does not replace existing files on Windows.
+    std::remove(path.c_str());
+#endif
+    if(std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "Cannot replace '" << path << "'!" << std::endl;
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// Static
+bool ResourceForkWriter::compact(const ResourceFork& resourceFork, const std::string& path)
+{
+    ResourceForkWriter writer;
+    return writer.addResources(resourceFork) && writer.write(path);
+}
+
+} // namespace RESX
@@ -0,0 +1,591 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/ResourceIndex.hpp"
+#include "RESX/Decoder.hpp"
+#include "RESX/MappedReader.hpp"
+
+#include <algorithm> // For sort(), unique(), lower_bound() and upper_bound()
+#include <cstdio> // For std::rename() and std::remove()
+#include <cstring> // For std::memcpy(), std::memcmp() and std::memset()
+#include <fstream>
+#include <iostream>
+#include <random> // For random_device
+#include <string>
+
+namespace RESX
+{
+
+namespace
+{
+    const char imageMagic[8] = {'R', 'E', 'S', 'X', 'I', 'D', 'X', '\0'};
+    const uint32_t imageVersion = 2; // 2: IDs ordered as signed
+    const uint32_t byteOrderMark = 0x01020304;
+
+    uint64_t alignImageOffset(uint64_t offset)
+    {
+        return (offset + 7) & ~static_cast<uint64_t>(7);
+    }
+
+    bool sameFingerprint(const ResourceIndex::Fingerprint& a, const ResourceIndex::Fingerprint& b)
+    {
+        return a.sourceSize == b.sourceSize && a.sourceModificationTime == b.sourceModificationTime &&
+               a.forkStart == b.forkStart && a.dataZoneOffset == b.dataZoneOffset &&
+               a.mapOffset == b.mapOffset && a.dataLength == b.dataLength && a.mapLength == b.mapLength;
+    }
+
+    bool typeCodeLess(const ResourceIndex::Type& type, uint32_t code)
+    {
+        return type.code < code;
+    }
+
+    bool resourceIDLess(const ResourceIndex::Resource& resource, uint16_t ID)
+    {
+        return static_cast<int16_t>(resource.ID) < static_cast<int16_t>(ID);
+    }
+}
+
+ResourceIndex::ResourceIndex()
+{
+    pack(); // Empty
+}
+
+ResourceIndex::~ResourceIndex()
+{
+
+}
+
+bool ResourceIndex::build(const char* map, std::size_t mapLength, std::size_t typeListOffset,
+                          std::size_t nameListOffset)
+{
+    mTypes.clear();
+    mResources.clear();
+    mNames.clear();
+    mNameSlots.clear();
+    mDataOffsets.clear();
+
+    // Leaves the building tables empty on failure.
+    bool parsed = parseMap(map, mapLength, typeListOffset, nameListOffset);
+    pack();
+    return parsed;
+}
+
+// Fills the building tables from the map.
+bool ResourceIndex::parseMap(const char* map, std::size_t mapLength, std::size_t typeListOffset,
+                             std::size_t nameListOffset)
+{
+
+    if(typeListOffset + 2 > mapLength)
+    {
+        std::cerr << "Resource type list lies outside of the resource map!" << std::endl;
+        return false;
+    }
+
+    const char* typeList = map + typeListOffset;
+    std::size_t typeListLength = mapLength - typeListOffset;
+    Decoder typeDecoder(typeList, typeListLength);
+
+    // Signed: -1 if there are no types.
+    int numberOfTypes = typeDecoder.readS16() + 1;
+    if(numberOfTypes <= 0)
+        return true;
+
+    // Each entry: type (4), number of resources -1 (2), reference list offset (2).
+    if(static_cast<std::size_t>(numberOfTypes) * 8 > typeDecoder.remaining())
+    {
+        std::cerr << "Resource type list is truncated!" << std::endl;
+        return false;
+    }
+
+    mTypes.reserve(numberOfTypes);
+    for(int i = 0; i < numberOfTypes; i++)
+    {
+        Type type;
+        type.code = typeDecoder.readU32();
+        uint32_t resourceCount = typeDecoder.readU16() + 1U;
+        // Reference list offsets are relative to the type list.
+        std::size_t referenceListOffset = typeDecoder.readU16();
+
+        // Each entry: ID (2), name offset (2), attributes (1), data offset (3), reserved (4).
+        if(referenceListOffset + resourceCount * 12 > typeListLength)
+        {
+            std::cerr << "Reference list of resource type '" << typeString(type.code) <<
+                "' is truncated!" << std::endl;
+            mTypes.clear();
+            mResources.clear();
+            return false;
+        }
+
+        type.firstResource = static_cast<uint32_t>(mResources.size());
+        type.resourceCount = resourceCount;
+        type.firstNameSlot = 0;
+        type.nameSlotCount = 0;
+        mTypes.push_back(type);
+
+        Decoder referenceDecoder(typeList + referenceListOffset, resourceCount * 12);
+        for(uint32_t j = 0; j < resourceCount; j++)
+        {
+            Resource resource;
+            resource.ID = referenceDecoder.readU16();
+            resource.nameOffset = referenceDecoder.readU16();
+            resource.attributes = referenceDecoder.readU8();
+            resource.dataOffset = referenceDecoder.readU24();
+            resource.nameStart = 0;
+            resource.nameLength = 0;
+            referenceDecoder.skip(4); // Reserved (handle to resource)
+            mResources.push_back(resource);
+        }
+
+        std::sort(mResources.begin() + type.firstResource, mResources.end(),
+            [](const Resource& a, const Resource& b)
+            {
+                return static_cast<int16_t>(a.ID) < static_cast<int16_t>(b.ID);
+            });
+    }
+
+    // An empty name list is fine (nameListOffset == mapLength).
+    std::size_t nameListLength = nameListOffset <= mapLength ? mapLength - nameListOffset : 0;
+    if(!decodeNames(map + nameListOffset, nameListLength))
+    {
+        mTypes.clear();
+        mResources.clear();
+        mNames.clear();
+        return false;
+    }
+
+    for(std::size_t i = 0; i < mTypes.size(); i++)
+        buildNameSlots(mTypes[i]);
+
+    std::sort(mTypes.begin(), mTypes.end(),
+        [](const Type& a, const Type& b) { return a.code < b.code; });
+
+    mDataOffsets.reserve(mResources.size());
+    for(const Resource& resource : mResources)
+        mDataOffsets.push_back(resource.dataOffset);
+
+    std::sort(mDataOffsets.begin(), mDataOffsets.end());
+    mDataOffsets.erase(std::unique(mDataOffsets.begin(), mDataOffsets.end()), mDataOffsets.end());
+
+    return true;
+}
+
+// Static
+// 32-bit FNV-1a.
+uint32_t ResourceIndex::hashName(const char* name, std::size_t length)
+{
+    uint32_t hash = 2166136261U;
+    for(std::size_t i = 0; i < length; i++)
+    {
+        hash ^= static_cast<unsigned char>(name[i]);
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+// Copies every name (Pascal strings in the name list) into mNames.
+bool ResourceIndex::decodeNames(const char* nameList, std::size_t nameListLength)
+{
+    for(std::size_t i = 0; i < mResources.size(); i++)
+    {
+        Resource& resource = mResources[i];
+        if(resource.nameOffset == noName)
+            continue;
+
+        std::size_t nameLength = resource.nameOffset < nameListLength ?
+            static_cast<unsigned char>(nameList[resource.nameOffset]) : 0;
+        if(resource.nameOffset + 1U + nameLength > nameListLength)
+        {
+            std::cerr << "Name of resource with ID '" << resource.ID <<
+                "' lies outside of the name list!" << std::endl;
+            return false;
+        }
+
+        resource.nameStart = static_cast<uint32_t>(mNames.size());
+        resource.nameLength = static_cast<uint8_t>(nameLength);
+        mNames.append(nameList + resource.nameOffset + 1, nameLength);
+    }
+
+    return true;
+}
+
+// Appends the name hash table of type to mNameSlots.
+// Resources must already be sorted by ID, so that the lowest ID
+// comes first in its probe sequence.
+void ResourceIndex::buildNameSlots(Type& type)
+{
+    uint32_t namedCount = 0;
+    for(uint32_t i = type.firstResource; i < type.firstResource + type.resourceCount; i++)
+    {
+        if(mResources[i].nameOffset != noName)
+            namedCount++;
+    }
+
+    if(namedCount == 0)
+        return;
+
+    // Keep the load factor at or under 1/2.
+    uint32_t slotCount = 1;
+    while(slotCount < namedCount * 2)
+        slotCount <<= 1;
+
+    type.firstNameSlot = static_cast<uint32_t>(mNameSlots.size());
+    type.nameSlotCount = slotCount;
+    mNameSlots.resize(mNameSlots.size() + slotCount, 0);
+    uint32_t* slots = mNameSlots.data() + type.firstNameSlot;
+
+    for(uint32_t i = type.firstResource; i < type.firstResource + type.resourceCount; i++)
+    {
+        const Resource& resource = mResources[i];
+        if(resource.nameOffset == noName)
+            continue;
+
+        uint32_t slot = hashName(mNames.data() + resource.nameStart, resource.nameLength) & (slotCount - 1);
+        while(slots[slot] != 0)
+            slot = (slot + 1) & (slotCount - 1);
+
+        slots[slot] = i + 1;
+    }
+}
+
+// Moves the building tables into a fresh image, and lets go of any sidecar.
+void ResourceIndex::pack()
+{
+    ImageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, imageMagic, sizeof(header.magic));
+    header.version = imageVersion;
+    header.byteOrderMark = byteOrderMark;
+    header.typeCount = static_cast<uint32_t>(mTypes.size());
+    header.resourceCount = static_cast<uint32_t>(mResources.size());
+    header.namesLength = static_cast<uint32_t>(mNames.size());
+    header.nameSlotCount = static_cast<uint32_t>(mNameSlots.size());
+    header.dataOffsetCount = static_cast<uint32_t>(mDataOffsets.size());
+
+    header.typesOffset = alignImageOffset(sizeof(ImageHeader));
+    header.resourcesOffset = alignImageOffset(header.typesOffset + mTypes.size() * sizeof(Type));
+    header.namesOffset = alignImageOffset(header.resourcesOffset + mResources.size() * sizeof(Resource));
+    header.nameSlotsOffset = alignImageOffset(header.namesOffset + mNames.size());
+    header.dataOffsetsOffset = alignImageOffset(header.nameSlotsOffset + mNameSlots.size() * sizeof(uint32_t));
+    header.imageSize = alignImageOffset(header.dataOffsetsOffset + mDataOffsets.size() * sizeof(uint32_t));
+
+    mImage.assign(header.imageSize / sizeof(uint64_t), 0);
+    char* image = reinterpret_cast<char*>(mImage.data());
+    std::memcpy(image, &header, sizeof(header));
+    if(!mTypes.empty())
+        std::memcpy(image + header.typesOffset, mTypes.data(), mTypes.size() * sizeof(Type));
+    if(!mResources.empty())
+        std::memcpy(image + header.resourcesOffset, mResources.data(), mResources.size() * sizeof(Resource));
+    if(!mNames.empty())
+        std::memcpy(image + header.namesOffset, mNames.data(), mNames.size());
+    if(!mNameSlots.empty())
+        std::memcpy(image + header.nameSlotsOffset, mNameSlots.data(), mNameSlots.size() * sizeof(uint32_t));
+    if(!mDataOffsets.empty())
+        std::memcpy(image + header.dataOffsetsOffset, mDataOffsets.data(), mDataOffsets.size() * sizeof(uint32_t));
+
+    // Everything lives in the image now.
+    std::vector<Type>().swap(mTypes);
+    std::vector<Resource>().swap(mResources);
+    std::string().swap(mNames);
+    std::vector<uint32_t>().swap(mNameSlots);
+    std::vector<uint32_t>().swap(mDataOffsets);
+    mSidecar.reset();
+}
+
+bool ResourceIndex::load(const std::string& sidecarPath, const Fingerprint& fingerprint)
+{
+    std::shared_ptr<Reader> sidecar(new MappedReader(sidecarPath));
+    if(!sidecar->isOpen() || sidecar->size() < sizeof(ImageHeader))
+        return false;
+
+    // Mappings are page-aligned, so the tables are aligned too.
+    const ImageHeader& header = *reinterpret_cast<const ImageHeader*>(sidecar->data());
+    if(std::memcmp(header.magic, imageMagic, sizeof(header.magic)) != 0 ||
+       header.version != imageVersion || header.byteOrderMark != byteOrderMark ||
+       header.imageSize != sidecar->size() || !sameFingerprint(header.fingerprint, fingerprint))
+    {
+        return false;
+    }
+
+    // Sections in order and inside the file, and tables only pointing
+    // inside of them, so that a damaged sidecar cannot send lookups
+    // outside of the mapping. Offsets are bounded first: counts are 32-bit,
+    // so the sums below cannot wrap around then.
+    if(header.typesOffset > header.imageSize || header.resourcesOffset > header.imageSize ||
+       header.namesOffset > header.imageSize || header.nameSlotsOffset > header.imageSize ||
+       header.dataOffsetsOffset > header.imageSize ||
+       header.typesOffset < sizeof(ImageHeader) ||
+       header.resourcesOffset < header.typesOffset + static_cast<uint64_t>(header.typeCount) * sizeof(Type) ||
+       header.namesOffset < header.resourcesOffset + static_cast<uint64_t>(header.resourceCount) * sizeof(Resource) ||
+       header.nameSlotsOffset < header.namesOffset + header.namesLength ||
+       header.dataOffsetsOffset < header.nameSlotsOffset + static_cast<uint64_t>(header.nameSlotCount) * sizeof(uint32_t) ||
+       header.imageSize < header.dataOffsetsOffset + static_cast<uint64_t>(header.dataOffsetCount) * sizeof(uint32_t) ||
+       (header.typesOffset | header.resourcesOffset | header.nameSlotsOffset | header.dataOffsetsOffset) % 8 != 0 ||
+       !checkTables(sidecar->data()))
+    {
+        std::cerr << "Sidecar index '" << sidecarPath << "' is damaged!" << std::endl;
+        return false;
+    }
+
+    std::vector<uint64_t>().swap(mImage);
+    mSidecar = sidecar;
+    return true;
+}
+
+// Static
+// Call once the sections are known to lie inside the image.
+bool ResourceIndex::checkTables(const char* image)
+{
+    const ImageHeader& header = *reinterpret_cast<const ImageHeader*>(image);
+    const Type* types = reinterpret_cast<const Type*>(image + header.typesOffset);
+    const Resource* resources = reinterpret_cast<const Resource*>(image + header.resourcesOffset);
+    const uint32_t* nameSlots = reinterpret_cast<const uint32_t*>(image + header.nameSlotsOffset);
+
+    // At most one per resource.
+    if(header.dataOffsetCount > header.resourceCount)
+        return false;
+
+    for(uint32_t i = 0; i < header.resourceCount; i++)
+    {
+        const Resource& resource = resources[i];
+        if(resource.nameOffset != noName &&
+           static_cast<uint64_t>(resource.nameStart) + resource.nameLength > header.namesLength)
+        {
+            return false;
+        }
+    }
+
+    for(uint32_t i = 0; i < header.typeCount; i++)
+    {
+        const Type& type = types[i];
+        if(static_cast<uint64_t>(type.firstResource) + type.resourceCount > header.resourceCount ||
+           static_cast<uint64_t>(type.firstNameSlot) + type.nameSlotCount > header.nameSlotCount ||
+           (type.nameSlotCount & (type.nameSlotCount - 1)) != 0)
+        {
+            return false;
+        }
+
+        // Probing stops at the first empty slot, there has to be one.
+        bool hasEmptySlot = type.nameSlotCount == 0;
+        for(uint32_t slot = type.firstNameSlot; slot < type.firstNameSlot + type.nameSlotCount; slot++)
+        {
+            if(nameSlots[slot] > header.resourceCount)
+                return false;
+
+            hasEmptySlot = hasEmptySlot || nameSlots[slot] == 0;
+        }
+
+        if(!hasEmptySlot)
+            return false;
+    }
+
+    return true;
+}
+
+bool ResourceIndex::save(const std::string& sidecarPath, const Fingerprint& fingerprint) const
+{
+    ImageHeader stampedHeader = header();
+    stampedHeader.fingerprint = fingerprint;
+
+    // Unique enough that two processes saving at once do not collide.
+    std::string temporaryPath = sidecarPath + ".tmp" + std::to_string(std::random_device()());
+    {
+        std::ofstream file(temporaryPath, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+        file.write(reinterpret_cast<const char*>(&stampedHeader), sizeof(stampedHeader));
+        file.write(image() + sizeof(stampedHeader), stampedHeader.imageSize - sizeof(stampedHeader));
+        file.close();
+
+        if(file.fail())
+        {
+            std::cerr << "Cannot write sidecar index '" << temporaryPath << "'!" << std::endl;
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+    }
+
+#ifdef _WIN32
+    // rename() does not replace existing files on Windows.
+    std::remove(sidecarPath.c_str());
+#endif
+    if(std::rename(temporaryPath.c_str(), sidecarPath.c_str()) != 0)
+    {
+        std::cerr << "Cannot replace sidecar index '" << sidecarPath << "'!" << std::endl;
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+const char* ResourceIndex::image() const
+{
+    if(mSidecar != nullptr)
+        return mSidecar->data();
+
+    return reinterpret_cast<const char*>(mImage.data());
+}
+
+const ResourceIndex::ImageHeader& ResourceIndex::header() const
+{
+    return *reinterpret_cast<const ImageHeader*>(image());
+}
+
+const ResourceIndex::Type* ResourceIndex::typeTable() const
+{
+    return reinterpret_cast<const Type*>(image() + header().typesOffset);
+}
+
+const ResourceIndex::Resource* ResourceIndex::resourceTable() const
+{
+    return reinterpret_cast<const Resource*>(image() + header().resourcesOffset);
+}
+
+const char* ResourceIndex::nameTable() const
+{
+    return image() + header().namesOffset;
+}
+
+const uint32_t* ResourceIndex::nameSlotTable() const
+{
+    return reinterpret_cast<const uint32_t*>(image() + header().nameSlotsOffset);
+}
+
+const uint32_t* ResourceIndex::dataOffsetTable() const
+{
+    return reinterpret_cast<const uint32_t*>(image() + header().dataOffsetsOffset);
+}
+
+// Static
+// Types are case sensitive and exactly four chars long (Apple HFS+ specification).
+uint32_t ResourceIndex::typeCode(const std::string& type)
+{
+    uint32_t code = 0;
+    for(std::size_t i = 0; i < type.size() && i < 4; i++)
+        code = (code << 8) | static_cast<unsigned char>(type[i]);
+
+    return code;
+}
+
+// Static
+std::string ResourceIndex::typeString(uint32_t code)
+{
+    std::string type(4, '\0');
+    for(int i = 0; i < 4; i++)
+        type[i] = static_cast<char>((code >> (24 - i * 8)) & 0xFF);
+
+    return type;
+}
+
+const ResourceIndex::Type* ResourceIndex::findType(const std::string& type) const
+{
+    if(type.size() != 4)
+        return nullptr;
+
+    uint32_t code = typeCode(type);
+    const Type* end = typesEnd();
+    const Type* it = std::lower_bound(typesBegin(), end, code, typeCodeLess);
+
+    if(it == end || it->code != code)
+        return nullptr;
+
+    return it;
+}
+
+const ResourceIndex::Resource* ResourceIndex::findResource(const Type& type, uint16_t ID) const
+{
+    const Resource* end = resourcesEnd(type);
+    const Resource* it = std::lower_bound(resourcesBegin(type), end, ID, resourceIDLess);
+
+    if(it == end || it->ID != ID)
+        return nullptr;
+
+    return it;
+}
+
+const ResourceIndex::Resource* ResourceIndex::findResource(const Type& type,
+                                                           const std::string& name) const
+{
+    if(type.nameSlotCount == 0)
+        return nullptr;
+
+    const uint32_t* slots = nameSlotTable() + type.firstNameSlot;
+    const Resource* resources = resourceTable();
+    const char* names = nameTable();
+    uint32_t mask = type.nameSlotCount - 1;
+
+    for(uint32_t slot = hashName(name.data(), name.size()) & mask; slots[slot] != 0;
+        slot = (slot + 1) & mask)
+    {
+        const Resource& resource = resources[slots[slot] - 1];
+        if(resource.nameLength == name.size() &&
+           std::memcmp(names + resource.nameStart, name.data(), name.size()) == 0)
+        {
+            return &resource;
+        }
+    }
+
+    return nullptr;
+}
+
+std::string ResourceIndex::name(const Resource& resource) const
+{
+    if(resource.nameOffset == noName)
+        return std::string();
+
+    return std::string(nameTable() + resource.nameStart, resource.nameLength);
+}
+
+const char* ResourceIndex::nameData(const Resource& resource) const
+{
+    if(resource.nameOffset == noName)
+        return nullptr;
+
+    return nameTable() + resource.nameStart;
+}
+
+const ResourceIndex::Type* ResourceIndex::typesBegin() const
+{
+    return typeTable();
+}
+
+const ResourceIndex::Type* ResourceIndex::typesEnd() const
+{
+    return typeTable() + header().typeCount;
+}
+
+bool ResourceIndex::nextDataOffset(uint32_t dataOffset, uint32_t* next) const
+{
+    const uint32_t* end = dataOffsetTable() + header().dataOffsetCount;
+    const uint32_t* found = std::upper_bound(dataOffsetTable(), end, dataOffset);
+    if(found == end)
+        return false;
+
+    *next = *found;
+    return true;
+}
+
+const ResourceIndex::Resource* ResourceIndex::resourcesBegin(const Type& type) const
+{
+    return resourceTable() + type.firstResource;
+}
+
+const ResourceIndex::Resource* ResourceIndex::resourcesEnd(const Type& type) const
+{
+    return resourceTable() + type.firstResource + type.resourceCount;
+}
+
+} // namespace RESX
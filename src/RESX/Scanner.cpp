@@ -0,0 +1,347 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/Scanner.hpp"
+#include "RESX/Decoder.hpp"
+#include "RESX/PositionalReader.hpp"
+#include "RESX/ThreadPool.hpp"
+
+#include <algorithm> // For std::sort
+#include <atomic>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RESX_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h> // For _BitScanForward()
+#endif
+
+namespace RESX
+{
+
+namespace
+{
+    // Bytes readable past the positions given to prefilter().
+    const std::size_t chunkPadding = 32;
+
+    // Header copy (16), handle to next map (4), file reference (2),
+    // attributes (2), type list offset (2), name list offset (2),
+    // number of types - 1 (2).
+    const std::size_t smallestMapLength = 30;
+
+    // Bound of the data offset (256 in practice) and of the map length:
+    // the map addresses itself with 2-byte offsets (names can go a bit
+    // further, but not 16 MiB further). The data zone has no such bound,
+    // only where resources start has to fit in 3 bytes.
+    const uint32_t smallFieldLimit = 1U << 24;
+
+#ifdef RESX_HAVE_SSE2
+    unsigned int countTrailingZeros(uint32_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return index;
+#else
+        return __builtin_ctz(value);
+#endif
+    }
+#endif
+}
+
+Scanner::Scanner(const std::string& fileName)
+    : Scanner(std::make_shared<PositionalReader>(fileName))
+{
+
+}
+
+Scanner::Scanner(std::shared_ptr<Reader> reader)
+    : mReader(reader),
+    mThreadCount(1),
+    mAlignment(1),
+    mChunkSize(defaultChunkSize)
+{
+    if(!mReader->isOpen())
+        std::cerr << "Could not open image file!" << std::endl;
+}
+
+Scanner::~Scanner()
+{
+
+}
+
+bool Scanner::isOpen() const
+{
+    return mReader->isOpen();
+}
+
+void Scanner::setThreadCount(unsigned int threadCount)
+{
+    mThreadCount = threadCount;
+}
+
+void Scanner::setAlignment(std::size_t alignment)
+{
+    if(alignment == 0 || (alignment & (alignment - 1)) != 0)
+    {
+        std::cerr << "Scan alignment " << alignment << " is not a power of two! Using 1." << std::endl;
+        alignment = 1;
+    }
+
+    mAlignment = alignment;
+}
+
+void Scanner::setChunkSize(std::size_t chunkSize)
+{
+    mChunkSize = std::max<std::size_t>(chunkSize, 1);
+}
+
+// Static
+// A header has four big-endian 32-bit fields: data offset, map offset,
+// data length and map length. The first (256 in practice) and the last
+// are below 16 MiB, so their high bytes (0 and 12) are zero, and the map
+// length is at least 30, so its other bytes (13 to 15) are not all zero.
+// Zeroed areas thus yield no candidates.
+void Scanner::prefilter(const char* data, std::size_t count, std::size_t alignment,
+                        std::vector<std::size_t>& candidates)
+{
+#ifdef RESX_HAVE_SSE2
+    if(alignment < 16)
+    {
+        // Zero bytes of 32 bytes as bits, then the positions among the
+        // first 16 (and aligned ones) that pass.
+        uint32_t alignedPositions = 0;
+        for(std::size_t i = 0; i < 16; i += alignment)
+            alignedPositions |= 1U << i;
+
+        const __m128i zero = _mm_setzero_si128();
+        for(std::size_t i = 0; i < count; i += 16)
+        {
+            __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+            uint32_t zeros = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(low, zero))) |
+                (static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(high, zero))) << 16);
+
+            uint32_t hits = zeros & (zeros >> 12) & ~((zeros >> 13) & (zeros >> 14) & (zeros >> 15)) &
+                alignedPositions;
+            while(hits != 0)
+            {
+                std::size_t position = i + countTrailingZeros(hits);
+                if(position < count)
+                    candidates.push_back(position);
+
+                hits &= hits - 1;
+            }
+        }
+
+        return;
+    }
+#endif
+
+    // Few enough positions that vectors would not help.
+    for(std::size_t i = 0; i < count; i += alignment)
+    {
+        if((data[i] | data[i + 12]) == 0 && (data[i + 13] | data[i + 14] | data[i + 15]) != 0)
+            candidates.push_back(i);
+    }
+}
+
+// The header alone: zones that fit in the image and do not overlap.
+bool Scanner::checkHeader(const char* header, Defs::addr offset, FoundFork* fork) const
+{
+    Decoder decoder(header, 16);
+    uint32_t dataOffset = decoder.readU32();
+    uint32_t mapOffset = decoder.readU32();
+    uint32_t dataLength = decoder.readU32();
+    uint32_t mapLength = decoder.readU32();
+
+    if(dataOffset < 16 || mapOffset < 16 || mapLength < smallestMapLength ||
+       dataOffset >= smallFieldLimit || mapLength >= smallFieldLimit)
+    {
+        return false;
+    }
+
+    uint64_t dataEnd = static_cast<uint64_t>(dataOffset) + dataLength;
+    uint64_t mapEnd = static_cast<uint64_t>(mapOffset) + mapLength;
+    if(dataEnd > mapOffset && mapEnd > dataOffset)
+        return false;
+
+    fork->offset = offset;
+    fork->size = static_cast<Defs::addr>(std::max(dataEnd, mapEnd));
+    return fork->size <= mReader->size() - offset;
+}
+
+// Call after checkHeader()! Walks the map the way ResourceIndex does,
+// without building anything, or cerring about what does not fit.
+bool Scanner::checkMap(Defs::addr offset, const char* header, FoundFork* fork) const
+{
+    Decoder headerDecoder(header, 16);
+    headerDecoder.skip(4);
+    uint32_t mapOffset = headerDecoder.readU32();
+    uint32_t dataLength = headerDecoder.readU32();
+    uint32_t mapLength = headerDecoder.readU32();
+
+    // The fields first, to read the whole map only if they make sense.
+    char fields[smallestMapLength];
+    if(mReader->readAt(offset + mapOffset, fields, sizeof(fields)) != sizeof(fields))
+        return false;
+
+    Decoder fieldsDecoder(fields, sizeof(fields));
+    fieldsDecoder.skip(16 + 4 + 2 + 2);
+    std::size_t typeListOffset = fieldsDecoder.readU16();
+    std::size_t nameListOffset = fieldsDecoder.readU16();
+    if(typeListOffset < smallestMapLength - 2 || typeListOffset + 2 > mapLength ||
+       nameListOffset < typeListOffset + 2 || nameListOffset > mapLength)
+    {
+        return false;
+    }
+
+    std::vector<char> map(mapLength);
+    if(mReader->readAt(offset + mapOffset, map.data(), map.size()) != map.size())
+        return false;
+
+    Decoder typeDecoder(map.data() + typeListOffset, mapLength - typeListOffset);
+    // Signed: -1 if there are no types.
+    int numberOfTypes = typeDecoder.readS16() + 1;
+    if(numberOfTypes < 0 || 2 + static_cast<std::size_t>(numberOfTypes) * 8 > nameListOffset - typeListOffset)
+        return false;
+
+    fork->typeCount = static_cast<uint32_t>(numberOfTypes);
+    fork->resourceCount = 0;
+
+    std::size_t nameListLength = mapLength - nameListOffset;
+    for(int i = 0; i < numberOfTypes; i++)
+    {
+        typeDecoder.skip(4); // Type code, anything goes
+        uint32_t resourceCount = typeDecoder.readU16() + 1U;
+        // Relative to the type list, after the type entries.
+        std::size_t referenceListOffset = typeDecoder.readU16();
+        if(referenceListOffset < 2 + static_cast<std::size_t>(numberOfTypes) * 8 ||
+           typeListOffset + referenceListOffset + resourceCount * 12 > nameListOffset)
+        {
+            return false;
+        }
+
+        Decoder referenceDecoder(map.data() + typeListOffset + referenceListOffset, resourceCount * 12);
+        for(uint32_t j = 0; j < resourceCount; j++)
+        {
+            referenceDecoder.skip(2); // ID
+            uint16_t nameOffset = referenceDecoder.readU16();
+            referenceDecoder.skip(1); // Attributes
+            uint32_t dataOffset = referenceDecoder.readU24();
+            referenceDecoder.skip(4); // Reserved (handle to resource)
+
+            // Room for the length of the data at least.
+            if(static_cast<uint64_t>(dataOffset) + 4 > dataLength ||
+               (nameOffset != ResourceIndex::noName && nameOffset >= nameListLength))
+            {
+                return false;
+            }
+        }
+
+        fork->resourceCount += resourceCount;
+    }
+
+    return true;
+}
+
+// Positions past the chunk (up to chunkPadding) are read too, so that
+// headers straddling two chunks are found in the first one.
+void Scanner::scanChunk(Defs::addr start, std::vector<char>& buffer, std::vector<std::size_t>& candidates,
+                        std::vector<FoundFork>& forks) const
+{
+    Defs::addr imageSize = mReader->size();
+    std::size_t length = static_cast<std::size_t>(std::min<Defs::addr>(buffer.size() - chunkPadding,
+                                                                       imageSize - start));
+    std::size_t toRead = static_cast<std::size_t>(std::min<Defs::addr>(buffer.size(), imageSize - start));
+    std::size_t bytesRead = mReader->readAt(start, buffer.data(), toRead);
+    if(bytesRead < length)
+    {
+        std::cerr << "Could only read " << bytesRead << " of " << length << " bytes at " <<
+            start << " of the image!" << std::endl;
+        length = bytesRead;
+    }
+
+    // Past the end of the image: zeros, never a valid header.
+    std::fill(buffer.begin() + bytesRead, buffer.end(), 0);
+
+    candidates.clear();
+    prefilter(buffer.data(), length, mAlignment, candidates);
+
+    for(std::size_t position : candidates)
+    {
+        FoundFork fork;
+        const char* header = buffer.data() + position;
+        if(checkHeader(header, start + position, &fork) && checkMap(start + position, header, &fork))
+            forks.push_back(fork);
+    }
+}
+
+std::vector<FoundFork> Scanner::scan() const
+{
+    std::vector<FoundFork> forks;
+    if(!mReader->isOpen())
+        return forks;
+
+    // Whole multiples of the alignment, so that chunks start aligned.
+    std::size_t chunkSize = (mChunkSize + mAlignment - 1) / mAlignment * mAlignment;
+    Defs::addr imageSize = mReader->size();
+    std::size_t chunkCount = static_cast<std::size_t>((imageSize + chunkSize - 1) / chunkSize);
+
+    // Every thread takes the next chunk when it is done with one, so that
+    // the image is read front to back, however fast each thread goes.
+    std::atomic<std::size_t> nextChunk(0);
+    auto scanChunks = [this, chunkSize, chunkCount, &nextChunk](std::vector<FoundFork>& found)
+    {
+        std::vector<char> buffer(chunkSize + chunkPadding);
+        std::vector<std::size_t> candidates;
+        for(std::size_t i = nextChunk++; i < chunkCount; i = nextChunk++)
+            scanChunk(static_cast<Defs::addr>(i) * chunkSize, buffer, candidates, found);
+    };
+
+    if(mThreadCount == 1 || chunkCount <= 1)
+    {
+        scanChunks(forks);
+    } else
+    {
+        ThreadPool threadPool(mThreadCount);
+        std::vector<std::vector<FoundFork>> foundPerThread(threadPool.threadCount());
+        for(std::size_t i = 0; i < foundPerThread.size(); i++)
+        {
+            std::vector<FoundFork>& found = foundPerThread[i];
+            threadPool.submit(i, [&scanChunks, &found]() { scanChunks(found); });
+        }
+
+        threadPool.wait();
+        for(const std::vector<FoundFork>& found : foundPerThread)
+            forks.insert(forks.end(), found.begin(), found.end());
+    }
+
+    std::sort(forks.begin(), forks.end(),
+        [](const FoundFork& a, const FoundFork& b) { return a.offset < b.offset; });
+    return forks;
+}
+
+ResourceFork Scanner::loadResourceFork(const FoundFork& fork) const
+{
+    return ResourceFork(mReader, fork.offset);
+}
+
+} // namespace RESX
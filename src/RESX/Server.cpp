@@ -0,0 +1,493 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/Server.hpp"
+#include "RESX/ResourceIndex.hpp"
+
+#include <cerrno>
+#include <climits> // For UINT_MAX
+#include <cstring> // For std::memcpy
+#include <iostream>
+#include <thread>
+
+#include <climits> // For PATH_MAX
+#include <cstdlib> // For realpath()
+#include <fcntl.h> // For open()
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h> // For lstat(), chmod()
+#include <sys/un.h>
+#include <unistd.h> // For close(), unlink(), pipe()
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+// Memory files, for data that is not stored as is in a file.
+#if defined(__linux__) && defined(SYS_memfd_create)
+#define RESX_HAVE_MEMFD
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#endif
+
+namespace RESX
+{
+
+Server::OpenFork::OpenFork(const std::string& path, unsigned int blockSize, unsigned int startBlock,
+                           bool decompress)
+    : file(path, blockSize),
+    resourceFork(file.loadResourceFork(startBlock)),
+    fileDescriptor(::open(path.c_str(), O_RDONLY)),
+    decompress(decompress)
+{
+    resourceFork.setDecompression(decompress);
+}
+
+Server::OpenFork::~OpenFork()
+{
+    if(fileDescriptor != -1)
+        ::close(fileDescriptor);
+}
+
+Server::Server(const std::string& socketPath, const std::string& rootDirectory)
+    : mSocketPath(socketPath),
+    mListeningSocket(-1),
+    mStopping(false)
+{
+    mWakePipe[0] = mWakePipe[1] = -1;
+
+    char resolvedRoot[PATH_MAX];
+    if(::realpath(rootDirectory.c_str(), resolvedRoot) == nullptr)
+    {
+        std::cerr << "Root directory '" << rootDirectory << "' does not exist: " << std::strerror(errno) <<
+            std::endl;
+        return;
+    }
+
+    mRootDirectory = resolvedRoot;
+    if(mRootDirectory == "/")
+        mRootDirectory.clear();
+
+    // Non-blocking, so that stop() never waits in a signal handler.
+    if(::pipe(mWakePipe) != 0)
+    {
+        std::cerr << "Could not create pipe: " << std::strerror(errno) << std::endl;
+        mWakePipe[0] = mWakePipe[1] = -1;
+        return;
+    }
+
+    for(int end : mWakePipe)
+    {
+        ::fcntl(end, F_SETFD, FD_CLOEXEC);
+        ::fcntl(end, F_SETFL, ::fcntl(end, F_GETFL) | O_NONBLOCK);
+    }
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Socket path '" << socketPath << "' is empty or too long!" << std::endl;
+        return;
+    }
+
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+
+    // A socket left behind by a server that did not stop cleanly.
+    struct stat status;
+    if(::lstat(socketPath.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+        ::unlink(socketPath.c_str());
+
+    mListeningSocket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(mListeningSocket == -1)
+    {
+        std::cerr << "Could not create socket: " << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    // Owner only, on top of checking who connects.
+    if(::bind(mListeningSocket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+       ::chmod(socketPath.c_str(), S_IRUSR | S_IWUSR) != 0 ||
+       ::listen(mListeningSocket, SOMAXCONN) != 0)
+    {
+        std::cerr << "Could not listen at '" << socketPath << "': " << std::strerror(errno) << std::endl;
+        ::close(mListeningSocket);
+        mListeningSocket = -1;
+    }
+}
+
+Server::~Server()
+{
+    if(mListeningSocket != -1)
+    {
+        ::close(mListeningSocket);
+        ::unlink(mSocketPath.c_str());
+    }
+
+    for(int end : mWakePipe)
+    {
+        if(end != -1)
+            ::close(end);
+    }
+}
+
+bool Server::isListening() const
+{
+    return mListeningSocket != -1;
+}
+
+void Server::run()
+{
+    // Waiting in poll() rather than accept(): shutting a listening socket
+    // down does not wake accept() up everywhere, and accept() is restarted
+    // after signal handlers installed with SA_RESTART.
+    pollfd waitedFor[2] = {{mListeningSocket, POLLIN, 0}, {mWakePipe[0], POLLIN, 0}};
+    while(isListening() && !mStopping)
+    {
+        if(::poll(waitedFor, 2, -1) == -1)
+        {
+            if(errno == EINTR)
+                continue;
+
+            std::cerr << "Could not wait for connections: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        if(waitedFor[1].revents != 0 || mStopping)
+            break;
+
+        if(waitedFor[0].revents == 0)
+            continue;
+
+        int socket = ::accept(mListeningSocket, nullptr, nullptr);
+        if(socket == -1)
+        {
+            if(errno == EINTR || errno == ECONNABORTED || errno == EAGAIN || errno == EWOULDBLOCK)
+                continue;
+
+            std::cerr << "Could not accept connection: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        if(!isPeerAllowed(socket))
+        {
+            ::close(socket);
+            continue;
+        }
+
+#ifdef SO_NOSIGPIPE
+        int noSignal = 1;
+        ::setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &noSignal, sizeof(noSignal));
+#endif
+
+        {
+            std::lock_guard<std::mutex> lock(mConnectionsMutex);
+            mConnections.insert(socket);
+        }
+
+        std::thread([this, socket]() { serveConnection(socket); }).detach();
+    }
+
+    // Wake the connections up, they close themselves.
+    std::unique_lock<std::mutex> lock(mConnectionsMutex);
+    for(int socket : mConnections)
+        ::shutdown(socket, SHUT_RDWR);
+
+    mConnectionsClosed.wait(lock, [this]() { return mConnections.empty(); });
+}
+
+void Server::stop()
+{
+    mStopping = true;
+
+    // write() is async-signal-safe. A full pipe already wakes run() up.
+    char wake = 1;
+    if(mWakePipe[1] != -1)
+    {
+        ssize_t ignored = ::write(mWakePipe[1], &wake, 1);
+        (void)ignored;
+    }
+}
+
+// Static
+// Processes of the same user, or root. Others are turned away without a reply.
+bool Server::isPeerAllowed(int socket)
+{
+    uid_t peerUser;
+#if defined(__linux__) && defined(SO_PEERCRED)
+    ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if(::getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0)
+        return false;
+
+    peerUser = credentials.uid;
+#else
+    gid_t peerGroup;
+    if(::getpeereid(socket, &peerUser, &peerGroup) != 0)
+        return false;
+#endif
+
+    if(peerUser == ::geteuid() || peerUser == 0)
+        return true;
+
+    std::cerr << "Turned away a connection from user " << peerUser << "!" << std::endl;
+    return false;
+}
+
+// Resolves links and '..', relative to the root directory. Returns false
+// if the file does not exist or lies outside of the root directory.
+bool Server::resolvePath(const std::string& path, std::string* resolvedPath) const
+{
+    std::string fullPath = !path.empty() && path[0] == '/' ? path : mRootDirectory + '/' + path;
+    char resolved[PATH_MAX];
+    if(::realpath(fullPath.c_str(), resolved) == nullptr)
+        return false;
+
+    *resolvedPath = resolved;
+    return resolvedPath->size() > mRootDirectory.size() + 1 &&
+        resolvedPath->compare(0, mRootDirectory.size(), mRootDirectory) == 0 &&
+        (*resolvedPath)[mRootDirectory.size()] == '/';
+}
+
+// Opened on the first request for it, then kept. Not kept if the file
+// could not be opened, so that it is tried again next time.
+std::shared_ptr<Server::OpenFork> Server::openFork(const Protocol::Request& request,
+                                                   const std::string& requestedPath)
+{
+    std::string path;
+    if(!resolvePath(requestedPath, &path))
+        return nullptr;
+
+    bool decompress = (request.flags & Protocol::decompressFlag) != 0;
+    std::string key = path + '\0' + std::to_string(request.blockSize) + ':' +
+        std::to_string(request.startBlock) + ':' + (decompress ? '1' : '0');
+
+    {
+        std::lock_guard<std::mutex> lock(mForksMutex);
+        auto found = mForks.find(key);
+        if(found != mForks.end())
+            return found->second;
+    }
+
+    // Parsed without holding the lock, other forks are still served.
+    std::shared_ptr<OpenFork> openFork = std::make_shared<OpenFork>(path, request.blockSize,
+        static_cast<unsigned int>(request.startBlock), decompress);
+    if(!openFork->file.getReader()->isOpen())
+        return nullptr;
+
+    // If another connection opened it meanwhile, theirs is kept.
+    std::lock_guard<std::mutex> lock(mForksMutex);
+    return mForks.insert(std::make_pair(key, openFork)).first->second;
+}
+
+void Server::serveConnection(int socket)
+{
+    std::vector<char> buffer; // Reused for every reply
+    Protocol::Request request;
+    while(Protocol::receiveAll(socket, reinterpret_cast<char*>(&request), sizeof(request)))
+    {
+        if(request.magic != Protocol::magic || request.version != Protocol::version ||
+           request.pathLength > Protocol::pathLengthLimit || request.nameLength > Protocol::nameLengthLimit)
+        {
+            // Cannot tell where the next request starts, give up on this client.
+            Protocol::Reply reply = {};
+            reply.magic = Protocol::magic;
+            reply.status = Protocol::badRequest;
+            reply.sequence = request.sequence;
+            Protocol::sendAll(socket, reinterpret_cast<const char*>(&reply), sizeof(reply));
+            break;
+        }
+
+        std::string path(request.pathLength, '\0');
+        std::string name(request.nameLength, '\0');
+        if(!Protocol::receiveAll(socket, &path[0], path.size()) ||
+           !Protocol::receiveAll(socket, &name[0], name.size()) ||
+           !serveRequest(socket, request, path, name, buffer))
+        {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mConnectionsMutex);
+    ::close(socket);
+    mConnections.erase(socket);
+    mConnectionsClosed.notify_all();
+}
+
+// Returns false if the reply could not be sent.
+bool Server::serveRequest(int socket, const Protocol::Request& request, const std::string& path,
+                          const std::string& name, std::vector<char>& buffer)
+{
+    Protocol::Reply reply = {};
+    reply.magic = Protocol::magic;
+    reply.sequence = request.sequence;
+    reply.status = Protocol::ok;
+    reply.payload = Protocol::noData;
+
+    std::shared_ptr<OpenFork> openFork;
+    ResourceInfo info;
+    if(request.operation == Protocol::forget)
+    {
+        std::lock_guard<std::mutex> lock(mForksMutex);
+        mForks.clear();
+    } else if((request.operation != Protocol::lookup && request.operation != Protocol::extract) ||
+              request.startBlock > UINT_MAX)
+    {
+        reply.status = Protocol::badRequest;
+    } else if(!(openFork = this->openFork(request, path)))
+    {
+        reply.status = Protocol::cannotOpen;
+    } else
+    {
+        std::string type = ResourceIndex::typeString(request.typeCode);
+        bool found = (request.flags & Protocol::byNameFlag) ?
+            openFork->resourceFork.getResourceInfo(ResourceKey(type, name), &info) :
+            openFork->resourceFork.getResourceInfo(ResourceKey(type, request.ID), &info);
+
+        if(found)
+        {
+            reply.ID = info.ID;
+            reply.attributes = info.attributes;
+            reply.nameLength = static_cast<uint16_t>(info.name.size());
+            reply.size = openFork->resourceFork.getResourceSize(info);
+        } else
+        {
+            reply.status = Protocol::notFound;
+        }
+    }
+
+    if(reply.status == Protocol::ok && request.operation == Protocol::extract)
+        return sendData(socket, reply, *openFork, info, buffer);
+
+    buffer.resize(sizeof(reply) + reply.nameLength);
+    std::memcpy(buffer.data(), &reply, sizeof(reply));
+    std::memcpy(buffer.data() + sizeof(reply), info.name.data(), reply.nameLength);
+    return Protocol::sendAll(socket, buffer.data(), buffer.size());
+}
+
+// The reply to an extraction, with its data.
+bool Server::sendData(int socket, Protocol::Reply& reply, const OpenFork& openFork, const ResourceInfo& info,
+                      std::vector<char>& buffer)
+{
+    std::size_t size = static_cast<std::size_t>(reply.size);
+    std::size_t headerSize = sizeof(reply) + reply.nameLength;
+    int fileDescriptor = -1;
+    bool closeDescriptor = false;
+
+    // As stored, the data has to lie inside the file: past its end, the
+    // client's mapping would fault (SIGBUS) instead of failing.
+    Defs::addr fileSize = openFork.file.getReader()->size();
+    Defs::addr resourceDataAddr = info.address + 4UL;
+    if(!openFork.decompress && (resourceDataAddr > fileSize || size > fileSize - resourceDataAddr))
+    {
+        std::cerr << "Resource at " << info.address << " extends past the end of the file!" << std::endl;
+        reply.status = Protocol::cannotRead;
+        reply.payload = Protocol::noData;
+    }
+    else if(size > Protocol::inlineDataLimit && !openFork.decompress && openFork.fileDescriptor != -1)
+    {
+        // As stored: right after the length, in the file itself.
+        reply.payload = Protocol::fileDescriptor;
+        reply.payloadOffset = info.address + 4;
+        fileDescriptor = openFork.fileDescriptor;
+    }
+#ifdef RESX_HAVE_MEMFD
+    else if(size > Protocol::inlineDataLimit)
+    {
+        fileDescriptor = static_cast<int>(::syscall(SYS_memfd_create, "resx", MFD_CLOEXEC));
+        closeDescriptor = true;
+        std::size_t written = 0;
+        bool failed = fileDescriptor == -1;
+        if(!failed)
+        {
+            openFork.resourceFork.streamResource(info, [fileDescriptor, &written, &failed](const char* chunk,
+                                                                                           std::size_t chunkSize)
+            {
+                ssize_t result = ::pwrite(fileDescriptor, chunk, chunkSize, static_cast<off_t>(written));
+                if(result != static_cast<ssize_t>(chunkSize))
+                {
+                    failed = true;
+                    return false;
+                }
+
+                written += chunkSize;
+                return true;
+            });
+        }
+
+        // Left compressed if it could not be expanded, so what was
+        // written is the size.
+        reply.payload = Protocol::fileDescriptor;
+        reply.payloadOffset = 0;
+        reply.size = written;
+        if(failed || written == 0)
+        {
+            reply.status = Protocol::cannotRead;
+            reply.payload = Protocol::noData;
+        }
+    }
+#endif
+    else if(openFork.decompress)
+    {
+        // Same as above, the size is only known once expanded.
+        reply.payload = Protocol::inlineData;
+        buffer.resize(headerSize);
+        reply.size = openFork.resourceFork.streamResource(info, [&buffer](const char* chunk, std::size_t chunkSize)
+        {
+            buffer.insert(buffer.end(), chunk, chunk + chunkSize);
+            return true;
+        });
+
+        if(reply.size == 0 && size != 0)
+        {
+            reply.status = Protocol::cannotRead;
+            reply.payload = Protocol::noData;
+        }
+    }
+    else
+    {
+        reply.payload = Protocol::inlineData;
+        buffer.resize(headerSize + size);
+        if(openFork.resourceFork.readResource(info, 0, buffer.data() + headerSize, size) != size)
+        {
+            reply.status = Protocol::cannotRead;
+            reply.payload = Protocol::noData;
+        }
+    }
+
+    if(reply.status != Protocol::ok)
+    {
+        reply.nameLength = 0;
+        buffer.resize(sizeof(reply));
+    } else if(reply.payload != Protocol::inlineData)
+    {
+        buffer.resize(headerSize);
+    }
+
+    std::memcpy(buffer.data(), &reply, sizeof(reply));
+    std::memcpy(buffer.data() + sizeof(reply), info.name.data(), reply.nameLength);
+    bool sent = Protocol::sendAll(socket, buffer.data(), buffer.size(),
+                                  reply.payload == Protocol::fileDescriptor ? fileDescriptor : -1);
+
+    if(closeDescriptor && fileDescriptor != -1)
+        ::close(fileDescriptor);
+
+    return sent;
+}
+
+} // namespace RESX
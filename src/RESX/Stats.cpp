@@ -0,0 +1,188 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/Stats.hpp"
+
+#include <sstream>
+
+namespace RESX
+{
+
+namespace
+{
+    void loadPhase(const StatsCounters::Phase& counters, Stats::Phase& phase)
+    {
+        phase.calls = counters.calls.load(std::memory_order_relaxed);
+        phase.nanoseconds = counters.nanoseconds.load(std::memory_order_relaxed);
+    }
+
+    void storePhase(const StatsCounters::Phase& from, StatsCounters::Phase& to)
+    {
+        to.calls.store(from.calls.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        to.nanoseconds.store(from.nanoseconds.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    void addPhase(const Stats::Phase& from, Stats::Phase& to)
+    {
+        to.calls += from.calls;
+        to.nanoseconds += from.nanoseconds;
+    }
+
+    // Name of phases, in the order of Stats.
+    const char* const phaseNames[] = {"parseHeader", "parseResourceMapFields", "lookup", "payloadRead"};
+}
+
+#ifdef RESX_ENABLE_STATS
+const bool Stats::enabled = true;
+#else
+const bool Stats::enabled = false;
+#endif
+
+Stats::Stats()
+    : seeks(0),
+    readCalls(0),
+    bytesRead(0),
+    allocations(0),
+    bytesAllocated(0),
+    parseHeader{0, 0},
+    parseResourceMapFields{0, 0},
+    lookup{0, 0},
+    payloadRead{0, 0}
+{
+
+}
+
+Stats& Stats::operator+=(const Stats& other)
+{
+    seeks += other.seeks;
+    readCalls += other.readCalls;
+    bytesRead += other.bytesRead;
+    allocations += other.allocations;
+    bytesAllocated += other.bytesAllocated;
+    addPhase(other.parseHeader, parseHeader);
+    addPhase(other.parseResourceMapFields, parseResourceMapFields);
+    addPhase(other.lookup, lookup);
+    addPhase(other.payloadRead, payloadRead);
+    return *this;
+}
+
+std::string Stats::toText() const
+{
+    const Phase* phases[] = {&parseHeader, &parseResourceMapFields, &lookup, &payloadRead};
+
+    std::ostringstream text;
+    if(!enabled)
+        text << "(statistics were compiled out, build with RESX_ENABLE_STATS)" << std::endl;
+
+    text << "seeks: " << seeks << std::endl <<
+        "readCalls: " << readCalls << std::endl <<
+        "bytesRead: " << bytesRead << std::endl <<
+        "allocations: " << allocations << std::endl <<
+        "bytesAllocated: " << bytesAllocated << std::endl;
+
+    for(std::size_t i = 0; i < 4; i++)
+    {
+        text << phaseNames[i] << ": " << phases[i]->calls << " calls, " <<
+            phases[i]->nanoseconds / 1e6 << " ms" << std::endl;
+    }
+
+    return text.str();
+}
+
+std::string Stats::toJSON() const
+{
+    const Phase* phases[] = {&parseHeader, &parseResourceMapFields, &lookup, &payloadRead};
+
+    std::ostringstream json;
+    json << "{\"enabled\": " << (enabled ? "true" : "false") <<
+        ", \"seeks\": " << seeks <<
+        ", \"readCalls\": " << readCalls <<
+        ", \"bytesRead\": " << bytesRead <<
+        ", \"allocations\": " << allocations <<
+        ", \"bytesAllocated\": " << bytesAllocated <<
+        ", \"phases\": {";
+
+    for(std::size_t i = 0; i < 4; i++)
+    {
+        json << (i == 0 ? "" : ", ") << "\"" << phaseNames[i] << "\": {\"calls\": " << phases[i]->calls <<
+            ", \"nanoseconds\": " << phases[i]->nanoseconds << "}";
+    }
+
+    json << "}}";
+    return json.str();
+}
+
+StatsCounters::Phase::Phase()
+    : calls(0),
+    nanoseconds(0)
+{
+
+}
+
+StatsCounters::StatsCounters()
+    : seeks(0),
+    readCalls(0),
+    bytesRead(0),
+    allocations(0),
+    bytesAllocated(0),
+    lastReadEnd(0)
+{
+
+}
+
+StatsCounters::StatsCounters(const StatsCounters& other)
+    : StatsCounters()
+{
+    *this = other;
+}
+
+StatsCounters& StatsCounters::operator=(const StatsCounters& other)
+{
+    seeks.store(other.seeks.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    readCalls.store(other.readCalls.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    bytesRead.store(other.bytesRead.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    allocations.store(other.allocations.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    bytesAllocated.store(other.bytesAllocated.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    lastReadEnd.store(other.lastReadEnd.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    storePhase(other.parseHeader, parseHeader);
+    storePhase(other.parseResourceMapFields, parseResourceMapFields);
+    storePhase(other.lookup, lookup);
+    storePhase(other.payloadRead, payloadRead);
+    return *this;
+}
+
+Stats StatsCounters::snapshot() const
+{
+    Stats stats;
+    stats.seeks = seeks.load(std::memory_order_relaxed);
+    stats.readCalls = readCalls.load(std::memory_order_relaxed);
+    stats.bytesRead = bytesRead.load(std::memory_order_relaxed);
+    stats.allocations = allocations.load(std::memory_order_relaxed);
+    stats.bytesAllocated = bytesAllocated.load(std::memory_order_relaxed);
+    loadPhase(parseHeader, stats.parseHeader);
+    loadPhase(parseResourceMapFields, stats.parseResourceMapFields);
+    loadPhase(lookup, stats.lookup);
+    loadPhase(payloadRead, stats.payloadRead);
+    return stats;
+}
+
+void StatsCounters::reset()
+{
+    *this = StatsCounters();
+}
+
+} // namespace RESX
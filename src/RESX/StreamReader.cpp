@@ -0,0 +1,69 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/StreamReader.hpp"
+
+#include <iostream>
+
+namespace RESX
+{
+
+StreamReader::StreamReader(ifstreamPointer file)
+    : mFile(file),
+    mSize(0)
+{
+    if(mFile->is_open())
+    {
+        mFile->seekg(0, std::ios::end);
+        mSize = mFile->tellg();
+        mFile->seekg(0, std::ios::beg);
+    }
+}
+
+StreamReader::~StreamReader()
+{
+
+}
+
+bool StreamReader::isOpen() const
+{
+    return mFile->is_open();
+}
+
+Defs::addr StreamReader::size() const
+{
+    return mSize;
+}
+
+std::size_t StreamReader::readAt(Defs::addr offset, char* destination, std::size_t size) const
+{
+    std::lock_guard<std::mutex> lock(mFileMutex);
+
+    // A previous short read leaves eof/fail set, which would make
+    // every following seekg() fail.
+    mFile->clear();
+    mFile->seekg(offset, std::ios::beg);
+    mFile->read(destination, size);
+
+    if(mFile->bad())
+        std::cerr << "Read error at offset " << offset << "! Loss of integrity of the stream?"
+            << std::endl;
+
+    return static_cast<std::size_t>(mFile->gcount());
+}
+
+} // namespace RESX
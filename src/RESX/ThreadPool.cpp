@@ -0,0 +1,146 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/ThreadPool.hpp"
+
+namespace RESX
+{
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+    : mQueuedTasks(0),
+    mUnfinishedTasks(0),
+    mStopping(false)
+{
+    if(threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    if(threadCount == 0) // hardware_concurrency() may not know
+        threadCount = 1;
+
+    for(unsigned int i = 0; i < threadCount; i++)
+        mWorkers.push_back(std::unique_ptr<Worker>(new Worker));
+
+    for(unsigned int i = 0; i < threadCount; i++)
+        mThreads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mStateMutex);
+        mStopping = true;
+    }
+
+    mWorkAvailable.notify_all();
+    for(std::thread& thread : mThreads)
+        thread.join();
+}
+
+std::size_t ThreadPool::threadCount() const
+{
+    return mThreads.size();
+}
+
+void ThreadPool::submit(std::size_t workerIndex, std::function<void()> task)
+{
+    Worker& worker = *mWorkers[workerIndex % mWorkers.size()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mStateMutex);
+        mQueuedTasks++;
+        mUnfinishedTasks++;
+    }
+
+    mWorkAvailable.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mStateMutex);
+    mAllDone.wait(lock, [this] { return mUnfinishedTasks == 0; });
+}
+
+// Own queue first (front), then steal from the others (back).
+bool ThreadPool::popTask(std::size_t workerIndex, std::function<void()>& task)
+{
+    for(std::size_t i = 0; i < mWorkers.size(); i++)
+    {
+        bool stealing = i != 0;
+        Worker& worker = *mWorkers[(workerIndex + i) % mWorkers.size()];
+
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if(worker.tasks.empty())
+            continue;
+
+        if(stealing)
+        {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+        } else
+        {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void ThreadPool::workerLoop(std::size_t workerIndex)
+{
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mStateMutex);
+            mWorkAvailable.wait(lock, [this] { return mQueuedTasks != 0 || mStopping; });
+
+            if(mQueuedTasks == 0) // Stopping, and nothing left to do
+                return;
+
+            // Claim a task before looking for it, so that two threads never
+            // go after the last one.
+            mQueuedTasks--;
+        }
+
+        std::function<void()> task;
+        // Tasks are queued before they are counted, so there is one for us,
+        // but popTask() locks one queue at a time and can miss it while
+        // other threads are popping: retry until we get it.
+        while(!popTask(workerIndex, task))
+            std::this_thread::yield();
+
+        task();
+        // What it captured goes before wait() can return.
+        task = nullptr;
+
+        bool allDone;
+        {
+            std::lock_guard<std::mutex> lock(mStateMutex);
+            allDone = --mUnfinishedTasks == 0;
+        }
+
+        if(allDone)
+            mAllDone.notify_all();
+    }
+}
+
+} // namespace RESX
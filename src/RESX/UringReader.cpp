@@ -0,0 +1,493 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/UringReader.hpp"
+
+#include <iostream>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h> // For iovec
+#include <cerrno>
+#include <cstdlib> // For posix_memalign() and free()
+#include <cstring> // For std::memcpy and std::memset
+#include <deque>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+#endif
+
+namespace RESX
+{
+
+#ifdef __linux__
+namespace
+{
+    // Size of each registered buffer, the most a single read asks for.
+    const std::size_t ringBufferSize = 128 * 1024;
+    // O_DIRECT offsets, sizes and buffers must be multiples of the logical
+    // block size of the device, which is at most this.
+    const std::size_t directAlignment = 4096;
+
+    // No wrappers in glibc: io_uring is used through raw system calls.
+    int ioUringSetup(unsigned int entries, struct io_uring_params* params)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int ioUringEnter(int ringFileDescriptor, unsigned int toSubmit, unsigned int minComplete, unsigned int flags)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_enter, ringFileDescriptor, toSubmit, minComplete, flags,
+                                        nullptr, 0));
+    }
+
+    int ioUringRegister(int ringFileDescriptor, unsigned int opcode, const void* argument, unsigned int count)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_register, ringFileDescriptor, opcode, argument, count));
+    }
+
+    // False on kernels before 5.6, which cannot probe, and lack
+    // IORING_OP_READ too.
+    bool isOpcodeSupported(int ringFileDescriptor, uint8_t opcode)
+    {
+        const unsigned int opCount = 256;
+        // Zeroed, as the kernel wants it.
+        std::vector<char> storage(sizeof(struct io_uring_probe) + opCount * sizeof(struct io_uring_probe_op));
+        struct io_uring_probe* probe = reinterpret_cast<struct io_uring_probe*>(storage.data());
+        if(ioUringRegister(ringFileDescriptor, IORING_REGISTER_PROBE, probe, opCount) != 0)
+            return false;
+
+        return opcode <= probe->last_op && opcode < probe->ops_len &&
+            (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+    }
+
+    // Part of a request, small enough for one buffer.
+    struct Piece
+    {
+        std::size_t request;
+        std::size_t requestOffset; // Where the piece starts in the request
+        std::size_t size;
+    };
+}
+
+struct UringReader::Ring
+{
+    int fileDescriptor;
+    int ringFileDescriptor;
+    bool directIO;
+    bool fixedBuffers; // Registered with the kernel
+    bool broken; // Reads may still be in flight, batches go around it
+
+    void* submissionRing;
+    std::size_t submissionRingSize;
+    void* completionRing; // Same as submissionRing with IORING_FEAT_SINGLE_MMAP
+    std::size_t completionRingSize;
+    struct io_uring_sqe* submissionEntries;
+    std::size_t submissionEntriesSize;
+
+    unsigned int* submissionHead;
+    unsigned int* submissionTail;
+    unsigned int submissionMask;
+    unsigned int* submissionArray;
+    unsigned int* completionHead;
+    unsigned int* completionTail;
+    unsigned int completionMask;
+    struct io_uring_cqe* completionEntries;
+
+    std::vector<char*> buffers; // One per entry
+
+    Ring()
+        : fileDescriptor(-1),
+        ringFileDescriptor(-1),
+        directIO(false),
+        fixedBuffers(false),
+        broken(false),
+        submissionRing(MAP_FAILED),
+        submissionRingSize(0),
+        completionRing(MAP_FAILED),
+        completionRingSize(0),
+        submissionEntries(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+        submissionEntriesSize(0)
+    {
+
+    }
+};
+#else
+struct UringReader::Ring
+{
+
+};
+#endif
+
+UringReader::UringReader(const std::string& fileName, bool directIO, unsigned int queueDepth)
+    : mPositional(fileName)
+{
+    if(mPositional.isOpen() && !setUpRing(fileName, directIO, queueDepth))
+        tearDownRing();
+}
+
+UringReader::~UringReader()
+{
+    tearDownRing();
+}
+
+// Static
+UringReader::readerPointer UringReader::open(const std::string& fileName, bool directIO, unsigned int queueDepth)
+{
+    std::shared_ptr<UringReader> reader(new UringReader(fileName, directIO, queueDepth));
+    if(reader->isOpen())
+        return reader;
+
+    return readerPointer(new PositionalReader(fileName));
+}
+
+// Returns false if any step fails, leaving the rest for tearDownRing().
+bool UringReader::setUpRing(const std::string& fileName, bool directIO, unsigned int queueDepth)
+{
+#ifdef __linux__
+    mRing.reset(new Ring);
+    Ring& ring = *mRing;
+
+    if(directIO)
+    {
+        ring.fileDescriptor = ::open(fileName.c_str(), O_RDONLY | O_DIRECT);
+        if(ring.fileDescriptor >= 0)
+            ring.directIO = true;
+        else
+            std::cerr << "Cannot open '" << fileName << "' for direct I/O, going through the page cache!" <<
+                std::endl;
+    }
+
+    if(ring.fileDescriptor < 0)
+        ring.fileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+
+    if(ring.fileDescriptor < 0)
+        return false;
+
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring.ringFileDescriptor = ioUringSetup(queueDepth == 0 ? 1 : queueDepth, &params);
+    if(ring.ringFileDescriptor < 0)
+        return false; // ENOSYS, EPERM (disabled or filtered)...
+
+    ring.submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring.completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(singleMap)
+    {
+        if(ring.completionRingSize > ring.submissionRingSize)
+            ring.submissionRingSize = ring.completionRingSize;
+        ring.completionRingSize = 0; // Not mapped separately
+    }
+
+    ring.submissionRing = mmap(nullptr, ring.submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                               ring.ringFileDescriptor, IORING_OFF_SQ_RING);
+    if(ring.submissionRing == MAP_FAILED)
+        return false;
+
+    ring.completionRing = singleMap ? ring.submissionRing :
+        mmap(nullptr, ring.completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+             ring.ringFileDescriptor, IORING_OFF_CQ_RING);
+    if(ring.completionRing == MAP_FAILED)
+        return false;
+
+    ring.submissionEntriesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring.submissionEntries = static_cast<struct io_uring_sqe*>(
+        mmap(nullptr, ring.submissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+             ring.ringFileDescriptor, IORING_OFF_SQES));
+    if(ring.submissionEntries == MAP_FAILED)
+        return false;
+
+    char* submission = static_cast<char*>(ring.submissionRing);
+    ring.submissionHead = reinterpret_cast<unsigned int*>(submission + params.sq_off.head);
+    ring.submissionTail = reinterpret_cast<unsigned int*>(submission + params.sq_off.tail);
+    ring.submissionMask = *reinterpret_cast<unsigned int*>(submission + params.sq_off.ring_mask);
+    ring.submissionArray = reinterpret_cast<unsigned int*>(submission + params.sq_off.array);
+
+    char* completion = static_cast<char*>(ring.completionRing);
+    ring.completionHead = reinterpret_cast<unsigned int*>(completion + params.cq_off.head);
+    ring.completionTail = reinterpret_cast<unsigned int*>(completion + params.cq_off.tail);
+    ring.completionMask = *reinterpret_cast<unsigned int*>(completion + params.cq_off.ring_mask);
+    ring.completionEntries = reinterpret_cast<struct io_uring_cqe*>(completion + params.cq_off.cqes);
+
+    // Aligned for O_DIRECT, registered so the kernel does not map them for every read.
+    std::vector<struct iovec> vectors;
+    for(unsigned int i = 0; i < params.sq_entries; i++)
+    {
+        void* buffer = nullptr;
+        if(posix_memalign(&buffer, directAlignment, ringBufferSize) != 0)
+            return false;
+
+        ring.buffers.push_back(static_cast<char*>(buffer));
+        struct iovec vector = {buffer, ringBufferSize};
+        vectors.push_back(vector);
+    }
+
+    // Fails if over RLIMIT_MEMLOCK on older kernels: plain reads into the same buffers then.
+    ring.fixedBuffers = ioUringRegister(ring.ringFileDescriptor, IORING_REGISTER_BUFFERS, vectors.data(),
+                                        static_cast<unsigned int>(vectors.size())) == 0;
+
+    // Kernels 5.1 to 5.5 only have fixed reads: every plain read would fail.
+    if(!ring.fixedBuffers && !isOpcodeSupported(ring.ringFileDescriptor, IORING_OP_READ))
+        return false;
+
+    return true;
+#else
+    (void)fileName; (void)directIO; (void)queueDepth;
+    return false;
+#endif
+}
+
+void UringReader::tearDownRing()
+{
+#ifdef __linux__
+    if(mRing == nullptr)
+        return;
+
+    Ring& ring = *mRing;
+    for(char* buffer : ring.buffers)
+        free(buffer);
+
+    if(ring.submissionEntries != MAP_FAILED)
+        munmap(ring.submissionEntries, ring.submissionEntriesSize);
+    if(ring.completionRing != MAP_FAILED && ring.completionRing != ring.submissionRing)
+        munmap(ring.completionRing, ring.completionRingSize);
+    if(ring.submissionRing != MAP_FAILED)
+        munmap(ring.submissionRing, ring.submissionRingSize);
+
+    // Closing the ring also unregisters the buffers.
+    if(ring.ringFileDescriptor >= 0)
+        close(ring.ringFileDescriptor);
+    if(ring.fileDescriptor >= 0)
+        close(ring.fileDescriptor);
+#endif
+
+    mRing.reset();
+}
+
+bool UringReader::isOpen() const
+{
+    return mPositional.isOpen() && mRing != nullptr;
+}
+
+Defs::addr UringReader::size() const
+{
+    return mPositional.size();
+}
+
+int64_t UringReader::modificationTime() const
+{
+    return mPositional.modificationTime();
+}
+
+std::size_t UringReader::readAt(Defs::addr offset, char* destination, std::size_t size) const
+{
+    return mPositional.readAt(offset, destination, size);
+}
+
+bool UringReader::prefersBatches() const
+{
+    return mRing != nullptr;
+}
+
+std::size_t UringReader::copyToFile(Defs::addr offset, std::size_t size, int outputFileDescriptor) const
+{
+    return mPositional.copyToFile(offset, size, outputFileDescriptor);
+}
+
+// Keeps every buffer busy: as soon as a read completes, its piece is
+// copied out and the buffer goes to the next piece.
+void UringReader::readBatch(ReadRequest* requests, std::size_t count) const
+{
+#ifdef __linux__
+    if(mRing == nullptr)
+    {
+        Reader::readBatch(requests, count);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mRingMutex);
+    Ring& ring = *mRing;
+    if(ring.broken)
+    {
+        lock.unlock();
+        Reader::readBatch(requests, count);
+        return;
+    }
+
+    // Room for the widening to aligned blocks.
+    std::size_t maxPieceSize = ring.directIO ? ringBufferSize - 2 * directAlignment : ringBufferSize;
+    std::deque<Piece> pending;
+    for(std::size_t i = 0; i < count; i++)
+    {
+        ReadRequest& request = requests[i];
+        request.bytesRead = 0;
+        if(request.offset >= size())
+            continue;
+
+        std::size_t requestSize = request.size;
+        if(requestSize > size() - request.offset)
+            requestSize = size() - request.offset;
+
+        for(std::size_t offset = 0; offset < requestSize; offset += maxPieceSize)
+        {
+            Piece piece = {i, offset, std::min(maxPieceSize, requestSize - offset)};
+            pending.push_back(piece);
+        }
+    }
+
+    std::vector<Piece> inFlight(ring.buffers.size());
+    std::vector<Defs::addr> readStarts(ring.buffers.size()); // Aligned down with directIO
+    std::vector<unsigned int> freeBuffers;
+    for(unsigned int i = 0; i < ring.buffers.size(); i++)
+        freeBuffers.push_back(i);
+
+    std::size_t inFlightCount = 0;
+    while(!pending.empty() || inFlightCount > 0)
+    {
+        unsigned int toSubmit = 0;
+        unsigned int tail = *ring.submissionTail;
+        while(!pending.empty() && !freeBuffers.empty())
+        {
+            unsigned int buffer = freeBuffers.back();
+            freeBuffers.pop_back();
+            Piece piece = pending.front();
+            pending.pop_front();
+
+            Defs::addr start = requests[piece.request].offset + piece.requestOffset;
+            Defs::addr end = start + piece.size;
+            if(ring.directIO)
+            {
+                start -= start % directAlignment;
+                end = (end + directAlignment - 1) / directAlignment * directAlignment;
+            }
+
+            unsigned int index = tail & ring.submissionMask;
+            struct io_uring_sqe* entry = &ring.submissionEntries[index];
+            std::memset(entry, 0, sizeof(*entry));
+            entry->opcode = ring.fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            entry->fd = ring.fileDescriptor;
+            entry->off = start;
+            entry->addr = reinterpret_cast<uint64_t>(ring.buffers[buffer]);
+            entry->len = static_cast<uint32_t>(end - start);
+            entry->buf_index = static_cast<uint16_t>(buffer);
+            entry->user_data = buffer;
+            ring.submissionArray[index] = index;
+
+            inFlight[buffer] = piece;
+            readStarts[buffer] = start;
+            tail++;
+            toSubmit++;
+        }
+
+        // The kernel must see the entries before the new tail.
+        __atomic_store_n(ring.submissionTail, tail, __ATOMIC_RELEASE);
+        inFlightCount += toSubmit;
+
+        // Including any an interrupted call did not get to.
+        unsigned int unsubmitted = tail - __atomic_load_n(ring.submissionHead, __ATOMIC_ACQUIRE);
+        int entered = ioUringEnter(ring.ringFileDescriptor, unsubmitted, 1, IORING_ENTER_GETEVENTS);
+        if(entered < 0 && errno != EINTR)
+        {
+            std::cerr << "io_uring_enter() failed, reading the batch without io_uring!" << std::endl;
+
+            // Nothing of this batch may complete into the next one: take
+            // back what the kernel did not get to, and wait for the rest.
+            unsigned int submissionHead = __atomic_load_n(ring.submissionHead, __ATOMIC_ACQUIRE);
+            inFlightCount -= tail - submissionHead;
+            __atomic_store_n(ring.submissionTail, submissionHead, __ATOMIC_RELEASE);
+            while(inFlightCount > 0)
+            {
+                unsigned int head = *ring.completionHead;
+                for(; head != __atomic_load_n(ring.completionTail, __ATOMIC_ACQUIRE); head++)
+                    inFlightCount--;
+
+                __atomic_store_n(ring.completionHead, head, __ATOMIC_RELEASE);
+                if(inFlightCount > 0 && ioUringEnter(ring.ringFileDescriptor, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+                   errno != EINTR)
+                {
+                    // Reads may still land in the buffers: never free
+                    // them, never use the ring again.
+                    ring.buffers.clear();
+                    ring.broken = true;
+                    break;
+                }
+            }
+
+            lock.unlock();
+            Reader::readBatch(requests, count);
+            return;
+        }
+
+        unsigned int head = *ring.completionHead;
+        while(head != __atomic_load_n(ring.completionTail, __ATOMIC_ACQUIRE))
+        {
+            struct io_uring_cqe* completion = &ring.completionEntries[head & ring.completionMask];
+            unsigned int buffer = static_cast<unsigned int>(completion->user_data);
+            int result = completion->res;
+            head++;
+
+            Piece piece = inFlight[buffer];
+            freeBuffers.push_back(buffer);
+            inFlightCount--;
+
+            ReadRequest& request = requests[piece.request];
+            Defs::addr pieceStart = request.offset + piece.requestOffset;
+            if(result < 0)
+            {
+                // Some files refuse O_DIRECT reads (-EINVAL), for instance:
+                // the piece is read again without the ring.
+                request.bytesRead += mPositional.readAt(pieceStart, request.destination + piece.requestOffset,
+                                                        piece.size);
+                continue;
+            }
+
+            // What the read covered of the piece.
+            std::size_t skipped = pieceStart - readStarts[buffer];
+            std::size_t useful = static_cast<std::size_t>(result) > skipped ? result - skipped : 0;
+            if(useful > piece.size)
+                useful = piece.size;
+
+            std::memcpy(request.destination + piece.requestOffset, ring.buffers[buffer] + skipped, useful);
+            request.bytesRead += useful;
+
+            // Short read before the end of the file: read the rest again,
+            // without the ring if the ring got none of it.
+            if(useful < piece.size && pieceStart + useful < size())
+            {
+                if(useful > 0)
+                {
+                    Piece rest = {piece.request, piece.requestOffset + useful, piece.size - useful};
+                    pending.push_back(rest);
+                } else
+                {
+                    request.bytesRead += mPositional.readAt(pieceStart, request.destination + piece.requestOffset,
+                                                            piece.size);
+                }
+            }
+        }
+
+        __atomic_store_n(ring.completionHead, head, __ATOMIC_RELEASE);
+    }
+#else
+    Reader::readBatch(requests, count);
+#endif
+}
+
+} // namespace RESX
@@ -0,0 +1,442 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RESX/Volume.hpp"
+
+#include <algorithm> // For sort()
+#include <iostream>
+
+namespace RESX
+{
+
+namespace
+{
+    // Volume header, 1024 bytes into the volume.
+    const Defs::addr volumeHeaderAddr = 1024;
+    const std::size_t volumeHeaderLength = 512;
+
+    const uint16_t HFSPlusSignature = 0x482B; // 'H+'
+    const uint16_t HFSXSignature = 0x4858; // 'HX'
+
+    // Catalog node IDs of the special files.
+    const uint32_t extentsFileID = 3;
+    const uint32_t catalogFileID = 4;
+    const uint32_t rootFolderID = 2;
+
+    const uint8_t dataForkType = 0x00;
+    const uint8_t resourceForkType = 0xFF;
+
+    const int8_t leafNodeKind = -1;
+
+    // Catalog record types.
+    const uint16_t folderRecordType = 1;
+    const uint16_t fileRecordType = 2;
+
+    // How much of a B-tree file is read at once when walking it.
+    const std::size_t batchBytes = 1UL << 20; // 1 MiB
+
+    // HFS+ names are UTF-16 (big-endian).
+    std::string UTF16ToUTF8(const char* data, std::size_t characterCount)
+    {
+        std::string text;
+        for(std::size_t i = 0; i < characterCount; i++)
+        {
+            uint32_t codePoint = static_cast<uint32_t>(Defs::loadBigEndian16(data + i * 2));
+
+            // Surrogate pair
+            if(codePoint >= 0xD800 && codePoint < 0xDC00 && i + 1 < characterCount)
+            {
+                uint32_t low = static_cast<uint32_t>(Defs::loadBigEndian16(data + (i + 1) * 2));
+                if(low >= 0xDC00 && low < 0xE000)
+                {
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                    i++;
+                }
+            }
+
+            if(codePoint < 0x80)
+            {
+                text += static_cast<char>(codePoint);
+            } else if(codePoint < 0x800)
+            {
+                text += static_cast<char>(0xC0 | (codePoint >> 6));
+                text += static_cast<char>(0x80 | (codePoint & 0x3F));
+            } else if(codePoint < 0x10000)
+            {
+                text += static_cast<char>(0xE0 | (codePoint >> 12));
+                text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                text += static_cast<char>(0x80 | (codePoint & 0x3F));
+            } else
+            {
+                text += static_cast<char>(0xF0 | (codePoint >> 18));
+                text += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+                text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                text += static_cast<char>(0x80 | (codePoint & 0x3F));
+            }
+        }
+
+        return text;
+    }
+
+    uint32_t countBlocks(const std::vector<Extent>& extents)
+    {
+        uint32_t blockCount = 0;
+        for(const Extent& extent : extents)
+            blockCount += extent.blockCount;
+
+        return blockCount;
+    }
+}
+
+// The block size is read from the volume header.
+Volume::Volume(const std::string& fileName, bool memoryMap)
+    : mFile(fileName, 0, memoryMap),
+    mValid(false),
+    mBlockSize(0),
+    mCatalogSize(0),
+    mExtentsOverflowSize(0)
+{
+    if(!mFile.getReader()->isOpen())
+        return;
+
+    if(!parseVolumeHeader())
+        return;
+
+    mFile.setBlockSize(mBlockSize);
+    loadOverflowExtents();
+
+    // The catalog itself can be fragmented past its 8 extents.
+    appendOverflowExtents(dataForkType, catalogFileID,
+                          static_cast<uint32_t>((mCatalogSize + mBlockSize - 1) / mBlockSize),
+                          mCatalogExtents);
+
+    mValid = true;
+}
+
+Volume::~Volume()
+{
+
+}
+
+bool Volume::isValid() const
+{
+    return mValid;
+}
+
+unsigned int Volume::getBlockSize() const
+{
+    return mBlockSize;
+}
+
+bool Volume::parseVolumeHeader()
+{
+    char header[volumeHeaderLength];
+    if(mFile.getReader()->readAt(volumeHeaderAddr, header, volumeHeaderLength) != volumeHeaderLength)
+    {
+        std::cerr << "File is too small to be an HFS+ volume!" << std::endl;
+        return false;
+    }
+
+    uint16_t signature = static_cast<uint16_t>(Defs::loadBigEndian16(header));
+    if(signature != HFSPlusSignature && signature != HFSXSignature)
+    {
+        std::cerr << "Not an HFS+ volume (bad volume header signature)!" << std::endl;
+        return false;
+    }
+
+    mBlockSize = static_cast<uint32_t>(Defs::loadBigEndian32(header + 40));
+    if(mBlockSize < 512 || (mBlockSize & (mBlockSize - 1)) != 0)
+    {
+        std::cerr << "Invalid HFS+ block size " << mBlockSize << "!" << std::endl;
+        return false;
+    }
+
+    // Fork data records of the special files.
+    mExtentsOverflowExtents = ExtentReader::parseForkData(header + 192, &mExtentsOverflowSize);
+    mCatalogExtents = ExtentReader::parseForkData(header + 272, &mCatalogSize);
+
+    return true;
+}
+
+// Reads the header node: node size, node count and which nodes are in use.
+bool Volume::openBTree(const std::vector<Extent>& extents, Defs::addr size, BTree& tree)
+{
+    tree.reader = std::make_shared<ExtentReader>(mFile.getReader(), extents, mBlockSize, size);
+
+    // Nodes are at least 512 bytes, enough for the header record.
+    char firstBytes[512];
+    if(tree.reader->readAt(0, firstBytes, sizeof(firstBytes)) != sizeof(firstBytes))
+        return false;
+
+    // Header record right after the 14-byte node descriptor.
+    tree.nodeSize = static_cast<uint32_t>(Defs::loadBigEndian16(firstBytes + 14 + 18));
+    tree.totalNodes = static_cast<uint32_t>(Defs::loadBigEndian32(firstBytes + 14 + 22));
+    if(tree.nodeSize < 512 || (tree.nodeSize & (tree.nodeSize - 1)) != 0)
+    {
+        std::cerr << "Invalid B-tree node size " << tree.nodeSize << "!" << std::endl;
+        return false;
+    }
+
+    // The map record (third record of the header node), then map nodes
+    // chained by their forward link, hold the node allocation bitmap.
+    std::vector<char> node(tree.nodeSize);
+    uint32_t nodeNumber = 0;
+    int mapRecord = 2;
+    std::size_t visitedNodes = 0;
+    do
+    {
+        if(tree.reader->readAt(static_cast<Defs::addr>(nodeNumber) * tree.nodeSize, node.data(),
+                               tree.nodeSize) != tree.nodeSize)
+            return false;
+
+        std::size_t recordStart = Defs::loadBigEndian16(node.data() + tree.nodeSize - 2 * (mapRecord + 1));
+        std::size_t recordEnd = Defs::loadBigEndian16(node.data() + tree.nodeSize - 2 * (mapRecord + 2));
+        if(recordStart < recordEnd && recordEnd <= tree.nodeSize)
+            tree.nodeBitmap.insert(tree.nodeBitmap.end(), node.data() + recordStart, node.data() + recordEnd);
+
+        // Map nodes only have one record.
+        nodeNumber = static_cast<uint32_t>(Defs::loadBigEndian32(node.data()));
+        mapRecord = 0;
+    } while(nodeNumber != 0 && nodeNumber < tree.totalNodes && ++visitedNodes < tree.totalNodes);
+
+    return true;
+}
+
+// Walks all used leaf nodes in physical order, reading them in large batches,
+// instead of following the leaf chain node by node.
+void Volume::forEachLeafRecord(const BTree& tree,
+                               const std::function<void(const char* record, std::size_t length)>& callback)
+{
+    std::size_t nodesPerBatch = batchBytes / tree.nodeSize;
+    if(nodesPerBatch == 0)
+        nodesPerBatch = 1;
+
+    std::vector<char> batch;
+    for(uint32_t firstNode = 0; firstNode < tree.totalNodes; firstNode += nodesPerBatch)
+    {
+        std::size_t nodeCount = tree.totalNodes - firstNode;
+        if(nodeCount > nodesPerBatch)
+            nodeCount = nodesPerBatch;
+
+        Defs::addr batchAddr = static_cast<Defs::addr>(firstNode) * tree.nodeSize;
+        std::size_t batchLength = nodeCount * tree.nodeSize;
+
+        // Straight from the mapping if we can.
+        const char* nodes = nullptr;
+        if(tree.reader->data() != nullptr && batchAddr + batchLength <= tree.reader->size())
+        {
+            nodes = tree.reader->data() + batchAddr;
+        } else
+        {
+            batch.resize(batchLength);
+            std::size_t bytesRead = tree.reader->readAt(batchAddr, batch.data(), batchLength);
+            nodeCount = bytesRead / tree.nodeSize;
+            nodes = batch.data();
+        }
+
+        for(std::size_t i = 0; i < nodeCount; i++)
+        {
+            uint32_t nodeNumber = firstNode + static_cast<uint32_t>(i);
+            std::size_t bitmapByte = nodeNumber / 8;
+            if(bitmapByte >= tree.nodeBitmap.size() ||
+               !(tree.nodeBitmap[bitmapByte] & (0x80 >> (nodeNumber % 8))))
+            {
+                continue; // Free node, may hold stale records
+            }
+
+            const char* node = nodes + i * tree.nodeSize;
+            if(static_cast<int8_t>(node[8]) != leafNodeKind)
+                continue;
+
+            // Record offsets are stored backwards from the end of the node,
+            // followed by the offset of the free space.
+            std::size_t recordCount = Defs::loadBigEndian16(node + 10);
+            if(14 + 2 * (recordCount + 1) > tree.nodeSize)
+                continue;
+
+            for(std::size_t j = 0; j < recordCount; j++)
+            {
+                std::size_t recordStart = Defs::loadBigEndian16(node + tree.nodeSize - 2 * (j + 1));
+                std::size_t recordEnd = Defs::loadBigEndian16(node + tree.nodeSize - 2 * (j + 2));
+                if(recordStart < 14 || recordStart >= recordEnd || recordEnd > tree.nodeSize)
+                    continue;
+
+                callback(node + recordStart, recordEnd - recordStart);
+            }
+        }
+
+        if(nodeCount < nodesPerBatch && firstNode + nodeCount < tree.totalNodes)
+            break; // Short read, B-tree file is truncated
+    }
+}
+
+// Collects every record of the extents overflow file.
+void Volume::loadOverflowExtents()
+{
+    mOverflowExtents.clear();
+    if(mExtentsOverflowExtents.empty())
+        return;
+
+    BTree tree;
+    if(!openBTree(mExtentsOverflowExtents, mExtentsOverflowSize, tree))
+    {
+        std::cerr << "Could not read the extents overflow file!" << std::endl;
+        return;
+    }
+
+    forEachLeafRecord(tree, [this](const char* record, std::size_t length)
+    {
+        // Key: keyLength (2), forkType (1), pad (1), fileID (4), startBlock (4).
+        // Data: 8 extent descriptors.
+        if(length < 12 + 64)
+            return;
+
+        uint8_t forkType = static_cast<uint8_t>(record[2]);
+        uint32_t fileID = static_cast<uint32_t>(Defs::loadBigEndian32(record + 4));
+        uint32_t startBlock = static_cast<uint32_t>(Defs::loadBigEndian32(record + 8));
+
+        std::vector<Extent> extents;
+        for(int i = 0; i < 8; i++)
+        {
+            Extent extent;
+            extent.startBlock = static_cast<uint32_t>(Defs::loadBigEndian32(record + 12 + i * 8));
+            extent.blockCount = static_cast<uint32_t>(Defs::loadBigEndian32(record + 12 + i * 8 + 4));
+            if(extent.blockCount == 0)
+                break;
+
+            extents.push_back(extent);
+        }
+
+        uint64_t key = (static_cast<uint64_t>(forkType) << 32) | fileID;
+        mOverflowExtents[key].push_back(OverflowRecord(startBlock, extents));
+    });
+
+    // Overflow records of a fork, in fork order.
+    for(auto& forkRecords : mOverflowExtents)
+    {
+        std::sort(forkRecords.second.begin(), forkRecords.second.end(),
+            [](const OverflowRecord& a, const OverflowRecord& b) { return a.first < b.first; });
+    }
+}
+
+// Appends overflow extents of a fork until it covers totalBlocks.
+void Volume::appendOverflowExtents(uint8_t forkType, uint32_t fileID, uint32_t totalBlocks,
+                                   std::vector<Extent>& extents) const
+{
+    if(countBlocks(extents) >= totalBlocks)
+        return;
+
+    uint64_t key = (static_cast<uint64_t>(forkType) << 32) | fileID;
+    std::map<uint64_t, std::vector<OverflowRecord>>::const_iterator forkRecords = mOverflowExtents.find(key);
+    if(forkRecords == mOverflowExtents.end())
+    {
+        std::cerr << "Missing overflow extents for file " << fileID << "!" << std::endl;
+        return;
+    }
+
+    for(const OverflowRecord& record : forkRecords->second)
+        extents.insert(extents.end(), record.second.begin(), record.second.end());
+}
+
+std::vector<VolumeFile> Volume::findResourceForks()
+{
+    std::vector<VolumeFile> files;
+    if(!mValid)
+        return files;
+
+    BTree tree;
+    if(!openBTree(mCatalogExtents, mCatalogSize, tree))
+    {
+        std::cerr << "Could not read the catalog file!" << std::endl;
+        return files;
+    }
+
+    // First: parent ID, second: name. For building paths.
+    std::map<uint32_t, std::pair<uint32_t, std::string>> folders;
+
+    forEachLeafRecord(tree, [&](const char* record, std::size_t length)
+    {
+        // Key: keyLength (2), parentID (4), name length (2), name (UTF-16).
+        if(length < 8)
+            return;
+
+        std::size_t keyLength = Defs::loadBigEndian16(record);
+        uint32_t parentID = static_cast<uint32_t>(Defs::loadBigEndian32(record + 2));
+        std::size_t nameLength = Defs::loadBigEndian16(record + 6);
+        if(8 + nameLength * 2 > length || 2 + keyLength + 2 > length)
+            return;
+
+        const char* data = record + 2 + keyLength;
+        std::size_t dataLength = length - 2 - keyLength;
+        uint16_t recordType = static_cast<uint16_t>(Defs::loadBigEndian16(data));
+
+        // Folder record: folderID at 8.
+        if(recordType == folderRecordType && dataLength >= 12)
+        {
+            uint32_t folderID = static_cast<uint32_t>(Defs::loadBigEndian32(data + 8));
+            folders[folderID] = std::make_pair(parentID, UTF16ToUTF8(record + 8, nameLength));
+        }
+
+        // File record: fileID at 8, data fork at 88, resource fork at 168.
+        if(recordType == fileRecordType && dataLength >= 168 + 80)
+        {
+            VolumeFile file;
+            file.fileID = static_cast<uint32_t>(Defs::loadBigEndian32(data + 8));
+            file.parentID = parentID;
+            file.resourceForkExtents = ExtentReader::parseForkData(data + 168, &file.resourceForkSize);
+            if(file.resourceForkSize == 0)
+                return;
+
+            uint32_t totalBlocks = static_cast<uint32_t>(Defs::loadBigEndian32(data + 168 + 12));
+            appendOverflowExtents(resourceForkType, file.fileID, totalBlocks, file.resourceForkExtents);
+
+            // Temporarily just the name, folders come later.
+            file.path = UTF16ToUTF8(record + 8, nameLength);
+            files.push_back(file);
+        }
+    });
+
+    // Prepend folder names up to the root folder.
+    for(VolumeFile& file : files)
+    {
+        std::string path = "/" + file.path;
+        uint32_t folderID = file.parentID;
+
+        // Bounded, in case the catalog has a loop.
+        for(std::size_t depth = 0; folderID != rootFolderID && depth < folders.size(); depth++)
+        {
+            std::map<uint32_t, std::pair<uint32_t, std::string>>::const_iterator folder =
+                folders.find(folderID);
+            if(folder == folders.end())
+                break;
+
+            path = "/" + folder->second.second + path;
+            folderID = folder->second.first;
+        }
+
+        file.path = path;
+    }
+
+    return files;
+}
+
+ResourceFork Volume::loadResourceFork(const VolumeFile& volumeFile)
+{
+    return mFile.loadResourceFork(volumeFile.resourceForkExtents, volumeFile.resourceForkSize);
+}
+
+} // namespace RESX
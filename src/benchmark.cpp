@@ -0,0 +1,498 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+// Generates a synthetic resource fork (or takes an existing one) and times
+// the main operations of the library on it. Results go out as JSON, so
+// that runs can be compared from one build to the next.
+
+#include "ResExtractor.hpp"
+
+#include <algorithm> // For find(), sort() and min()
+#include <chrono>
+#include <cmath> // For std::pow()
+#include <cstddef> // For size_t
+#include <cstdint>
+#include <cstdio> // For std::remove()
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using Big = long long int;
+using benchmarkClock = std::chrono::steady_clock;
+
+// What the generated fork looks like.
+struct ForkShape
+{
+    unsigned int typeCount;
+    unsigned int resourcesPerType;
+    unsigned int minNameLength; // 0: some resources are unnamed
+    unsigned int maxNameLength;
+    unsigned int minPayloadSize;
+    unsigned int maxPayloadSize;
+    bool logUniformPayloads; // Many small, few large, like real forks
+    unsigned int seed;
+};
+
+struct BenchmarkResult
+{
+    std::string name;
+    std::string unit;
+    double value;
+    Big operations;
+};
+
+void printHelp()
+{
+    std::cout <<
+        "Times the ResExtractor library on a synthetic resource fork (or on -input)." << std::endl <<
+        std::endl <<
+        "Usage: ResExtractorBenchmark [-types N] [-resourcesPerType N] [-nameLength MIN:MAX]" << std::endl <<
+        "   [-payloadSize MIN:MAX] [-distribution uniform|loguniform] [-seed N]" << std::endl <<
+        "   [-iterations N] [-fork FORK_FILE] [-keep] [-output RESULTS_FILE]" << std::endl <<
+        "       ResExtractorBenchmark -input INPUT_FILE [-iterations N] [-output RESULTS_FILE]" << std::endl <<
+        std::endl <<
+        " --help, --h                 display help" << std::endl <<
+        std::endl <<
+        " -distribution               payload sizes, loguniform (default) or uniform" << std::endl <<
+        " -fork                       where to write the generated fork, resx_benchmark.rsrc by default" << std::endl <<
+        " -input                      benchmark an existing resource fork file instead of generating one" << std::endl <<
+        " -iterations                 number of lookups to time, 100000 by default" << std::endl <<
+        " -keep                       keep the generated fork and its sidecar index" << std::endl <<
+        " -nameLength                 name lengths, 0:31 by default (0: some resources are unnamed)" << std::endl <<
+        " -output                     write JSON results to file, printed to cmdline if unspecified" << std::endl <<
+        " -payloadSize                payload sizes in bytes, 16:65536 by default" << std::endl <<
+        " -resourcesPerType           number of resources of each type, 128 by default" << std::endl <<
+        " -seed                       random seed, 1 by default" << std::endl <<
+        " -types                      number of resource types, 16 by default" << std::endl;
+}
+
+// Parses "MIN:MAX".
+bool parseRange(const std::string& text, unsigned int& minimum, unsigned int& maximum)
+{
+    std::size_t colon = text.find(':');
+    if(colon == std::string::npos)
+        return false;
+
+    try
+    {
+        minimum = std::stoul(text.substr(0, colon));
+        maximum = std::stoul(text.substr(colon + 1));
+    } catch(const std::exception&)
+    {
+        return false;
+    }
+
+    return minimum <= maximum;
+}
+
+// Four-char codes 'Raaa', 'Raab'...
+std::string typeName(unsigned int index)
+{
+    std::string type = "R";
+    for(int i = 2; i >= 0; i--)
+    {
+        unsigned int power = 1;
+        for(int j = 0; j < i; j++)
+            power *= 26;
+
+        type += static_cast<char>('a' + (index / power) % 26);
+    }
+
+    return type;
+}
+
+// Writes a resource fork of the given shape with random payloads and names.
+// Returns false (and cerrs) if the shape does not fit the format's limits.
+bool generateFork(const ForkShape& shape, const std::string& path)
+{
+    std::mt19937 random(shape.seed);
+
+    if(shape.typeCount == 0 || shape.typeCount > 26 * 26 * 26)
+    {
+        std::cerr << "Error: too many types for a resource map!" << std::endl;
+        return false;
+    }
+
+    std::size_t resourceCount = static_cast<std::size_t>(shape.typeCount) * shape.resourcesPerType;
+    std::uniform_int_distribution<unsigned int> nameLengths(shape.minNameLength, shape.maxNameLength);
+    std::uniform_int_distribution<int> letters('a', 'z');
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    RESX::ResourceForkWriter writer;
+
+    for(std::size_t i = 0; i < resourceCount; i++)
+    {
+        double fraction = unit(random);
+        double size = shape.logUniformPayloads ?
+            shape.minPayloadSize * std::pow(static_cast<double>(shape.maxPayloadSize) /
+                                            std::max(1U, shape.minPayloadSize), fraction) :
+            shape.minPayloadSize + fraction * (shape.maxPayloadSize - shape.minPayloadSize);
+        uint32_t payloadSize = std::min(static_cast<uint32_t>(size), shape.maxPayloadSize);
+
+        std::vector<char> payload(payloadSize);
+        for(char& byte : payload)
+            byte = static_cast<char>(random());
+
+        std::string name;
+        unsigned int nameLength = std::min(nameLengths(random), 255U);
+        for(unsigned int j = 0; j < nameLength; j++)
+            name += static_cast<char>(letters(random));
+
+        if(!writer.addResource(typeName(static_cast<unsigned int>(i / shape.resourcesPerType)),
+                               static_cast<int>(128 + i % shape.resourcesPerType), name, 0, payload.data(),
+                               payload.size()))
+        {
+            return false;
+        }
+    }
+
+    return writer.write(path);
+}
+
+double secondsSince(benchmarkClock::time_point start)
+{
+    return std::chrono::duration<double>(benchmarkClock::now() - start).count();
+}
+
+// Median of several timed opens, in milliseconds.
+double timeOpen(const std::string& path, const std::string& indexPath, int repetitions)
+{
+    std::vector<double> times;
+    for(int i = 0; i < repetitions; i++)
+    {
+        benchmarkClock::time_point start = benchmarkClock::now();
+        RESX::File file(path, 4096);
+        RESX::ResourceFork resourceFork = file.loadResourceFork(0, indexPath);
+        times.push_back(secondsSince(start) * 1000.0);
+    }
+
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+std::string escapeJSON(const std::string& text)
+{
+    std::string escaped;
+    for(char c : text)
+    {
+        if(c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+
+    return escaped;
+}
+
+int main(int argc, char **argv)
+{
+    // Terminal command, pointer to value to modify, textual type name.
+    using argDefinitionTuple = std::tuple<std::string, void*, std::string>;
+    using argDefinitionVector = std::vector<argDefinitionTuple>;
+
+    ForkShape shape = {16, 128, 0, 31, 16, 65536, true, 1};
+    std::string nameLengthText;
+    std::string payloadSizeText;
+    std::string distribution = "loguniform";
+    std::string inputFile;
+    std::string forkFile = "resx_benchmark.rsrc";
+    std::string outputFile;
+    Big iterations = 100000LL;
+    bool keep = false;
+
+    argDefinitionVector argDefinitions = {
+                    argDefinitionTuple("--help", nullptr, "printHelp()"),
+                    argDefinitionTuple("--h", nullptr, "printHelp()"),
+
+                    argDefinitionTuple("-distribution", &distribution, "std::string"),
+                    argDefinitionTuple("-fork", &forkFile, "std::string"),
+                    argDefinitionTuple("-input", &inputFile, "std::string"),
+                    argDefinitionTuple("-iterations", &iterations, "Big"),
+                    argDefinitionTuple("-keep", &keep, "bool"),
+                    argDefinitionTuple("-nameLength", &nameLengthText, "std::string"),
+                    argDefinitionTuple("-output", &outputFile, "std::string"),
+                    argDefinitionTuple("-payloadSize", &payloadSizeText, "std::string"),
+                    argDefinitionTuple("-resourcesPerType", &shape.resourcesPerType, "unsigned int"),
+                    argDefinitionTuple("-seed", &shape.seed, "unsigned int"),
+                    argDefinitionTuple("-types", &shape.typeCount, "unsigned int"),
+    };
+
+    std::vector<std::string> args(argv, argv+argc);
+    for(argDefinitionTuple argDefinition : argDefinitions)
+    {
+        std::string command = std::get<0>(argDefinition);
+        void* associatedVariable = std::get<1>(argDefinition);
+        std::string textualType = std::get<2>(argDefinition);
+
+        auto foundStringIt = std::find(args.begin(), args.end(), command);
+        if(foundStringIt == args.end())
+            continue;
+
+        if(textualType == "printHelp()")
+        {
+            printHelp();
+            return 0; // Quit
+        }
+
+        if(textualType == "bool")
+        {
+            *static_cast<bool*>(associatedVariable) = true;
+            continue;
+        }
+
+        if(foundStringIt + 1 == args.end())
+        {
+            std::cerr << "Missing value for '" + command + "'!" << std::endl;
+            return 1;
+        }
+
+        try
+        {
+            if(textualType == "std::string")
+                *static_cast<std::string*>(associatedVariable) = *(foundStringIt + 1);
+            else if(textualType == "unsigned int")
+                *static_cast<unsigned int*>(associatedVariable) = std::stoul(*(foundStringIt + 1));
+            else if(textualType == "Big")
+                *static_cast<Big*>(associatedVariable) = std::stoll(*(foundStringIt + 1));
+        } catch(const std::exception&)
+        {
+            std::cerr << "Invalid value for '" + command + "'!" << std::endl;
+            return 1;
+        }
+    }
+
+    if((!nameLengthText.empty() && !parseRange(nameLengthText, shape.minNameLength, shape.maxNameLength)) ||
+       (!payloadSizeText.empty() && !parseRange(payloadSizeText, shape.minPayloadSize, shape.maxPayloadSize)))
+    {
+        std::cerr << "Error: ranges are given as MIN:MAX!" << std::endl;
+        return 1;
+    }
+
+    if(iterations < 1)
+    {
+        std::cerr << "Error: -iterations must be positive!" << std::endl;
+        return 1;
+    }
+
+    if(distribution != "uniform" && distribution != "loguniform")
+    {
+        std::cerr << "Error: unknown distribution '" << distribution << "'!" << std::endl;
+        return 1;
+    }
+
+    shape.logUniformPayloads = distribution == "loguniform";
+    if(shape.maxNameLength > 255)
+        shape.maxNameLength = 255; // Pascal strings
+
+    std::string forkPath = inputFile.empty() ? forkFile : inputFile;
+    if(inputFile.empty() && !generateFork(shape, forkPath))
+        return 1;
+
+    std::string indexPath = forkPath + ".resxidx";
+    std::vector<BenchmarkResult> results;
+
+    // Opening: parsing the map, then again from a sidecar index.
+    std::remove(indexPath.c_str());
+    results.push_back({"open_parse", "ms", timeOpen(forkPath, std::string(), 21), 21});
+    timeOpen(forkPath, indexPath, 1); // Writes the sidecar
+    results.push_back({"open_sidecar", "ms", timeOpen(forkPath, indexPath, 21), 21});
+
+    RESX::File file(forkPath, 4096);
+    RESX::ResourceFork resourceFork = file.loadResourceFork(0);
+    std::vector<RESX::ResourceInfo> infos = resourceFork.getResourcesInfo();
+    if(infos.empty())
+    {
+        std::cerr << "Error: no resources in '" << forkPath << "'!" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> types;
+    for(const RESX::ResourceInfo& info : infos)
+    {
+        if(std::find(types.begin(), types.end(), info.type) == types.end())
+            types.push_back(info.type);
+    }
+
+    // Same random keys for every run with the same seed.
+    std::mt19937 random(shape.seed);
+    std::uniform_int_distribution<std::size_t> pick(0, infos.size() - 1);
+    std::vector<std::size_t> picks(static_cast<std::size_t>(iterations));
+    for(std::size_t& picked : picks)
+        picked = pick(random);
+
+    Big lookupErrors = 0;
+    RESX::ResourceInfo found;
+    benchmarkClock::time_point start = benchmarkClock::now();
+    for(std::size_t picked : picks)
+    {
+        const RESX::ResourceInfo& info = infos[picked];
+        if(!resourceFork.getResourceInfo(RESX::ResourceKey(info.type, info.ID), &found) ||
+           found.address != info.address)
+        {
+            lookupErrors++;
+        }
+    }
+    results.push_back({"lookup_id", "ns/op", secondsSince(start) * 1e9 / picks.size(), iterations});
+
+    std::vector<std::size_t> namedPicks;
+    for(std::size_t picked : picks)
+    {
+        if(!infos[picked].name.empty())
+            namedPicks.push_back(picked);
+    }
+
+    if(!namedPicks.empty())
+    {
+        start = benchmarkClock::now();
+        for(std::size_t picked : namedPicks)
+        {
+            const RESX::ResourceInfo& info = infos[picked];
+            if(!resourceFork.getResourceInfo(RESX::ResourceKey(info.type, info.name), &found))
+                lookupErrors++;
+        }
+        results.push_back({"lookup_name", "ns/op", secondsSince(start) * 1e9 / namedPicks.size(),
+                           static_cast<Big>(namedPicks.size())});
+    }
+
+    // Enumerating every type, enough times to take a measurable while.
+    std::size_t enumerationRounds = std::max<std::size_t>(1, picks.size() / infos.size());
+    std::size_t enumerated = 0;
+    start = benchmarkClock::now();
+    for(std::size_t i = 0; i < enumerationRounds; i++)
+    {
+        for(const std::string& type : types)
+            enumerated += resourceFork.getResourcesIDs(type).size();
+    }
+    results.push_back({"enumerate_ids", "ns/resource", secondsSince(start) * 1e9 / enumerated,
+                       static_cast<Big>(enumerated)});
+
+    enumerated = 0;
+    start = benchmarkClock::now();
+    for(std::size_t i = 0; i < enumerationRounds; i++)
+    {
+        for(const std::string& type : types)
+            enumerated += resourceFork.getResourcesNames(type).size();
+    }
+    results.push_back({"enumerate_names", "ns/resource", secondsSince(start) * 1e9 / enumerated,
+                       static_cast<Big>(enumerated)});
+
+    // The whole map through the visitor, names as views, then with sizes.
+    std::size_t entryBytes = 0;
+    RESX::ResourceFork::resourceVisitor visitor = [&](const RESX::ResourceEntry& entry)
+    {
+        enumerated++;
+        entryBytes += entry.nameLength + entry.size;
+        return true;
+    };
+
+    enumerated = 0;
+    start = benchmarkClock::now();
+    for(std::size_t i = 0; i < enumerationRounds; i++)
+        resourceFork.forEachResource(visitor);
+    results.push_back({"enumerate_entries", "ns/resource", secondsSince(start) * 1e9 / enumerated,
+                       static_cast<Big>(enumerated)});
+
+    enumerated = 0;
+    start = benchmarkClock::now();
+    for(std::size_t i = 0; i < enumerationRounds; i++)
+        resourceFork.forEachResource(visitor, true);
+    results.push_back({"enumerate_entries_sized", "ns/resource", secondsSince(start) * 1e9 / enumerated,
+                       static_cast<Big>(enumerated)});
+
+    // Bulk extraction to memory, one resource at a time in address order,
+    // then batched.
+    std::size_t totalBytes = 0;
+    start = benchmarkClock::now();
+    for(const RESX::ResourceInfo& info : infos)
+    {
+        std::size_t size;
+        std::unique_ptr<char, RESX::freeDelete> data = resourceFork.getResourceData(info, &size);
+        totalBytes += size;
+    }
+    double seconds = secondsSince(start);
+    results.push_back({"extract_each", "MB/s", totalBytes / 1e6 / seconds, static_cast<Big>(infos.size())});
+
+    std::vector<RESX::ResourceKey> keys;
+    for(const RESX::ResourceInfo& info : infos)
+        keys.push_back(RESX::ResourceKey(info.type, info.ID));
+
+    start = benchmarkClock::now();
+    RESX::ResourceBatch batch = resourceFork.getResources(keys);
+    seconds = secondsSince(start);
+    results.push_back({"extract_batch", "MB/s", totalBytes / 1e6 / seconds, static_cast<Big>(keys.size())});
+
+    // Endian conversion of as many bytes, as getResourceArray() does it.
+    std::vector<char> samples(totalBytes);
+    std::string kernelName = RESX::EndianSwapper::kernelName();
+    start = benchmarkClock::now();
+    RESX::EndianSwapper::swap16(samples.data(), samples.size() / 2);
+    seconds = secondsSince(start);
+    results.push_back({"swap16_" + kernelName, "MB/s", totalBytes / 1e6 / seconds, static_cast<Big>(samples.size() / 2)});
+
+    start = benchmarkClock::now();
+    RESX::EndianSwapper::swap32(samples.data(), samples.size() / 4);
+    seconds = secondsSince(start);
+    results.push_back({"swap32_" + kernelName, "MB/s", totalBytes / 1e6 / seconds, static_cast<Big>(samples.size() / 4)});
+
+    if(!keep)
+    {
+        std::remove(indexPath.c_str());
+        if(inputFile.empty())
+            std::remove(forkPath.c_str());
+    }
+
+    std::ostringstream json;
+    json << "{" << std::endl;
+    json << "  \"fork\": {\"path\": \"" << escapeJSON(forkPath) << "\", \"generated\": " <<
+        (inputFile.empty() ? "true" : "false") << ", \"types\": " << types.size() <<
+        ", \"resources\": " << infos.size() << ", \"payloadBytes\": " << totalBytes;
+    if(inputFile.empty())
+    {
+        json << ", \"nameLength\": [" << shape.minNameLength << ", " << shape.maxNameLength << "]" <<
+            ", \"payloadSize\": [" << shape.minPayloadSize << ", " << shape.maxPayloadSize << "]" <<
+            ", \"distribution\": \"" << distribution << "\", \"seed\": " << shape.seed;
+    }
+    json << "}," << std::endl;
+    json << "  \"lookupErrors\": " << lookupErrors << "," << std::endl;
+    json << "  \"results\": [" << std::endl;
+    for(std::size_t i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult& result = results[i];
+        json << "    {\"name\": \"" << result.name << "\", \"unit\": \"" << result.unit << "\", \"value\": " <<
+            result.value << ", \"operations\": " << result.operations << "}" <<
+            (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    json << "  ]" << std::endl << "}" << std::endl;
+
+    if(outputFile.empty())
+    {
+        std::cout << json.str();
+    } else
+    {
+        std::ofstream output(outputFile, std::ofstream::out | std::ofstream::trunc);
+        output << json.str();
+        if(output.fail())
+        {
+            std::cerr << "Error: writing to '" << outputFile << "' failed!" << std::endl;
+            return 1;
+        }
+    }
+
+    return lookupErrors == 0 ? 0 : 1;
+}
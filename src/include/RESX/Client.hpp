@@ -0,0 +1,112 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_CLIENT_HPP
+#define RESX_CLIENT_HPP
+
+#include "RESX/Protocol.hpp"
+#include "RESX/ResourceFork.hpp"
+
+#include <cstdint>
+#include <cstddef> // For std::size_t
+#include <string>
+#include <vector>
+
+namespace RESX
+{
+
+// Where a Server finds a resource fork: like File::loadResourceFork().
+struct ForkLocation
+{
+    std::string path;
+    unsigned int blockSize;
+    uint64_t startBlock;
+    bool decompress;
+
+    ForkLocation(const std::string& path, unsigned int blockSize = 4096, uint64_t startBlock = 0,
+                 bool decompress = false)
+        : path(path), blockSize(blockSize), startBlock(startBlock), decompress(decompress) {}
+};
+
+// A resource, as the server found it.
+struct RemoteResource
+{
+    int ID;
+    uint8_t attributes;
+    std::string name; // Empty if unnamed
+    std::size_t size;
+};
+
+// Data of an extracted resource: copied out of the reply, or mapped
+// from the descriptor that came with it (without copying). Move-only.
+class Payload
+{
+private:
+    std::vector<char> mCopy;
+    void* mMapping;
+    std::size_t mMappingSize;
+    const char* mData;
+    std::size_t mSize;
+
+    void release();
+
+    friend class Client;
+
+public:
+    Payload();
+    ~Payload();
+
+    Payload(Payload&& other);
+    Payload& operator=(Payload&& other);
+    Payload(const Payload&) = delete;
+    Payload& operator=(const Payload&) = delete;
+
+    const char* data() const;
+    std::size_t size() const;
+};
+
+// Connection to a Server. Requests wait for their reply; use one
+// Client per thread.
+class Client
+{
+private:
+    int mSocket;
+    uint32_t mSequence;
+
+    Protocol::Status request(Protocol::Operation operation, const ForkLocation& location,
+                             const ResourceKey& key, RemoteResource* resource, Payload* payload);
+    void disconnect();
+
+public:
+    Client(const std::string& socketPath);
+    ~Client();
+
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    // False once the server went away (or before it was reached).
+    bool isConnected() const;
+
+    Protocol::Status lookup(const ForkLocation& location, const ResourceKey& key, RemoteResource* resource);
+    Protocol::Status extract(const ForkLocation& location, const ResourceKey& key, RemoteResource* resource,
+                             Payload* payload);
+    // Makes the server close every fork, to reopen them when files changed.
+    Protocol::Status forget();
+};
+
+} // namespace RESX
+#endif // RESX_CLIENT_HPP
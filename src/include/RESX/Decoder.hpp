@@ -0,0 +1,141 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_DECODER_HPP
+#define RESX_DECODER_HPP
+
+#include "Defs.hpp"
+
+#include <cstdint>
+#include <cstddef> // For std::size_t
+
+namespace RESX
+{
+
+// Cursor over a buffer of big-endian data (a mapping, or bytes read
+// once into memory). Reads never allocate or touch the file.
+// Reading past the end returns 0 and sets overran(), check it once
+// after a series of reads.
+class Decoder
+{
+private:
+    const char* mData;
+    std::size_t mSize;
+    std::size_t mPosition;
+    bool mOverran;
+
+    // Returns nullptr (and sets mOverran) if bytes are not available.
+    const char* take(std::size_t bytes)
+    {
+        if(bytes > mSize - mPosition)
+        {
+            mOverran = true;
+            mPosition = mSize;
+            return nullptr;
+        }
+
+        const char* data = mData + mPosition;
+        mPosition += bytes;
+        return data;
+    }
+
+public:
+    Decoder(const char* data, std::size_t size)
+        : mData(data),
+        mSize(size),
+        mPosition(0),
+        mOverran(false)
+    {
+
+    }
+
+    uint8_t readU8()
+    {
+        const char* data = take(1);
+        return data ? static_cast<uint8_t>(*data) : 0;
+    }
+
+    uint16_t readU16()
+    {
+        const char* data = take(2);
+        return data ? Defs::loadBigEndian16(data) : 0;
+    }
+
+    // For 3-byte offsets (resource data offsets in reference lists).
+    uint32_t readU24()
+    {
+        const char* data = take(3);
+        return data ? Defs::loadBigEndian24(data) : 0;
+    }
+
+    uint32_t readU32()
+    {
+        const char* data = take(4);
+        return data ? Defs::loadBigEndian32(data) : 0;
+    }
+
+    uint64_t readU64()
+    {
+        const char* data = take(8);
+        return data ? Defs::loadBigEndian64(data) : 0;
+    }
+
+    int16_t readS16()
+    {
+        return static_cast<int16_t>(readU16());
+    }
+
+    // Pointer to the next bytes, nullptr if there aren't enough.
+    const char* readBytes(std::size_t bytes)
+    {
+        return take(bytes);
+    }
+
+    void skip(std::size_t bytes)
+    {
+        take(bytes);
+    }
+
+    void seek(std::size_t position)
+    {
+        if(position > mSize)
+        {
+            mOverran = true;
+            position = mSize;
+        }
+
+        mPosition = position;
+    }
+
+    std::size_t position() const
+    {
+        return mPosition;
+    }
+
+    std::size_t remaining() const
+    {
+        return mSize - mPosition;
+    }
+
+    bool overran() const
+    {
+        return mOverran;
+    }
+};
+
+} // namespace RESX
+#endif // RESX_DECODER_HPP
@@ -0,0 +1,99 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_DECOMPRESSOR_HPP
+#define RESX_DECOMPRESSOR_HPP
+
+#include <cstddef> // For std::size_t
+#include <cstdint>
+#include <functional>
+
+namespace RESX
+{
+
+// Compressed resources, as the Resource Manager of System 7 expands them:
+// the data starts with an extended header naming the 'dcmp' resource
+// that decompresses it and the decompressed length, so output buffers
+// are allocated once, before decompressing.
+// Built in: 'dcmp' (0), 'dcmp' (1) and 'dcmp' (2). 'dcmp' (2) resources
+// without their own table use a default one, which lives in the System
+// file and is not built in: until it is handed over with
+// setDcmp2DefaultTable(), they fail to decompress. Others can be plugged
+// in with registerDecompressor().
+class Decompressor
+{
+public:
+    static const uint32_t signature = 0xA89F6572;
+    // Set in the attributes of compressed resources.
+    static const uint8_t resourceAttribute = 0x01;
+    // Headers claiming more are rejected, the length comes from the file.
+    static const uint32_t maxDecompressedLength = 1UL << 26; // 64 MiB
+    // Words in the default table of 'dcmp' (2).
+    static const std::size_t dcmp2DefaultTableCount = 256;
+
+    struct Header
+    {
+        uint16_t headerLength; // The compressed data follows
+        uint8_t headerVersion; // 8 or 9
+        uint8_t attributes;
+        uint32_t decompressedLength;
+        int decompressorID;
+
+        // Version 8: working buffer fractional size and expansion buffer
+        // size, then reserved.
+        // Version 9: decompressor-specific parameters.
+        uint8_t parameters[4];
+    };
+
+    // input is the data after the header. Must fill output with exactly
+    // header.decompressedLength bytes, or return false.
+    using decompressFunction = std::function<bool(const Header& header, const char* input,
+                                                  std::size_t inputSize, char* output)>;
+
+    // Returns false if data does not start with a compressed resource header,
+    // or one claiming more than maxDecompressedLength bytes.
+    static bool parseHeader(const char* data, std::size_t size, Header* header);
+
+    // Decompresses data (header included) into output, which must hold
+    // header.decompressedLength bytes. Returns false (and cerrs) if no
+    // decompressor is registered for header.decompressorID or the data
+    // is malformed.
+    static bool decompress(const Header& header, const char* data, std::size_t size, char* output);
+
+    // Replaces the decompressor for ID, if any. Thread-safe.
+    static void registerDecompressor(int ID, decompressFunction function);
+    // True if a decompressor is registered for ID. Thread-safe.
+    static bool isRegistered(int ID);
+    // Copies the default table of 'dcmp' (2): dcmp2DefaultTableCount
+    // big-endian words. Thread-safe.
+    static void setDcmp2DefaultTable(const char* table);
+
+    // 'dcmp' (0): byte-oriented, for code. Literals (kept to be referred
+    // back to later), back-references, a fixed table of common 68k words
+    // and run-length, delta and jump table encodings.
+    static bool decompressDcmp0(const Header& header, const char* input, std::size_t inputSize, char* output);
+    // 'dcmp' (1): like 'dcmp' (0), with shorter literals and a smaller
+    // fixed table, for small resources.
+    static bool decompressDcmp1(const Header& header, const char* input, std::size_t inputSize, char* output);
+    // 'dcmp' (2): 16-bit words replaced by one-byte indices into a table,
+    // stored in the resource or the default one, optionally mixed with
+    // literal words under tag bytes.
+    static bool decompressDcmp2(const Header& header, const char* input, std::size_t inputSize, char* output);
+};
+
+} // namespace RESX
+#endif // RESX_DECOMPRESSOR_HPP
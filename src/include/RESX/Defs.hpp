@@ -25,15 +25,33 @@
 /* Global defines */
 
 // Define if you are compiling for a little-endian machine.
-// When undefined, big-endian machine is assumed (unless universal
-// endianness hack is used).
+// Only needed if your compiler doesn't tell us (GCC, Clang and MSVC do).
 // #define RESX_ON_LITTLE_ENDIAN_MACHINE
 
-// If defined, will use union hack to figure out the machine's endianness
-// at run-time. Use this if you wish to detect endianness automatically.
-// Might cause undefined behavior/compile-time error on future compilers.
-// Setting this to true will ignore RESX_ON_LITTLE_ENDIAN_MACHINE.
-#define RESX_USE_UNIVERSAL_ENDIANNESS_HACK
+// Define if you are compiling for a big-endian machine.
+// Only needed if your compiler doesn't tell us (GCC, Clang and MSVC do).
+// #define RESX_ON_BIG_ENDIAN_MACHINE
+
+// Figure out endianness at compile-time.
+#if !defined(RESX_ON_LITTLE_ENDIAN_MACHINE) && !defined(RESX_ON_BIG_ENDIAN_MACHINE)
+    #if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && \
+        __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        #define RESX_ON_LITTLE_ENDIAN_MACHINE
+    #elif defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && \
+        __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        #define RESX_ON_BIG_ENDIAN_MACHINE
+    #elif defined(_MSC_VER) // Every target of MSVC is little-endian
+        #define RESX_ON_LITTLE_ENDIAN_MACHINE
+    #else
+        #error "Cannot detect endianness, define RESX_ON_LITTLE_ENDIAN_MACHINE or RESX_ON_BIG_ENDIAN_MACHINE"
+    #endif
+#endif
+
+#ifdef _MSC_VER
+#include <stdlib.h> // For _byteswap_*()
+#endif
+
+#include <cstring> // For std::memcpy
 
 /* *** */
 
@@ -44,64 +62,122 @@ namespace Defs // Defs for "definitions"
 {
     using addr = unsigned long int; // At least 32-bit
 
-#ifdef RESX_USE_UNIVERSAL_ENDIANNESS_HACK
-    // Is not guaranteed to work on all compilers.
-    // From David Cournapeau
-    // (https://stackoverflow.com/questions/1001307/detecting-endianness-programmatically-in-a-c-program)
-    static bool isMachineLittleEndianHack()
+#ifdef RESX_ON_LITTLE_ENDIAN_MACHINE
+    constexpr bool machineIsLittleEndian = true;
+#else
+    // Big-endian machine, don't change endianness!
+    constexpr bool machineIsLittleEndian = false;
+#endif
+
+    static_assert(CHAR_BIT == 8, "CHAR_BIT != 8");
+
+    // Byte swaps, compiled to single instructions where the compiler can.
+    inline uint16_t byteSwap(uint16_t u)
     {
-        union {
-            uint32_t i;
-            char c[4];
-        } bint = {0x01020304};
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_bswap16(u);
+#elif defined(_MSC_VER)
+        return _byteswap_ushort(u);
+#else
+        return static_cast<uint16_t>((u >> 8) | (u << 8));
+#endif
+    }
 
-        return !(bint.c[0] == 1);
+    inline uint32_t byteSwap(uint32_t u)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_bswap32(u);
+#elif defined(_MSC_VER)
+        return _byteswap_ulong(u);
+#else
+        return (u >> 24) | ((u >> 8) & 0x0000FF00U) | ((u << 8) & 0x00FF0000U) | (u << 24);
+#endif
     }
 
-    const bool machineIsLittleEndian = isMachineLittleEndianHack();
-#elif defined(RESX_ON_LITTLE_ENDIAN_MACHINE)
-    const bool machineIsLittleEndian = true;
+    inline uint64_t byteSwap(uint64_t u)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_bswap64(u);
+#elif defined(_MSC_VER)
+        return _byteswap_uint64(u);
 #else
-    // Big-endian machine assumed, don't change endianness!
-    const bool machineIsLittleEndian = false;
-#endif /* RESX_USE_UNIVERSAL_ENDIANNESS_HACK*/
+        return (static_cast<uint64_t>(byteSwap(static_cast<uint32_t>(u))) << 32) |
+            byteSwap(static_cast<uint32_t>(u >> 32));
+#endif
+    }
+
+    inline uint8_t byteSwap(uint8_t u)
+    {
+        return u;
+    }
+
+    // Unsigned integer of the same size as T.
+    template<std::size_t size> struct UnsignedOfSize;
+    template<> struct UnsignedOfSize<1> { using type = uint8_t; };
+    template<> struct UnsignedOfSize<2> { using type = uint16_t; };
+    template<> struct UnsignedOfSize<4> { using type = uint32_t; };
+    template<> struct UnsignedOfSize<8> { using type = uint64_t; };
 
     // If you are running on a little-endian machine, you must call this
     // on each struct primitive (on every member and on every element of
-    // all member arrays)!!!
+    // all member arrays)!!! Or declare the struct with RESX_SCHEMA()
+    // (see Schema.hpp) and let getResource() do it.
     // Remember: endianness only applies to individual values (numbers)!
     // So, the struct is in the correct order, but the individual members
     // have the wrong byte order.
-    // Note: this method also looks like a union hack.
-    // From https://stackoverflow.com/questions/105252/how-do-i-convert-between-big-endian-and-little-endian-values-in-c
+    // Works for any 1, 2, 4 or 8-byte T, floats included.
     template<typename T>
-    static T swapEndian(T u)
+    inline T swapEndian(T u)
     {
-        static_assert (CHAR_BIT == 8, "CHAR_BIT != 8");
-
-        union
-        {
-            T u;
-            unsigned char u8[sizeof(T)];
-        } source, dest;
+        using Unsigned = typename UnsignedOfSize<sizeof(T)>::type;
 
-        source.u = u;
+        // memcpy is the well-defined way of type punning,
+        // compilers turn it into plain moves.
+        Unsigned bits;
+        std::memcpy(&bits, &u, sizeof(T));
+        bits = byteSwap(bits);
+        std::memcpy(&u, &bits, sizeof(T));
 
-        for (size_t k = 0; k < sizeof(T); k++)
-            dest.u8[k] = source.u8[sizeof(T) - k - 1];
-
-        return dest.u;
+        return u;
     }
 
     // Makes the value the correct endianness for the client machine.
     template<typename T>
-    static T makeSafeEndian(T u)
+    inline T makeSafeEndian(T u)
     {
         if(machineIsLittleEndian)
             return swapEndian(u);
         else
             return u;
     }
+
+    // Big-endian loads from unaligned bytes.
+    inline uint16_t loadBigEndian16(const char* data)
+    {
+        uint16_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return makeSafeEndian(value);
+    }
+
+    inline uint32_t loadBigEndian24(const char* data)
+    {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+        return (static_cast<uint32_t>(bytes[0]) << 16) | (static_cast<uint32_t>(bytes[1]) << 8) | bytes[2];
+    }
+
+    inline uint32_t loadBigEndian32(const char* data)
+    {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return makeSafeEndian(value);
+    }
+
+    inline uint64_t loadBigEndian64(const char* data)
+    {
+        uint64_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return makeSafeEndian(value);
+    }
 } // namespace Defs
 
 } // namespace RESX
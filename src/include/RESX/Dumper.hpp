@@ -0,0 +1,84 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_DUMPER_HPP
+#define RESX_DUMPER_HPP
+
+#include <cstddef> // For std::size_t
+#include <cstdint>
+#include <cstdio> // For FILE
+#include <string>
+#include <vector>
+
+namespace RESX
+{
+
+// Renders resource data for a terminal or a pipe, chunk by chunk (as
+// handed out by ResourceFork::streamResource()), into a large buffer that
+// is written out in few calls.
+class Dumper
+{
+public:
+    enum class Format
+    {
+        hex, // 16 bytes per line, in two groups of 8
+        raw, // The bytes as they are
+        base64 // RFC 4648, in lines of 76 chars
+    };
+
+private:
+    static const std::size_t bufferSize = 1 << 20;
+    static const std::size_t bytesPerLine = 16;
+
+    std::FILE* mOutput;
+    Format mFormat;
+    bool mShowOffsets;
+    bool mShowASCII;
+    bool mFailed;
+
+    std::vector<char> mBuffer;
+    std::size_t mBufferLength;
+
+    // Bytes not rendered yet: the start of an incomplete hex line, or of
+    // a base64 quantum.
+    unsigned char mPending[bytesPerLine];
+    std::size_t mPendingLength;
+    uint64_t mOffset; // Of mPending[0] in the data
+    std::size_t mLineLength; // Base64 chars on the current line
+
+    void flushBuffer();
+    void reserve(std::size_t size);
+    void appendHexLine(const unsigned char* bytes, std::size_t count);
+    void appendBase64(const unsigned char* bytes, std::size_t count);
+
+public:
+    // Hex lines can start with their offset and end with an ASCII gutter.
+    Dumper(std::FILE* output, Format format, bool showOffsets = false, bool showASCII = false);
+    ~Dumper();
+
+    // Returns false if writing failed (then and from there on).
+    bool write(const char* data, std::size_t size);
+    // Renders what is pending (the last, incomplete line) and writes out
+    // the buffer. Returns false if writing failed.
+    bool finish();
+
+    // "hex", "raw" or "base64" to format. Returns false if unknown.
+    static bool parseFormat(const std::string& text, Format* format);
+};
+
+} // namespace RESX
+#endif // RESX_DUMPER_HPP
@@ -0,0 +1,82 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_ENDIAN_SWAPPER_HPP
+#define RESX_ENDIAN_SWAPPER_HPP
+
+#include "Defs.hpp"
+
+#include <cstddef> // For std::size_t
+#include <cstdint>
+
+namespace RESX
+{
+
+// Swaps the byte order of whole arrays in place, 16 or 32 bytes at a
+// time with byte shuffles (SSE2, AVX2, NEON), one value at a time
+// otherwise. The kernel is picked once, at runtime, from what the CPU
+// supports.
+class EndianSwapper
+{
+public:
+    // values points to count 2, 4 or 8-byte values, with any alignment.
+    static void swap16(void* values, std::size_t count);
+    static void swap32(void* values, std::size_t count);
+    static void swap64(void* values, std::size_t count);
+
+    // Name of the kernel in use: "avx2", "sse2", "neon" or "scalar".
+    static const char* kernelName();
+
+    // Converts big-endian values to the machine's byte order (nothing to
+    // do on big-endian machines). Any 1, 2, 4 or 8-byte T, floats included.
+    template<typename T>
+    static void toMachineEndian(T* values, std::size_t count)
+    {
+        if(Defs::machineIsLittleEndian)
+            swap(values, count, SizeTag<sizeof(T)>());
+    }
+
+private:
+    template<std::size_t size> struct SizeTag {};
+
+    template<typename T>
+    static void swap(T*, std::size_t, SizeTag<1>)
+    {
+
+    }
+
+    template<typename T>
+    static void swap(T* values, std::size_t count, SizeTag<2>)
+    {
+        swap16(values, count);
+    }
+
+    template<typename T>
+    static void swap(T* values, std::size_t count, SizeTag<4>)
+    {
+        swap32(values, count);
+    }
+
+    template<typename T>
+    static void swap(T* values, std::size_t count, SizeTag<8>)
+    {
+        swap64(values, count);
+    }
+};
+
+} // namespace RESX
+#endif // RESX_ENDIAN_SWAPPER_HPP
@@ -0,0 +1,87 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_EXTENT_READER_HPP
+#define RESX_EXTENT_READER_HPP
+
+#include "Reader.hpp"
+
+#include <cstdint>
+#include <memory> // For smart pointers
+#include <vector>
+
+namespace RESX
+{
+
+// A run of contiguous allocation blocks, as in HFS+ extent records.
+struct Extent
+{
+    uint32_t startBlock;
+    uint32_t blockCount;
+};
+
+// Presents a fork scattered over several extents of a parent file as one
+// contiguous file: offset 0 is the start of the fork. Extents that are
+// physically adjacent are merged, so reads spanning them are single reads.
+class ExtentReader : public Reader
+{
+public:
+    // Type aliases
+    using readerPointer = std::shared_ptr<Reader>;
+
+private:
+    // Extents merged and converted to bytes.
+    struct Run
+    {
+        Defs::addr logicalStart;
+        Defs::addr physicalStart;
+        Defs::addr length;
+    };
+
+    readerPointer mParent;
+    std::vector<Run> mRuns;
+    Defs::addr mSize;
+
+public:
+    // logicalSize is the size of the fork, 0 to use all the blocks of the extents.
+    ExtentReader(readerPointer parent, const std::vector<Extent>& extents,
+                 unsigned int blockSize, Defs::addr logicalSize = 0);
+    ~ExtentReader();
+
+    // Parses the 8 extents of an HFS+ fork data record (HFSPlusForkData,
+    // 80 bytes, big-endian), stopping at the first empty one.
+    // If logicalSize is not nullptr, it receives the fork's logical size.
+    static std::vector<Extent> parseForkData(const char* forkData, Defs::addr* logicalSize = nullptr);
+
+    bool isOpen() const override;
+    Defs::addr size() const override;
+    // The parent's.
+    int64_t modificationTime() const override;
+    std::size_t readAt(Defs::addr offset, char* destination, std::size_t size) const override;
+    // Split over the runs, then handed to the parent as a single batch.
+    void readBatch(ReadRequest* requests, std::size_t count) const override;
+    // The parent's.
+    bool prefersBatches() const override;
+    std::size_t copyToFile(Defs::addr offset, std::size_t size, int outputFileDescriptor) const override;
+
+    // Only available if all extents are physically contiguous
+    // and the parent is memory-mapped.
+    const char* data() const override;
+};
+
+} // namespace RESX
+#endif // RESX_EXTENT_READER_HPP
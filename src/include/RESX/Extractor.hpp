@@ -0,0 +1,76 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_EXTRACTOR_HPP
+#define RESX_EXTRACTOR_HPP
+
+#include "RESX/ResourceFork.hpp"
+
+#include <string>
+#include <cstddef> // For std::size_t
+
+namespace RESX
+{
+
+// Extracts many resources of a fork in one go, each to its own file
+// in an output directory. Resources are read in address order, so
+// the input is scanned sequentially.
+// With several threads, resources are split in batches of neighbouring
+// resources, and each thread gets a contiguous run of batches (stealing
+// from the others when it is done).
+// If the fork prefers batches (io_uring), each batch is read with
+// getResources(), then written out.
+class Extractor
+{
+private:
+    ResourceFork& mResourceFork;
+    std::string mOutputDirectory;
+    unsigned int mThreadCount;
+
+    bool extractResource(const ResourceInfo& info);
+    std::size_t extractBatch(const std::vector<ResourceInfo>& infos, std::size_t first, std::size_t last);
+    std::size_t extractResources(const std::vector<ResourceInfo>& infos);
+    std::size_t extractResourcesInParallel(const std::vector<ResourceInfo>& infos);
+
+public:
+    // Creates outputDirectory (and its parents) if it does not exist.
+    Extractor(ResourceFork& resourceFork, const std::string& outputDirectory);
+    ~Extractor();
+
+    // 1 by default. 0 uses the number of hardware threads.
+    void setThreadCount(unsigned int threadCount);
+
+    // Returns the number of resources extracted.
+    std::size_t extractAll();
+    std::size_t extractAll(const std::string& type);
+
+    // TYPE_ID_NAME (TYPE_ID if unnamed), with characters that are not safe
+    // in file names percent-encoded: 'snd ' 128 "Beep" gives snd%20_128_Beep.
+    static std::string outputFileName(const ResourceInfo& info);
+
+    // text with characters that are not safe in file names percent-encoded.
+    static std::string safeFileName(const std::string& text);
+
+    // Writes the data of a resource to outputPath (truncated), copying
+    // inside the kernel when possible: memory use stays bounded whatever
+    // the size of the resource. Returns false (and cerrs) on failure.
+    static bool writeResource(const ResourceFork& resourceFork, const ResourceInfo& info,
+                              const std::string& outputPath);
+};
+
+} // namespace RESX
+#endif // RESX_EXTRACTOR_HPP
@@ -19,10 +19,13 @@
 #define RESX_FILE_HPP
 
 #include "Defs.hpp"
+#include "Reader.hpp"
+#include "ExtentReader.hpp"
 
 #include <string>
 #include <fstream>
 #include <memory> // For smart pointers
+#include <vector>
 
 namespace RESX
 {
@@ -33,17 +36,36 @@ class File
 public:
     // Type aliases
     using ifstreamPointer = std::shared_ptr<std::ifstream>;
+    using readerPointer = std::shared_ptr<Reader>;
 
 private:
     std::string mHFSFileName;
-    ifstreamPointer mHFSFile;
+    readerPointer mReader;
     int mBlockSize;
 
 public:
-    File(const std::string& HFSFileName, unsigned int blockSize);
+    // If memoryMap is true, the file is memory-mapped, falling back to
+    // positional reads if mapping fails.
+    File(const std::string& HFSFileName, unsigned int blockSize, bool memoryMap = true);
+    // Reads through reader (UringReader, for one).
+    File(const std::string& HFSFileName, unsigned int blockSize, readerPointer reader);
     ~File();
 
-    ResourceFork loadResourceFork(unsigned int firstBlock);
+    bool isMemoryMapped() const;
+    readerPointer getReader() const;
+
+    // For when the block size is only known after reading the file
+    // (HFS+ volume header).
+    void setBlockSize(unsigned int blockSize);
+
+    // Resource fork on a single extent, starting at firstBlock.
+    // If indexPath is not empty, the index is loaded from (or saved to)
+    // that sidecar file, see ResourceFork.
+    ResourceFork loadResourceFork(unsigned int firstBlock, const std::string& indexPath = std::string());
+    // Resource fork spread over extents, in fork order.
+    // logicalSize is the fork's size, 0 to use all the blocks of the extents.
+    ResourceFork loadResourceFork(const std::vector<Extent>& extents, Defs::addr logicalSize = 0,
+                                  const std::string& indexPath = std::string());
 };
 
 } // namespace RESX
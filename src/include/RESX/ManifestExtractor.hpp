@@ -0,0 +1,97 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_MANIFEST_EXTRACTOR_HPP
+#define RESX_MANIFEST_EXTRACTOR_HPP
+
+#include "RESX/File.hpp"
+#include "RESX/ResourceFork.hpp"
+
+#include <cstddef> // For std::size_t
+#include <functional>
+#include <istream>
+#include <map>
+#include <string>
+#include <utility> // For std::pair
+#include <vector>
+
+namespace RESX
+{
+
+// Extracts the resources listed in a manifest, one per line, with tabs
+// between the fields:
+// INPUT_FILE  START_BLOCK  TYPE  ID_OR_NAME  OUTPUT_FILE
+// ID_OR_NAME is an ID if it is a number, a name otherwise. Empty lines
+// and lines starting with '#' are skipped.
+// Records are grouped by input file and start block, so each resource
+// fork is opened, and its map parsed, once however many records name
+// it. Forks are opened by several threads at once, and the records of
+// a fork are written in address order, in runs split among the threads.
+class ManifestExtractor
+{
+public:
+    // Opens an input file (with the block size and reader to use).
+    using fileOpener = std::function<File(const std::string& path)>;
+
+private:
+    struct Record
+    {
+        ResourceKey key;
+        std::string outputFile;
+        std::size_t line;
+    };
+
+    struct Group
+    {
+        std::string inputFile;
+        unsigned int startBlock;
+        std::vector<Record> records;
+    };
+
+    fileOpener mOpenFile;
+    unsigned int mThreadCount;
+    bool mDecompress;
+
+    std::vector<Group> mGroups;
+    // Index in mGroups of each input file and start block.
+    std::map<std::pair<std::string, unsigned int>, std::size_t> mGroupIndices;
+    std::size_t mRecordCount;
+
+    bool addRecord(const std::string& line, std::size_t lineNumber);
+
+public:
+    ManifestExtractor(fileOpener openFile);
+    ~ManifestExtractor();
+
+    // Adds the records of manifest. Returns false (and cerrs the line)
+    // at the first malformed record, which is not added.
+    bool load(std::istream& manifest);
+    std::size_t recordCount() const;
+    std::size_t inputCount() const;
+
+    // 1 by default. 0 uses the number of hardware threads.
+    void setThreadCount(unsigned int threadCount);
+    // Off by default, see ResourceFork::setDecompression().
+    void setDecompression(bool decompress);
+
+    // Returns the number of resources extracted. Output files are
+    // truncated, their directories must exist.
+    std::size_t extractAll();
+};
+
+} // namespace RESX
+#endif // RESX_MANIFEST_EXTRACTOR_HPP
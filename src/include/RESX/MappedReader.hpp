@@ -0,0 +1,61 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_MAPPED_READER_HPP
+#define RESX_MAPPED_READER_HPP
+
+#include "Reader.hpp"
+
+#include <string>
+
+namespace RESX
+{
+
+// Maps the whole file read-only into memory, so parsing and resource
+// views read straight from the page cache without syscalls or copies.
+class MappedReader : public Reader
+{
+private:
+    const char* mData;
+    Defs::addr mSize;
+    int64_t mModificationTime;
+
+#ifdef _WIN32
+    void* mFileHandle;
+    void* mMappingHandle;
+#else
+    int mFileDescriptor; // Kept for copyToFile()
+#endif
+
+public:
+    MappedReader(const std::string& fileName);
+    ~MappedReader();
+
+    // No copies, we own the mapping.
+    MappedReader(const MappedReader&) = delete;
+    MappedReader& operator=(const MappedReader&) = delete;
+
+    bool isOpen() const override;
+    Defs::addr size() const override;
+    int64_t modificationTime() const override;
+    std::size_t readAt(Defs::addr offset, char* destination, std::size_t size) const override;
+    std::size_t copyToFile(Defs::addr offset, std::size_t size, int outputFileDescriptor) const override;
+    const char* data() const override;
+};
+
+} // namespace RESX
+#endif // RESX_MAPPED_READER_HPP
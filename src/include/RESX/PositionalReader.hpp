@@ -0,0 +1,69 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_POSITIONAL_READER_HPP
+#define RESX_POSITIONAL_READER_HPP
+
+#include "Reader.hpp"
+
+#include <string>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace RESX
+{
+
+// Reads with pread() (ReadFile() with an explicit offset on Windows):
+// there is no shared cursor, so any number of threads can read at once.
+class PositionalReader : public Reader
+{
+private:
+#ifdef _WIN32
+    void* mFileHandle;
+#else
+    int mFileDescriptor;
+#endif
+    Defs::addr mSize;
+    int64_t mModificationTime;
+
+public:
+    PositionalReader(const std::string& fileName);
+    ~PositionalReader();
+
+    // No copies, we own the file descriptor.
+    PositionalReader(const PositionalReader&) = delete;
+    PositionalReader& operator=(const PositionalReader&) = delete;
+
+    bool isOpen() const override;
+    Defs::addr size() const override;
+    int64_t modificationTime() const override;
+    std::size_t readAt(Defs::addr offset, char* destination, std::size_t size) const override;
+    std::size_t copyToFile(Defs::addr offset, std::size_t size, int outputFileDescriptor) const override;
+
+#ifndef _WIN32
+    // copyToFile() for any pair of file descriptors. Only Linux has
+    // copy_file_range() and sendfile() to a file, elsewhere returns 0.
+    static std::size_t copyFileRange(int inputFileDescriptor, Defs::addr offset, std::size_t size,
+                                     int outputFileDescriptor);
+    static int64_t modificationTimeOf(const struct stat& fileStat);
+#endif
+};
+
+} // namespace RESX
+#endif // RESX_POSITIONAL_READER_HPP
@@ -0,0 +1,122 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_PROTOCOL_HPP
+#define RESX_PROTOCOL_HPP
+
+#include <cstdint>
+#include <cstddef> // For std::size_t
+
+namespace RESX
+{
+
+// What Server and Client say to each other over a Unix domain socket.
+// Both ends are on the same machine, so messages are plain structs in
+// native byte order.
+//
+// A request is a Request, then pathLength bytes of path, then
+// nameLength bytes of name. A reply is a Reply, then nameLength bytes
+// of name, then size bytes of data if payload is inlineData. With
+// fileDescriptor, the data is not in the reply: a descriptor comes
+// along with it (SCM_RIGHTS), and the data is at payloadOffset in it,
+// ready to be mapped.
+class Protocol
+{
+public:
+    static const uint32_t magic = 0x52535844; // 'RSXD'
+    static const uint16_t version = 1;
+
+    // Larger data is handed over as a descriptor: mapping it costs more
+    // than copying a few pages.
+    static const std::size_t inlineDataLimit = 1UL << 16; // 64 KiB
+
+    static const std::size_t pathLengthLimit = 4096;
+    static const std::size_t nameLengthLimit = 255; // As in the name list
+
+    enum Operation : uint16_t
+    {
+        lookup = 1, // Reply without data
+        extract = 2,
+        forget = 3 // Close every open fork, for when files changed
+    };
+
+    enum Status : uint16_t
+    {
+        ok = 0,
+        badRequest = 1,
+        cannotOpen = 2,
+        notFound = 3,
+        cannotRead = 4,
+        disconnected = 5 // Never sent, the client's own
+    };
+
+    enum Payload : uint16_t
+    {
+        noData = 0,
+        inlineData = 1,
+        fileDescriptor = 2
+    };
+
+    // Request flags
+    static const uint16_t decompressFlag = 1 << 0;
+    static const uint16_t byNameFlag = 1 << 1; // Else by ID
+
+    struct Request
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t operation;
+        uint32_t sequence; // Echoed back in the reply
+        uint32_t blockSize;
+        uint64_t startBlock;
+        uint32_t typeCode; // See ResourceIndex::typeCode()
+        int32_t ID;
+        uint16_t flags;
+        uint16_t nameLength;
+        uint32_t pathLength;
+    };
+
+    struct Reply
+    {
+        uint32_t magic;
+        uint16_t status;
+        uint16_t payload;
+        uint32_t sequence;
+        int32_t ID;
+        uint64_t size; // Of the resource data, even without payload
+        uint64_t payloadOffset;
+        uint8_t attributes;
+        uint8_t reserved;
+        uint16_t nameLength;
+        uint32_t reserved2;
+    };
+
+    static_assert(sizeof(Request) == 40, "Request is not packed as expected!");
+    static_assert(sizeof(Reply) == 40, "Reply is not packed as expected!");
+
+    static const char* statusString(uint16_t status);
+
+    // Both return false if the other end went away or on error.
+    // fileDescriptor, if not -1, is passed along with the first byte.
+    static bool sendAll(int socket, const char* data, std::size_t size, int fileDescriptor = -1);
+    // *fileDescriptor is set to a received descriptor, -1 if none came
+    // (nullptr to close any that does).
+    static bool receiveAll(int socket, char* data, std::size_t size, int* fileDescriptor = nullptr);
+};
+
+} // namespace RESX
+#endif // RESX_PROTOCOL_HPP
@@ -0,0 +1,89 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_READER_HPP
+#define RESX_READER_HPP
+
+#include "Defs.hpp"
+
+#include <cstddef> // For std::size_t
+#include <cstdint>
+
+namespace RESX
+{
+
+// Random-access source of bytes a resource fork is parsed from.
+// Offsets are absolute within the parent file (.hfs or .rsrc).
+// Implementations must be safe to call from several threads at once.
+class Reader
+{
+public:
+    // One read of a batch, see readBatch().
+    struct ReadRequest
+    {
+        Defs::addr offset;
+        char* destination;
+        std::size_t size;
+        std::size_t bytesRead; // Set by readBatch()
+    };
+
+    virtual ~Reader() {}
+
+    virtual bool isOpen() const = 0;
+
+    // Size of the whole parent file, in bytes.
+    virtual Defs::addr size() const = 0;
+
+    // Copies size bytes starting at offset into destination.
+    // Returns the number of bytes actually copied, which is
+    // smaller than size if the end of the file was reached.
+    virtual std::size_t readAt(Defs::addr offset, char* destination, std::size_t size) const = 0;
+
+    // readAt() for every request, setting their bytesRead. Readers that
+    // can keep many reads in flight do, completing them in any order.
+    virtual void readBatch(ReadRequest* requests, std::size_t count) const
+    {
+        for(std::size_t i = 0; i < count; i++)
+            requests[i].bytesRead = readAt(requests[i].offset, requests[i].destination, requests[i].size);
+    }
+
+    // True if readBatch() is much faster than as many readAt() calls, so
+    // reading many resources is worth gathering into batches.
+    virtual bool prefersBatches() const { return false; }
+
+    // When the file was last modified, in a platform-specific unit. Only
+    // meant to be compared, to tell whether the file changed. 0 if unknown.
+    virtual int64_t modificationTime() const { return 0; }
+
+    // Pointer to the whole file in memory, if this reader keeps it there
+    // (memory-mapped). Returns nullptr otherwise, in which case you must
+    // go through readAt().
+    virtual const char* data() const { return nullptr; }
+
+    // Writes size bytes starting at offset to the file outputFileDescriptor
+    // (at its current position) without copying them through user space.
+    // Returns the number of bytes written, which may be less than size
+    // (0 if the reader or platform cannot do it): write the rest with readAt().
+    virtual std::size_t copyToFile(Defs::addr offset, std::size_t size, int outputFileDescriptor) const
+    {
+        (void)offset; (void)size; (void)outputFileDescriptor;
+        return 0;
+    }
+};
+
+} // namespace RESX
+#endif // RESX_READER_HPP
@@ -0,0 +1,94 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_RESOURCE_CACHE_HPP
+#define RESX_RESOURCE_CACHE_HPP
+
+#include "Defs.hpp"
+
+#include <cstddef> // For std::size_t
+#include <cstdint>
+#include <list>
+#include <memory> // For smart pointers
+#include <mutex>
+#include <unordered_map>
+
+namespace RESX
+{
+
+// Resource data shared between the cache and everyone it was handed to.
+// Freed when the last owner lets go, even if evicted in the meantime.
+// data is nullptr if the resource could not be read.
+struct ResourceBuffer
+{
+    std::shared_ptr<const char> data;
+    std::size_t size;
+};
+
+// Resource data keyed by address, evicting the least recently used
+// resources once the total size goes over a byte budget.
+// Safe to use from several threads at once.
+class ResourceCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        std::size_t entryCount;
+        std::size_t bytes; // Total size of the cached resources
+        std::size_t budget;
+    };
+
+private:
+    struct Entry
+    {
+        Defs::addr address;
+        ResourceBuffer buffer;
+    };
+
+    // Most recently used first.
+    std::list<Entry> mEntries;
+    std::unordered_map<Defs::addr, std::list<Entry>::iterator> mLookup;
+
+    // Guards everything below and the containers above.
+    mutable std::mutex mMutex;
+    std::size_t mBudget;
+    std::size_t mBytes;
+    uint64_t mHits;
+    uint64_t mMisses;
+    uint64_t mEvictions;
+
+public:
+    ResourceCache(std::size_t budget);
+    ~ResourceCache();
+
+    ResourceCache(const ResourceCache&) = delete;
+    ResourceCache& operator=(const ResourceCache&) = delete;
+
+    // Returns false (a miss) if address is not cached.
+    bool find(Defs::addr address, ResourceBuffer* buffer);
+
+    // Resources larger than the whole budget are not cached.
+    void insert(Defs::addr address, const ResourceBuffer& buffer);
+
+    Stats stats() const;
+};
+
+} // namespace RESX
+#endif // RESX_RESOURCE_CACHE_HPP
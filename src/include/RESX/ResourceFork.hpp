@@ -18,8 +18,13 @@
 #ifndef RESX_RESOURCE_FORK_HPP
 #define RESX_RESOURCE_FORK_HPP
 
-#include "ResExtractor.hpp"
 #include "RESX/Defs.hpp"
+#include "RESX/Reader.hpp"
+#include "RESX/ResourceIndex.hpp"
+#include "RESX/ResourceCache.hpp"
+#include "RESX/EndianSwapper.hpp"
+#include "RESX/Schema.hpp"
+#include "RESX/Stats.hpp"
 
 #include <fstream>
 #include <utility> // For pair
@@ -30,11 +35,13 @@
 #include <ios>
 #include <iostream> // For istream and cerr
 #include <vector>
-#include <algorithm> // For reverse()
-#include <iterator>
+#include <algorithm> // For sort()
 
 #include <cstring> // For std::memcpy (why is this in <cstring>)
 #include <cstddef> // For std::size_t
+#include <limits> // For numeric_limits
+#include <functional> // For function
+#include <mutex>
 
 namespace RESX
 {
@@ -45,19 +52,78 @@ struct freeDelete
     void operator()(void* x) { free(x); }
 };
 
+// Non-owning view of a resource's data inside a memory-mapped file.
+// Only valid as long as the File/ResourceFork it came from is alive.
+// data is nullptr if the resource could not be viewed.
+struct ResourceView
+{
+    const char* data;
+    std::size_t size;
+};
+
+// Everything the map says about a resource.
+struct ResourceInfo
+{
+    std::string type;
+    int ID; // Signed, as in the Resource Manager
+    std::string name; // Empty if unnamed
+    uint8_t attributes;
+    Defs::addr address; // Absolute address of the resource data length field
+};
+
+// What forEachResource() hands out, without copying anything: name
+// points into the index (not null-terminated, nullptr if unnamed) and is
+// only valid as long as the ResourceFork.
+struct ResourceEntry
+{
+    uint32_t typeCode; // Big-endian packed, see ResourceIndex::typeString()
+    int ID; // Signed, as in the Resource Manager
+    uint8_t attributes;
+    std::size_t size; // As stored, 0 unless asked for
+    Defs::addr address; // Absolute address of the resource data length field
+    const char* name;
+    std::size_t nameLength;
+};
+
+// Key of a resource for getResources(): by name if name is not empty,
+// by ID otherwise.
+struct ResourceKey
+{
+    std::string type;
+    int ID;
+    std::string name;
+
+    ResourceKey(const std::string& type, int ID) : type(type), ID(ID) {}
+    ResourceKey(const std::string& type, const std::string& name) : type(type), ID(0), name(name) {}
+};
+
+// Result of getResources(): one view per key, in the order of the keys,
+// all pointing into buffer. A view is {nullptr, 0} if its key was not found.
+struct ResourceBatch
+{
+    std::unique_ptr<char, freeDelete> buffer;
+    std::vector<ResourceView> views;
+};
+
+// Once constructed, all const methods are safe to call from several
+// threads at once: the index is read-only and readers have no cursor.
 class ResourceFork
 {
 public:
     // Type aliases
     // To save time typing the looooonnnggg type.
     using ifstreamPointer = std::shared_ptr<std::ifstream>;
+    using readerPointer = std::shared_ptr<Reader>;
+    // Receives consecutive chunks of resource data, returns false to stop.
+    using chunkSink = std::function<bool(const char* chunk, std::size_t size)>;
+    // Visitors of forEachType() and forEachResource(), return false to stop.
+    using typeVisitor = std::function<bool(uint32_t typeCode, std::size_t resourceCount)>;
+    using resourceVisitor = std::function<bool(const ResourceEntry& entry)>;
 
-private:
-    // First: (number of resources -1) of this type in our map.
-    // Second: address of reference list for this type.
-    using ReferenceListPointerPair = std::pair<int, Defs::addr>;
+    static const std::size_t defaultChunkSize = 1UL << 16; // 64 KiB
 
-    ifstreamPointer mHFSFile;
+private:
+    readerPointer mReader;
 
     // The address of the resource fork itself within the parent file
     Defs::addr mStartAddr;
@@ -76,6 +142,29 @@ private:
     Defs::addr mResourceNameListAddr;
     int mNumberOfTypesMinusOne; // Can be negative
 
+    // Parsed once from the map, all lookups go through here.
+    ResourceIndex mIndex;
+
+    // Set with setDecompression().
+    bool mDecompress;
+
+    // nullptr unless enabled with setCacheBudget().
+    std::shared_ptr<ResourceCache> mCache;
+
+    // Without a cache, the last resource expanded, so that reading one
+    // piece by piece only expands it once. Shared by copies.
+    struct ExpandedResource
+    {
+        std::mutex mutex;
+        Defs::addr address;
+        ResourceBuffer buffer;
+    };
+    std::shared_ptr<ExpandedResource> mLastExpanded;
+
+    // Always there, so that the layout does not depend on
+    // RESX_ENABLE_STATS; only counted into if it is defined.
+    mutable StatsCounters mStats;
+
     static inline void checkFloatingTypes();
 
     // Casts typeToCastFrom* to std::unique_ptr<typeToCastTo>.
@@ -102,87 +191,207 @@ private:
         return newData;
     }
 
-    // Read a single primitive value from binary file.
-    // Corrects endianness if necessary.
-    // Use seekg to move the cursor to the chunk of bytes
-    // you want to read.
-    // (This function moves the file cursor to the end of
-    // the read bytes.)
-    template<typename B>
-    static B readSinglePrimitive(ifstreamPointer file, std::size_t bytesToRead)
-    {
-        std::vector<char> rawData;
-        // Size of rawData must be >= to sizeof(B) to avoid garbage data when
-        // reinterpret casting; if rawData > sizeof(B), will truncate or not
-        // depending on endianness, so don't do this. Thus, set sizeof(rawData)
-        // to sizeof(B) for portability.
-        // Allocate and set all elements to 0:
-        rawData.resize(sizeof(B), 0);
-
-        // Add padding if necessary, to avoid garbage data from seeping in.
-        std::size_t paddingRequired = 0;
-        // sizeof(B) should never be < than bytesToRead if you are a good coder!
-        if(sizeof(B) > bytesToRead)
-            paddingRequired = sizeof(B) - bytesToRead;
-
-        // file.read() wants a char* and not an unsigned char* for some reason.
-        // Data in HFS file is in big-endian!! HFS+ specification.
-        file->read(rawData.data()+paddingRequired, bytesToRead);
-        checkFileReadErrors(file, bytesToRead, "single primitive");
-
-        // If we are on little endian, invert endianness!
-        // (Convert from big-endian to little-endian)
-        if(Defs::machineIsLittleEndian)
-            // Could of called Defs::makeSafeEndian() on the reinterpreted value
-            // itself, but this is simpler in our case.
-            std::reverse(std::begin(rawData), std::end(rawData));
-
-        return *reinterpret_cast<B*>(rawData.data());
-    }
+    std::size_t readAt(Defs::addr address, char* destination, std::size_t size) const;
+    void readBytes(Defs::addr address, char* destination, std::size_t bytesToRead,
+                   const std::string& dataTryingToReadName) const;
+    void readBatch(std::vector<Reader::ReadRequest>& reads, const std::string& dataTryingToReadName) const;
 
-    // Read an array having elements of size char (and ONLY of size char,
-    // don't try to read an array from file with elements larger than char)
-    // from binary file.
-    template<typename B>
-    static std::vector<B> readByteArray(ifstreamPointer file, std::size_t bytesToRead)
-    {
-        std::vector<char> rawData;
-        rawData.resize(bytesToRead, 0);
-        file->read(rawData.data(), bytesToRead);
-        checkFileReadErrors(file, bytesToRead, "byte array");
-
-        // May or may not copy
-        // Type conversion for each element (since they are all
-        // of size char).
-        return std::vector<B>(rawData.begin(), rawData.end());
-    }
+    std::size_t readResourceSize(Defs::addr resourceAddress) const;
 
     void parseHeader();
     void parseResourceMapFields();
-    ReferenceListPointerPair findReferenceListPointer(const std::string& type);
-
-    std::string getResourceName(Defs::addr resourceNameAddr);
-
-    Defs::addr findResourceAddress(const std::string& type, int ID);
-    Defs::addr findResourceAddress(const std::string& type, const std::string& name);
+    bool buildIndex();
+    void loadResourceMap(const std::string& indexPath);
+    ResourceIndex::Fingerprint indexFingerprint() const;
+    const ResourceIndex::Type* findType(const std::string& type) const;
+    const ResourceIndex::Resource* findResource(const std::string& type, int ID) const;
+    const ResourceIndex::Resource* findResource(const std::string& type, const std::string& name) const;
+    const ResourceIndex::Resource* findResource(const ResourceKey& key) const;
+    ResourceInfo makeResourceInfo(const std::string& type, const ResourceIndex::Resource& resource) const;
+    void appendResourcesInfo(const ResourceIndex::Type& type, std::vector<ResourceInfo>& infos) const;
+    bool visitResources(const ResourceIndex::Type& type, const resourceVisitor& visitor, bool withSizes) const;
+
+    Defs::addr findResourceAddress(const std::string& type, int ID) const;
+    Defs::addr findResourceAddress(const std::string& type, const std::string& name) const;
+
+    Defs::addr findResourceAddress(const ResourceKey& key) const;
+    Defs::addr resourceSpanEnd(Defs::addr resourceAddress) const;
+
+    std::unique_ptr<char, freeDelete> readResourceData(Defs::addr resourceAddress, std::size_t* size) const;
+    ResourceBuffer sharedResourceData(Defs::addr resourceAddress) const;
+    std::unique_ptr<char, freeDelete> copyResourceData(Defs::addr resourceAddress, std::size_t* size) const;
+    ResourceView viewResourceData(Defs::addr resourceAddress) const;
+    bool isCompressed(Defs::addr resourceAddress) const;
+    void decompressResourceData(std::unique_ptr<char, freeDelete>& data, std::size_t* size) const;
+    ResourceBuffer expandedResourceData(Defs::addr resourceAddress) const;
 
 public:
     ResourceFork(ifstreamPointer HFSFile, Defs::addr startAddress);
+    ResourceFork(readerPointer reader, Defs::addr startAddress);
+    // Loads the index from the sidecar file at indexPath instead of parsing
+    // the map, unless the fork changed since it was saved (size,
+    // modification time, header). Then parses the map and saves it again.
+    ResourceFork(readerPointer reader, Defs::addr startAddress, const std::string& indexPath);
     ~ResourceFork();
 
+    // True if resource views are available (the file is memory-mapped).
+    bool isMemoryMapped() const;
+
     static void checkFileReadErrors(ifstreamPointer file, std::size_t bytesExpected,
                                                  const std::string& dataTryingToReadName);
 
-    std::vector<unsigned int> getResourcesIDs(const std::string& type);
-    std::vector<std::string> getResourcesNames(const std::string& type);
-
-    std::unique_ptr<char, freeDelete> getResourceData(const std::string& type, int ID, std::size_t* size);
+    std::vector<unsigned int> getResourcesIDs(const std::string& type) const;
+    std::vector<std::string> getResourcesNames(const std::string& type) const;
+
+    // Walk the index without allocating: types sorted by code, resources
+    // of each type sorted by ID. Sizes cost a read of each length field
+    // (a copy from the mapping if memory-mapped), so are only filled in
+    // if withSizes. Return false if the visitor stopped the walk.
+    bool forEachType(const typeVisitor& visitor) const;
+    bool forEachResource(const resourceVisitor& visitor, bool withSizes = false) const;
+    // Just the resources of type, true (and no visits) if there are none.
+    bool forEachResource(const std::string& type, const resourceVisitor& visitor,
+                         bool withSizes = false) const;
+
+    // Sorted by address, to read resources sequentially.
+    std::vector<ResourceInfo> getResourcesInfo() const;
+    std::vector<ResourceInfo> getResourcesInfo(const std::string& type) const;
+    // Returns false if the resource was not found.
+    bool getResourceInfo(const ResourceKey& key, ResourceInfo* info) const;
+
+    std::unique_ptr<char, freeDelete> getResourceData(const std::string& type, int ID, std::size_t* size) const;
     std::unique_ptr<char, freeDelete> getResourceData(const std::string& type,
-        const std::string& name, std::size_t* size);
+        const std::string& name, std::size_t* size) const;
+
+    // Zero-copy alternatives to getResourceData(), memory-mapped files only.
+    ResourceView getResourceView(const std::string& type, int ID) const;
+    ResourceView getResourceView(const std::string& type, const std::string& name) const;
+
+    // From getResourcesInfo(), without looking the resource up again.
+    std::unique_ptr<char, freeDelete> getResourceData(const ResourceInfo& info, std::size_t* size) const;
+    ResourceView getResourceView(const ResourceInfo& info) const;
+
+    // Streaming alternatives to getResourceData(), memory use does not
+    // grow with the size of the resource.
+    // Size of the resource data, 0 if it cannot be read.
+    std::size_t getResourceSize(const ResourceInfo& info) const;
+    // Copies up to bufferSize bytes of the resource data, starting offset
+    // bytes into it. Returns the number of bytes copied.
+    std::size_t readResource(const ResourceInfo& info, std::size_t offset, char* buffer,
+                             std::size_t bufferSize) const;
+    // Hands the resource data to sink in chunks of at most chunkSize bytes
+    // (straight from the mapping if memory-mapped). Returns the number of
+    // bytes handed over.
+    std::size_t streamResource(const ResourceInfo& info, const chunkSink& sink,
+                               std::size_t chunkSize = defaultChunkSize) const;
+    // Writes the resource data to the file outputFileDescriptor, copying
+    // inside the kernel when the reader can, by chunks otherwise.
+    // Returns false (and cerrs) on failure.
+    bool copyResourceToFile(const ResourceInfo& info, int outputFileDescriptor) const;
+
+    // Expands compressed resources (see Decompressor) in getResourceData(),
+    // getSharedResourceData(), getResourceSize(), readResource(),
+    // streamResource() and copyResourceToFile(); views and batches stay
+    // compressed. Resources that cannot be decompressed are handed out
+    // as they are (and cerr), getResourceSize() included. Off by default.
+    // Drops everything cached so far; not thread-safe.
+    void setDecompression(bool decompress);
+
+    // Keeps up to budget bytes of resource data in memory, evicting the
+    // least recently used resources, for getResourceData() and
+    // getSharedResourceData(). 0 (the default) disables the cache.
+    // Drops everything cached so far; not thread-safe.
+    void setCacheBudget(std::size_t budget);
+    // All zeros if the cache is disabled.
+    ResourceCache::Stats getCacheStats() const;
+
+    // Like getResourceData(), but cache hits are handed out without copying.
+    ResourceBuffer getSharedResourceData(const std::string& type, int ID) const;
+    ResourceBuffer getSharedResourceData(const std::string& type, const std::string& name) const;
+    ResourceBuffer getSharedResourceData(const ResourceInfo& info) const;
+
+    // Reads, allocations and time spent so far, all zeros if compiled
+    // without RESX_ENABLE_STATS. Thread-safe.
+    Stats getStats() const;
+    void resetStats();
+
+    // True if getResources() is the fastest way to read many resources:
+    // the reader keeps many reads in flight, and decompression is off
+    // (batches hand out resources as stored).
+    bool prefersBatches() const;
+
+    // Fetches many resources at once. Neighbouring resources are read
+    // together, in address order, instead of one read per resource.
+    ResourceBatch getResources(const std::vector<ResourceKey>& keys) const;
+
+    // Returns unique_ptr to requested type. Types with a RESX_SCHEMA()
+    // are decoded field by field, in the machine's byte order; others are
+    // copied as stored, swap them yourself (see Defs::makeSafeEndian()).
+    template<typename requestedType>
+    std::unique_ptr<requestedType> getResource(const std::string& type, int ID) const
+    {
+        return getResource<requestedType>(type, ID,
+            std::integral_constant<bool, Schema<requestedType>::declared>());
+    }
+
+    // Returns the resource as an array of *count big-endian numbers
+    // (sound samples, color and coordinate tables...), converted in place
+    // to the machine's byte order. Trailing bytes that do not make a whole
+    // T are dropped. nullptr (and *count 0) if the resource was not found.
+    template<typename T>
+    std::unique_ptr<T[], freeDelete> getResourceArray(const std::string& type, int ID, std::size_t* count) const
+    {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                      "getResourceArray() is for numbers, use getResource() for structs!");
+
+        std::size_t dataSize;
+        std::unique_ptr<char, freeDelete> rawData = getResourceData(type, ID, &dataSize);
+
+        if(dataSize % sizeof(T) != 0)
+        {
+            std::cerr << "Size of found resource (type: \"" << type << "\", ID: " <<
+                ID << ") is " << dataSize << " bytes, not a multiple of " << sizeof(T)
+                << " bytes! Ignoring the last " << dataSize % sizeof(T) << "." << std::endl;
+        }
+
+        // malloc()ed, so aligned for any T.
+        *count = dataSize / sizeof(T);
+        T* values = reinterpret_cast<T*>(rawData.release());
+        EndianSwapper::toMachineEndian(values, *count);
+        return std::unique_ptr<T[], freeDelete>(values);
+    }
+
+private:
+    // With a schema: read into a buffer on the stack, decode into the new T.
+    template<typename requestedType>
+    std::unique_ptr<requestedType> getResource(const std::string& type, int ID, std::true_type) const
+    {
+        constexpr std::size_t storedSize = schemaSize<requestedType>();
+
+        ResourceInfo info;
+        if(!getResourceInfo(ResourceKey(type, ID), &info))
+            return nullptr; // Error messages already sent
+
+        std::size_t dataSize = getResourceSize(info);
+        if(dataSize != storedSize)
+        {
+            std::cerr << "Size of found resource (type: \"" << type << "\", ID: " <<
+                ID << ") is " << dataSize << " bytes, when " << storedSize
+                << " bytes was expected!" << std::endl;
+        }
+
+        // Missing bytes decode as zeros.
+        char data[storedSize] = {};
+        readResource(info, 0, data, storedSize);
+
+        std::unique_ptr<requestedType> resource(new requestedType());
+        Schema<requestedType>::fields::decode(data, *resource);
+        return resource;
+    }
 
-    // Returns unique_ptr to requested type.
+    // Without: copy the bytes over T.
     template<typename requestedType>
-    std::unique_ptr<requestedType> getResource(const std::string& type, int ID)
+    std::unique_ptr<requestedType> getResource(const std::string& type, int ID, std::false_type) const
     {
         std::size_t dataSize;
         std::unique_ptr<char, freeDelete> rawData = getResourceData(type, ID, &dataSize);
@@ -0,0 +1,92 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_RESOURCE_FORK_WRITER_HPP
+#define RESX_RESOURCE_FORK_WRITER_HPP
+
+#include "RESX/ResourceFork.hpp"
+
+#include <cstddef> // For std::size_t
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace RESX
+{
+
+// Builds a resource fork: header, data zone, then the map (type list,
+// reference lists, name list). Resources are only collected until write(),
+// which lays everything out in one pass, so streamed data is never held
+// in memory.
+// Types are written sorted by code, the resources of each type sorted by
+// ID, and the data zone in that same order: reading the resources of a
+// type in ID order reads the file sequentially.
+class ResourceForkWriter
+{
+public:
+    // Hands the data of a resource to sink, in as many chunks as it likes.
+    // Must deliver exactly the size given to addResource(), or return false.
+    using dataProducer = std::function<bool(const ResourceFork::chunkSink& sink)>;
+
+private:
+    struct Entry
+    {
+        uint32_t typeCode;
+        uint16_t ID;
+        std::string name; // Empty if unnamed
+        uint8_t attributes;
+        std::size_t size;
+        dataProducer producer;
+    };
+
+    std::vector<Entry> mEntries;
+
+public:
+    ResourceForkWriter();
+    ~ResourceForkWriter();
+
+    // Returns false (and cerrs) if the type is not four chars long, the ID
+    // is outside -32768 to 32767, the name is longer than 255 chars, or a
+    // resource with the same type and ID was already added.
+    // Copies data.
+    bool addResource(const std::string& type, int ID, const std::string& name, uint8_t attributes,
+                     const char* data, std::size_t size);
+    // Calls producer during write().
+    bool addResource(const std::string& type, int ID, const std::string& name, uint8_t attributes,
+                     std::size_t size, dataProducer producer);
+    // Every resource of resourceFork, streamed from it during write().
+    // resourceFork must outlive this writer. With its decompression on,
+    // resources it expands are written expanded, without the compressed
+    // attribute; the others as stored.
+    bool addResources(const ResourceFork& resourceFork);
+
+    std::size_t resourceCount() const;
+
+    // Written to a temporary file, then renamed to path, so path may be
+    // the file the resources are read from.
+    // Returns false (and cerrs) if the resources do not fit the format
+    // (16 MiB of data, 64 KiB of map) or writing fails.
+    bool write(const std::string& path) const;
+
+    // Rewrites resourceFork to path without dead space, with the data
+    // zone in the order of the reference lists.
+    static bool compact(const ResourceFork& resourceFork, const std::string& path);
+};
+
+} // namespace RESX
+#endif // RESX_RESOURCE_FORK_WRITER_HPP
@@ -0,0 +1,186 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_RESOURCE_INDEX_HPP
+#define RESX_RESOURCE_INDEX_HPP
+
+#include "Defs.hpp"
+#include "Reader.hpp"
+
+#include <cstdint>
+#include <cstddef> // For std::size_t
+#include <memory> // For smart pointers
+#include <string>
+#include <vector>
+
+namespace RESX
+{
+
+// Flat copy of a resource map, built once so lookups never touch the file.
+// Types are sorted by code, and the resources of each type are stored
+// contiguously, sorted by ID. IDs are signed 16-bit on disk, so they
+// are ordered as signed: negative IDs come first. Both are found by
+// binary search.
+// Names are decoded once into a single buffer, and each type has an
+// open-addressing hash table over them for name lookups.
+// All tables live in one flat image, which can be saved as a sidecar
+// file and later memory-mapped as is instead of parsing the map again.
+class ResourceIndex
+{
+public:
+    struct Type
+    {
+        uint32_t code; // Four-char code, big-endian packed ('snd ' = 0x736E6420)
+        uint32_t firstResource; // Index of the first resource of this type
+        uint32_t resourceCount;
+        uint32_t firstNameSlot; // Index of this type's hash table in the slots
+        uint32_t nameSlotCount; // Power of two, 0 if no resource has a name
+    };
+
+    struct Resource
+    {
+        uint32_t dataOffset; // From the start of the resource data zone
+        uint32_t nameStart; // Index of the decoded name in the names buffer
+        uint16_t ID;
+        uint16_t nameOffset; // From the start of the name list, noName if none
+        uint8_t attributes;
+        uint8_t nameLength;
+    };
+
+    static const uint16_t noName = 0xFFFF;
+
+    // What a sidecar was made from. If any of it changed, the sidecar is stale.
+    struct Fingerprint
+    {
+        uint64_t sourceSize;
+        int64_t sourceModificationTime; // Reader::modificationTime()
+        uint64_t forkStart;
+        // Resource fork header
+        uint64_t dataZoneOffset;
+        uint64_t mapOffset;
+        uint64_t dataLength;
+        uint64_t mapLength;
+    };
+
+private:
+    // Start of the image (and of sidecar files). Native byte order:
+    // a sidecar is a cache for the machine that wrote it.
+    struct ImageHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrderMark;
+        Fingerprint fingerprint;
+        uint64_t imageSize;
+        uint32_t typeCount;
+        uint32_t resourceCount;
+        uint32_t namesLength;
+        uint32_t nameSlotCount;
+        uint32_t dataOffsetCount;
+        uint32_t reserved;
+        // From the start of the image, 8-byte aligned.
+        uint64_t typesOffset;
+        uint64_t resourcesOffset;
+        uint64_t namesOffset;
+        uint64_t nameSlotsOffset;
+        uint64_t dataOffsetsOffset;
+    };
+
+    // The tables, back to back after the header. Either built here,
+    // or mapped from a sidecar (mImage is empty then).
+    std::vector<uint64_t> mImage; // uint64_t for alignment
+    std::shared_ptr<Reader> mSidecar;
+
+    // Only used while building, then packed into the image.
+    std::vector<Type> mTypes;
+    std::vector<Resource> mResources;
+
+    // All names, back to back (not null-terminated).
+    std::string mNames;
+    // Hash tables of all types, back to back. Each slot holds the index
+    // of a resource + 1, or 0 if empty. Linear probing.
+    std::vector<uint32_t> mNameSlots;
+    // Data offsets of all resources, sorted, without duplicates.
+    std::vector<uint32_t> mDataOffsets;
+
+    static uint32_t hashName(const char* name, std::size_t length);
+    bool parseMap(const char* map, std::size_t mapLength, std::size_t typeListOffset,
+                  std::size_t nameListOffset);
+    bool decodeNames(const char* nameList, std::size_t nameListLength);
+    void buildNameSlots(Type& type);
+    void pack();
+    static bool checkTables(const char* image);
+
+    const char* image() const;
+    const ImageHeader& header() const;
+    const Type* typeTable() const;
+    const Resource* resourceTable() const;
+    const char* nameTable() const;
+    const uint32_t* nameSlotTable() const;
+    const uint32_t* dataOffsetTable() const;
+
+public:
+    ResourceIndex();
+    ~ResourceIndex();
+
+    // Builds the index from the whole resource map, which must be in memory.
+    // typeListOffset and nameListOffset are relative to the start of the map.
+    // Returns false (and cerrs) if the map is malformed.
+    bool build(const char* map, std::size_t mapLength, std::size_t typeListOffset,
+               std::size_t nameListOffset);
+
+    // Maps the index saved at sidecarPath. Returns false, leaving the index
+    // untouched, if there is none, it does not match fingerprint, or its
+    // tables would send lookups outside of them. Checking them is a single
+    // pass over the mapping, with no parsing or allocation.
+    bool load(const std::string& sidecarPath, const Fingerprint& fingerprint);
+    // Written to a temporary file first, then renamed over sidecarPath,
+    // so that concurrent loaders never see a partial file.
+    // Returns false (and cerrs) on failure.
+    bool save(const std::string& sidecarPath, const Fingerprint& fingerprint) const;
+
+    static uint32_t typeCode(const std::string& type);
+    static std::string typeString(uint32_t code);
+
+    // Returns nullptr if not found.
+    const Type* findType(const std::string& type) const;
+    const Resource* findResource(const Type& type, uint16_t ID) const;
+    // If several resources share a name, returns the one with the lowest ID.
+    const Resource* findResource(const Type& type, const std::string& name) const;
+
+    // Empty if the resource has no name.
+    std::string name(const Resource& resource) const;
+    // The same without copying: resource.nameLength bytes, not
+    // null-terminated. nullptr if the resource has no name.
+    const char* nameData(const Resource& resource) const;
+
+    // All types, sorted by code, are [begin, end).
+    const Type* typesBegin() const;
+    const Type* typesEnd() const;
+
+    // The smallest data offset of any resource past dataOffset, which is
+    // where the data of the resource at dataOffset ends at the latest.
+    // Returns false if it is the last one in the data zone.
+    bool nextDataOffset(uint32_t dataOffset, uint32_t* next) const;
+
+    // The resources of a type, sorted by ID, are [begin, end).
+    const Resource* resourcesBegin(const Type& type) const;
+    const Resource* resourcesEnd(const Type& type) const;
+};
+
+} // namespace RESX
+#endif // RESX_RESOURCE_INDEX_HPP
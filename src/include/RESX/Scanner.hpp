@@ -0,0 +1,97 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_SCANNER_HPP
+#define RESX_SCANNER_HPP
+
+#include "RESX/Defs.hpp"
+#include "RESX/Reader.hpp"
+#include "RESX/ResourceFork.hpp"
+
+#include <cstdint>
+#include <cstddef> // For std::size_t
+#include <memory> // For smart pointers
+#include <string>
+#include <vector>
+
+namespace RESX
+{
+
+// A resource fork found by Scanner.
+struct FoundFork
+{
+    Defs::addr offset; // Start of the fork header in the image
+    Defs::addr size; // Up to the end of the data or the map, whichever is last
+    uint32_t typeCount;
+    uint32_t resourceCount;
+};
+
+// Carves resource forks out of a raw image (a disk with a damaged or
+// missing catalog, say) without knowing where they start.
+// The image is read in large chunks, one after the other, by every
+// thread. Each chunk is prefiltered 16 bytes at a time (SSE2) for
+// headers whose data offset and map length fit in 24 bits, as real
+// ones do. Headers that also make sense on their own are
+// then checked against their map: type list, reference lists and name
+// offsets must all lie where the header says.
+class Scanner
+{
+private:
+    std::shared_ptr<Reader> mReader;
+    unsigned int mThreadCount;
+    std::size_t mAlignment;
+    std::size_t mChunkSize;
+
+    // Offsets in [0, count) of data (+ 32 readable bytes) that are
+    // multiples of alignment and pass the prefilter.
+    static void prefilter(const char* data, std::size_t count, std::size_t alignment,
+                          std::vector<std::size_t>& candidates);
+
+    bool checkHeader(const char* header, Defs::addr offset, FoundFork* fork) const;
+    bool checkMap(Defs::addr offset, const char* header, FoundFork* fork) const;
+    void scanChunk(Defs::addr start, std::vector<char>& buffer, std::vector<std::size_t>& candidates,
+                   std::vector<FoundFork>& forks) const;
+
+public:
+    static const std::size_t defaultChunkSize = 1UL << 23; // 8 MiB
+
+    // Positional reads: the image can be much larger than memory.
+    Scanner(const std::string& fileName);
+    Scanner(std::shared_ptr<Reader> reader);
+    ~Scanner();
+
+    bool isOpen() const;
+
+    // threadCount of 0 uses one thread per core. 1 by default.
+    void setThreadCount(unsigned int threadCount);
+    // Only look for forks starting at multiples of alignment, which must be
+    // a power of two: 512 finds the forks of HFS volumes (allocation
+    // blocks are multiples of 512 bytes), 128 those of MacBinary files.
+    // 1 (the default) finds them anywhere.
+    void setAlignment(std::size_t alignment);
+    // Bytes read at once by each thread, rounded up to the alignment.
+    void setChunkSize(std::size_t chunkSize);
+
+    // Every fork found, by offset. A fork stored inside another one
+    // (in a resource of it) is found too.
+    std::vector<FoundFork> scan() const;
+
+    ResourceFork loadResourceFork(const FoundFork& fork) const;
+};
+
+} // namespace RESX
+#endif // RESX_SCANNER_HPP
@@ -0,0 +1,172 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_SCHEMA_HPP
+#define RESX_SCHEMA_HPP
+
+#include "Defs.hpp"
+
+#include <cstddef> // For std::size_t
+#include <cstring> // For std::memcpy
+#include <type_traits>
+
+// Declares the layout of a resource struct, as stored: big-endian,
+// packed, fields in order. ResourceFork::getResource<T>() then decodes
+// it straight into T, swapping every field, instead of copying the raw
+// bytes over T. Use at global scope, after the struct:
+//
+//   struct Point { int16_t v; int16_t h; };
+//   RESX_SCHEMA(Point, RESX_FIELD(Point, v), RESX_FIELD(Point, h));
+//
+// Fields can be 1, 2, 4 or 8-byte numbers (floats and enums included),
+// arrays of them, or structs that have a schema of their own. Padding
+// in T does not matter, only the fields listed are written.
+#define RESX_FIELD(Struct, member) \
+    RESX::Field<Struct, decltype(Struct::member), &Struct::member>
+
+#define RESX_SCHEMA(Struct, ...) \
+    namespace RESX \
+    { \
+    template<> struct Schema<Struct> \
+    { \
+        static constexpr bool declared = true; \
+        using fields = Fields<__VA_ARGS__>; \
+    }; \
+    }
+
+namespace RESX
+{
+
+// Specialized by RESX_SCHEMA().
+template<typename T>
+struct Schema
+{
+    static constexpr bool declared = false;
+};
+
+// How one value is stored. Sizes are functions rather than constants,
+// so that they can be printed without being defined out of class.
+template<typename T, typename Enable = void>
+struct FieldCodec;
+
+// Numbers, floats and enums: swapped if the machine is little-endian.
+template<typename T>
+struct FieldCodec<T, typename std::enable_if<std::is_arithmetic<T>::value ||
+                                             std::is_enum<T>::value>::type>
+{
+    static constexpr std::size_t size() { return sizeof(T); }
+
+    static void decode(const char* data, T& value)
+    {
+        using Unsigned = typename Defs::UnsignedOfSize<sizeof(T)>::type;
+
+        Unsigned bits;
+        std::memcpy(&bits, data, sizeof(T));
+        bits = Defs::makeSafeEndian(bits);
+        std::memcpy(&value, &bits, sizeof(T));
+    }
+};
+
+// Arrays: elements one after the other.
+template<typename T, std::size_t count>
+struct FieldCodec<T[count]>
+{
+    static constexpr std::size_t size() { return count * FieldCodec<T>::size(); }
+
+    static void decode(const char* data, T (&values)[count])
+    {
+        for(std::size_t i = 0; i < count; i++)
+            FieldCodec<T>::decode(data + i * FieldCodec<T>::size(), values[i]);
+    }
+};
+
+// Nested structs with a schema of their own.
+template<typename T>
+struct FieldCodec<T, typename std::enable_if<Schema<T>::declared>::type>
+{
+    static constexpr std::size_t size() { return Schema<T>::fields::size(); }
+
+    static void decode(const char* data, T& value)
+    {
+        Schema<T>::fields::decode(data, value);
+    }
+};
+
+// A member of Struct, see RESX_FIELD().
+template<typename Struct, typename Member, Member Struct::* member>
+struct Field
+{
+    static constexpr std::size_t size() { return FieldCodec<Member>::size(); }
+
+    static void decode(const char* data, Struct& object)
+    {
+        FieldCodec<Member>::decode(data, object.*member);
+    }
+};
+
+// The fields of a struct, in the order they are stored. decode() is
+// unrolled at compile time: every offset is a constant.
+template<typename... F>
+struct Fields;
+
+template<>
+struct Fields<>
+{
+    static constexpr std::size_t size() { return 0; }
+
+    template<typename Struct>
+    static void decode(const char*, Struct&)
+    {
+
+    }
+};
+
+template<typename First, typename... Rest>
+struct Fields<First, Rest...>
+{
+    static constexpr std::size_t size() { return First::size() + Fields<Rest...>::size(); }
+
+    template<typename Struct>
+    static void decode(const char* data, Struct& object)
+    {
+        First::decode(data, object);
+        Fields<Rest...>::decode(data + First::size(), object);
+    }
+};
+
+// Stored size of T, which needs a schema.
+template<typename T>
+constexpr std::size_t schemaSize()
+{
+    static_assert(Schema<T>::declared, "No RESX_SCHEMA() for this type!");
+    return Schema<T>::fields::size();
+}
+
+// Decodes T from stored bytes (a view, a batch, a buffer...).
+// Returns false, leaving object untouched, if size is too small.
+template<typename T>
+bool decodeSchema(const char* data, std::size_t size, T& object)
+{
+    if(size < schemaSize<T>())
+        return false;
+
+    Schema<T>::fields::decode(data, object);
+    return true;
+}
+
+} // namespace RESX
+#endif // RESX_SCHEMA_HPP
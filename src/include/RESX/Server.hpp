@@ -0,0 +1,106 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_SERVER_HPP
+#define RESX_SERVER_HPP
+
+#include "RESX/File.hpp"
+#include "RESX/Protocol.hpp"
+#include "RESX/ResourceFork.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory> // For smart pointers
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace RESX
+{
+
+// Serves lookups and extractions (see Protocol) over a Unix domain
+// socket, keeping every resource fork it opened, and its index, for
+// the next requests. One thread per connection, so clients should keep
+// theirs open.
+// Data is sent in the reply up to Protocol::inlineDataLimit. Larger
+// data stored as is in the file is handed over as a descriptor of the
+// file itself, for the client to map; anything else (decompressed) is
+// written to a memory file first, on Linux, or sent in the reply.
+// Only files under the root directory are served (relative paths are
+// relative to it), and only to processes of the same user, or root:
+// descriptors give access to the whole file.
+class Server
+{
+private:
+    struct OpenFork
+    {
+        File file;
+        ResourceFork resourceFork;
+        int fileDescriptor; // Of the file, -1 if it could not be opened
+        bool decompress;
+
+        OpenFork(const std::string& path, unsigned int blockSize, unsigned int startBlock, bool decompress);
+        ~OpenFork();
+    };
+
+    std::string mSocketPath;
+    std::string mRootDirectory; // Resolved, without a trailing '/'
+    int mListeningSocket;
+    std::atomic<bool> mStopping;
+    // Written to by stop() to wake run() up, self-pipe style.
+    int mWakePipe[2];
+
+    // Key: path, block size, start block and decompression.
+    std::mutex mForksMutex;
+    std::map<std::string, std::shared_ptr<OpenFork>> mForks;
+
+    // Open connections, to shut them down when stopping.
+    std::mutex mConnectionsMutex;
+    std::condition_variable mConnectionsClosed;
+    std::set<int> mConnections;
+
+    static bool isPeerAllowed(int socket);
+    bool resolvePath(const std::string& path, std::string* resolvedPath) const;
+    std::shared_ptr<OpenFork> openFork(const Protocol::Request& request, const std::string& path);
+    void serveConnection(int socket);
+    bool serveRequest(int socket, const Protocol::Request& request, const std::string& path,
+                      const std::string& name, std::vector<char>& buffer);
+    bool sendData(int socket, Protocol::Reply& reply, const OpenFork& openFork, const ResourceInfo& info,
+                  std::vector<char>& buffer);
+
+public:
+    // Listens at socketPath, replacing what is there (a socket left behind),
+    // serving the files under rootDirectory.
+    Server(const std::string& socketPath, const std::string& rootDirectory);
+    // Removes the socket.
+    ~Server();
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    bool isListening() const;
+
+    // Serves until stop(), then waits for the connections to close.
+    void run();
+    // Async-signal-safe, can be called from a signal handler.
+    void stop();
+};
+
+} // namespace RESX
+#endif // RESX_SERVER_HPP
@@ -0,0 +1,165 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_STATS_HPP
+#define RESX_STATS_HPP
+
+#include "Defs.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef> // For std::size_t
+#include <cstdint>
+#include <string>
+
+/* Global defines */
+
+// Define when building the library to count reads, allocations and time
+// spent per phase in every ResourceFork (CMake option RESX_ENABLE_STATS,
+// off by default). Undefined, the counting is compiled out: the counters
+// stay at zero, and cost nothing.
+// #define RESX_ENABLE_STATS
+
+#ifdef RESX_ENABLE_STATS
+    #define RESX_STATS_COUNT_READ(counters, offset, bytes) (counters).countRead((offset), (bytes))
+    #define RESX_STATS_COUNT_ALLOCATION(counters, bytes) (counters).countAllocation(bytes)
+    #define RESX_STATS_TIME_PHASE(counters, phase) PhaseTimer phaseTimer((counters).phase)
+#else
+    #define RESX_STATS_COUNT_READ(counters, offset, bytes) ((void)0)
+    #define RESX_STATS_COUNT_ALLOCATION(counters, bytes) ((void)0)
+    #define RESX_STATS_TIME_PHASE(counters, phase) ((void)0)
+#endif
+
+/* *** */
+
+namespace RESX
+{
+
+// What a resource fork cost so far.
+struct Stats
+{
+    struct Phase
+    {
+        uint64_t calls;
+        uint64_t nanoseconds; // Wall time
+    };
+
+    // As the library was built, whatever the includer defines.
+    static const bool enabled;
+
+    // Reads not starting where the previous one ended.
+    uint64_t seeks;
+    // Including copies done inside the kernel.
+    uint64_t readCalls;
+    uint64_t bytesRead;
+    // Buffers allocated for resource data and the map.
+    uint64_t allocations;
+    uint64_t bytesAllocated;
+
+    Phase parseHeader;
+    // Also covers indexing the map, or loading the sidecar index instead.
+    Phase parseResourceMapFields;
+    Phase lookup;
+    Phase payloadRead;
+
+    Stats();
+
+    Stats& operator+=(const Stats& other);
+
+    // One "name: value" per line.
+    std::string toText() const;
+    // A single JSON object.
+    std::string toJSON() const;
+};
+
+// Counters behind Stats, safe to bump from several threads at once.
+// Copies take a snapshot of the counts.
+class StatsCounters
+{
+public:
+    struct Phase
+    {
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> nanoseconds;
+
+        Phase();
+    };
+
+    std::atomic<uint64_t> seeks;
+    std::atomic<uint64_t> readCalls;
+    std::atomic<uint64_t> bytesRead;
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> bytesAllocated;
+    // Where the last read ended, to tell seeks apart.
+    std::atomic<uint64_t> lastReadEnd;
+
+    Phase parseHeader;
+    Phase parseResourceMapFields;
+    Phase lookup;
+    Phase payloadRead;
+
+    StatsCounters();
+    StatsCounters(const StatsCounters& other);
+    StatsCounters& operator=(const StatsCounters& other);
+
+    void countRead(Defs::addr offset, std::size_t bytes)
+    {
+        if(lastReadEnd.exchange(offset + bytes, std::memory_order_relaxed) != offset)
+            seeks.fetch_add(1, std::memory_order_relaxed);
+
+        readCalls.fetch_add(1, std::memory_order_relaxed);
+        bytesRead.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void countAllocation(std::size_t bytes)
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        bytesAllocated.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    Stats snapshot() const;
+    void reset();
+};
+
+// Adds the time from construction to destruction to a phase.
+class PhaseTimer
+{
+private:
+    using clock = std::chrono::steady_clock;
+
+    StatsCounters::Phase& mPhase;
+    clock::time_point mStart;
+
+public:
+    PhaseTimer(StatsCounters::Phase& phase)
+        : mPhase(phase),
+        mStart(clock::now())
+    {
+
+    }
+
+    ~PhaseTimer()
+    {
+        uint64_t elapsed = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - mStart).count());
+        mPhase.calls.fetch_add(1, std::memory_order_relaxed);
+        mPhase.nanoseconds.fetch_add(elapsed, std::memory_order_relaxed);
+    }
+};
+
+} // namespace RESX
+#endif // RESX_STATS_HPP
@@ -0,0 +1,54 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_STREAM_READER_HPP
+#define RESX_STREAM_READER_HPP
+
+#include "Reader.hpp"
+
+#include <fstream>
+#include <memory> // For smart pointers
+#include <mutex>
+
+namespace RESX
+{
+
+// Reads through a std::ifstream, seeking for every read.
+// Since the stream has a single cursor, reads are serialized by a lock.
+// Prefer PositionalReader, this is for streams you already have.
+class StreamReader : public Reader
+{
+public:
+    // Type aliases
+    using ifstreamPointer = std::shared_ptr<std::ifstream>;
+
+private:
+    ifstreamPointer mFile;
+    Defs::addr mSize;
+    mutable std::mutex mFileMutex;
+
+public:
+    StreamReader(ifstreamPointer file);
+    ~StreamReader();
+
+    bool isOpen() const override;
+    Defs::addr size() const override;
+    std::size_t readAt(Defs::addr offset, char* destination, std::size_t size) const override;
+};
+
+} // namespace RESX
+#endif // RESX_STREAM_READER_HPP
@@ -0,0 +1,79 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_THREAD_POOL_HPP
+#define RESX_THREAD_POOL_HPP
+
+#include <cstddef> // For std::size_t
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory> // For smart pointers
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RESX
+{
+
+// Fixed set of worker threads, each with its own task queue.
+// A worker runs the tasks of its own queue front to back, and when it
+// runs dry, steals from the back of the other queues. Submitting
+// neighbouring tasks to the same worker thus keeps them together unless
+// another worker is idle.
+class ThreadPool
+{
+private:
+    struct Worker
+    {
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::vector<std::thread> mThreads;
+
+    // Guards the counters below, and is what idle threads sleep on.
+    std::mutex mStateMutex;
+    std::condition_variable mWorkAvailable;
+    std::condition_variable mAllDone;
+    std::size_t mQueuedTasks;
+    std::size_t mUnfinishedTasks;
+    bool mStopping;
+
+    bool popTask(std::size_t workerIndex, std::function<void()>& task);
+    void workerLoop(std::size_t workerIndex);
+
+public:
+    // threadCount of 0 uses the number of hardware threads.
+    ThreadPool(unsigned int threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::size_t threadCount() const;
+
+    // Queues task on the given worker (modulo the thread count).
+    void submit(std::size_t workerIndex, std::function<void()> task);
+
+    // Blocks until every submitted task has finished.
+    void wait();
+};
+
+} // namespace RESX
+#endif // RESX_THREAD_POOL_HPP
@@ -0,0 +1,79 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_URING_READER_HPP
+#define RESX_URING_READER_HPP
+
+#include "Reader.hpp"
+#include "PositionalReader.hpp"
+
+#include <memory> // For smart pointers
+#include <mutex>
+#include <string>
+
+namespace RESX
+{
+
+// Reads batches through a Linux io_uring: up to queueDepth reads in
+// flight at once, into buffers registered with the kernel once (then
+// copied to their destination). With directIO, the file is opened with
+// O_DIRECT and reads are widened to aligned blocks, so cold scans do not
+// fill the page cache.
+// Single reads (readAt()) and copyToFile() stay positional reads, which
+// are faster for one read at a time and can run from several threads.
+// Batches are submitted one at a time. Reads the ring fails are done
+// again as positional reads.
+class UringReader : public Reader
+{
+private:
+    // Ring, its file descriptor and registered buffers. Linux only.
+    struct Ring;
+
+    PositionalReader mPositional;
+    std::unique_ptr<Ring> mRing;
+    mutable std::mutex mRingMutex; // Guards mRing
+
+    UringReader(const std::string& fileName, bool directIO, unsigned int queueDepth);
+
+    bool setUpRing(const std::string& fileName, bool directIO, unsigned int queueDepth);
+    void tearDownRing();
+
+public:
+    // Type aliases
+    using readerPointer = std::shared_ptr<Reader>;
+
+    ~UringReader();
+
+    // No copies, we own the ring.
+    UringReader(const UringReader&) = delete;
+    UringReader& operator=(const UringReader&) = delete;
+
+    // A UringReader, or a PositionalReader if io_uring is not available
+    // (not Linux, too old a kernel, disabled or forbidden).
+    static readerPointer open(const std::string& fileName, bool directIO = false, unsigned int queueDepth = 32);
+
+    bool isOpen() const override;
+    Defs::addr size() const override;
+    int64_t modificationTime() const override;
+    std::size_t readAt(Defs::addr offset, char* destination, std::size_t size) const override;
+    void readBatch(ReadRequest* requests, std::size_t count) const override;
+    bool prefersBatches() const override;
+    std::size_t copyToFile(Defs::addr offset, std::size_t size, int outputFileDescriptor) const override;
+};
+
+} // namespace RESX
+#endif // RESX_URING_READER_HPP
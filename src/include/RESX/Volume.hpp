@@ -0,0 +1,97 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESX_VOLUME_HPP
+#define RESX_VOLUME_HPP
+
+#include "RESX/File.hpp"
+#include "RESX/ExtentReader.hpp"
+#include "RESX/ResourceFork.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace RESX
+{
+
+// A file of an HFS+ volume that has a resource fork.
+struct VolumeFile
+{
+    uint32_t fileID; // Catalog node ID
+    uint32_t parentID;
+    std::string path; // UTF-8, from the root folder: "/System Folder/Finder"
+    Defs::addr resourceForkSize;
+    std::vector<Extent> resourceForkExtents; // Including overflow extents
+};
+
+// An HFS+ (or HFSX) volume image, starting at offset 0 of the file.
+// Finds resource forks by walking the catalog B-tree, so no start
+// blocks are needed.
+class Volume
+{
+private:
+    // A B-tree file (catalog or extents overflow) and its geometry.
+    struct BTree
+    {
+        std::shared_ptr<ExtentReader> reader;
+        uint32_t nodeSize;
+        uint32_t totalNodes;
+        std::vector<unsigned char> nodeBitmap; // Which nodes are in use
+    };
+
+    // First: start block within the fork (fork order).
+    // Second: the extents of the overflow record.
+    using OverflowRecord = std::pair<uint32_t, std::vector<Extent>>;
+
+    File mFile;
+    bool mValid;
+    uint32_t mBlockSize;
+
+    std::vector<Extent> mCatalogExtents;
+    Defs::addr mCatalogSize;
+    std::vector<Extent> mExtentsOverflowExtents;
+    Defs::addr mExtentsOverflowSize;
+
+    // Key: fork type (0x00 data, 0xFF resource) << 32 | file ID.
+    std::map<uint64_t, std::vector<OverflowRecord>> mOverflowExtents;
+
+    bool parseVolumeHeader();
+    bool openBTree(const std::vector<Extent>& extents, Defs::addr size, BTree& tree);
+    void forEachLeafRecord(const BTree& tree,
+                           const std::function<void(const char* record, std::size_t length)>& callback);
+    void loadOverflowExtents();
+    void appendOverflowExtents(uint8_t forkType, uint32_t fileID, uint32_t totalBlocks,
+                               std::vector<Extent>& extents) const;
+
+public:
+    Volume(const std::string& fileName, bool memoryMap = true);
+    ~Volume();
+
+    bool isValid() const;
+    unsigned int getBlockSize() const;
+
+    // Every file with a non-empty resource fork, in catalog order.
+    std::vector<VolumeFile> findResourceForks();
+
+    ResourceFork loadResourceFork(const VolumeFile& volumeFile);
+};
+
+} // namespace RESX
+#endif // RESX_VOLUME_HPP
@@ -21,7 +21,33 @@
 #define RES_EXTRACTOR_HPP
 
 #include "RESX/Defs.hpp"
+#include "RESX/Decoder.hpp"
+#include "RESX/EndianSwapper.hpp"
 #include "RESX/File.hpp"
+#include "RESX/Reader.hpp"
+#include "RESX/MappedReader.hpp"
+#include "RESX/PositionalReader.hpp"
+#include "RESX/ExtentReader.hpp"
+#include "RESX/StreamReader.hpp"
+#include "RESX/UringReader.hpp"
+#include "RESX/ResourceIndex.hpp"
+#include "RESX/ResourceCache.hpp"
+#include "RESX/Decompressor.hpp"
+#include "RESX/Schema.hpp"
+#include "RESX/Stats.hpp"
 #include "RESX/ResourceFork.hpp"
+#include "RESX/ResourceForkWriter.hpp"
+#include "RESX/Volume.hpp"
+#include "RESX/Scanner.hpp"
+#include "RESX/ThreadPool.hpp"
+#include "RESX/Extractor.hpp"
+#include "RESX/ManifestExtractor.hpp"
+#include "RESX/Dumper.hpp"
+
+#ifndef _WIN32
+#include "RESX/Protocol.hpp"
+#include "RESX/Server.hpp"
+#include "RESX/Client.hpp"
+#endif
 
 #endif // RES_EXTRACTOR_HPP
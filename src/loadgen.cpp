@@ -0,0 +1,348 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+// Sends lookups or extractions of random resources to a running server
+// (ResExtractorCmdLine -serve) over several connections, and reports
+// latency percentiles as JSON. For comparison, also times doing the same
+// without a server: opening the file and parsing the map every time.
+
+#include "ResExtractor.hpp"
+
+#include <algorithm> // For find() and sort()
+#include <atomic>
+#include <chrono>
+#include <cstddef> // For size_t
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using Big = long long int;
+using loadClock = std::chrono::steady_clock;
+
+struct LoadResult
+{
+    std::string name;
+    std::string unit;
+    double value;
+    Big operations;
+};
+
+void printHelp()
+{
+    std::cout <<
+        "Measures the latency of a ResExtractor server (ResExtractorCmdLine -serve)." << std::endl <<
+        std::endl <<
+        "Usage: ResExtractorLoad -socket SOCKET_FILE -input INPUT_FILE [-blocksize BYTES] [-startblock BLOCK]" << std::endl <<
+        "   [-operation lookup|extract] [-decompress] [-requests N] [-connections N] [-cold N] [-seed N]" << std::endl <<
+        "   [-output RESULTS_FILE]" << std::endl <<
+        std::endl <<
+        " --help, --h                 display help" << std::endl <<
+        std::endl <<
+        " -blocksize                  set block size in bytes, 4 KiB by default" << std::endl <<
+        " -cold                       number of requests to time without the server, 20 by default" << std::endl <<
+        " -connections                number of connections sending requests at once, 1 by default" << std::endl <<
+        " -decompress                 ask for compressed resources to be expanded" << std::endl <<
+        " -input                      set resource fork file to request resources of (.hfs or .rsrc)" << std::endl <<
+        " -operation                  lookup or extract (default)" << std::endl <<
+        " -output                     write JSON results to file, printed to cmdline if unspecified" << std::endl <<
+        " -requests                   number of requests over all connections, 10000 by default" << std::endl <<
+        " -seed                       random seed, 1 by default" << std::endl <<
+        " -socket                     set socket the server listens at" << std::endl <<
+        " -startblock                 set first block of resource fork, 0 by default" << std::endl;
+}
+
+double secondsSince(loadClock::time_point start)
+{
+    return std::chrono::duration<double>(loadClock::now() - start).count();
+}
+
+// Of sorted latencies.
+double percentile(const std::vector<double>& latencies, double fraction)
+{
+    if(latencies.empty())
+        return 0.0;
+
+    std::size_t index = static_cast<std::size_t>(fraction * (latencies.size() - 1) + 0.5);
+    return latencies[index];
+}
+
+void addLatencies(std::vector<LoadResult>& results, const std::string& prefix, std::vector<double>& latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    Big count = static_cast<Big>(latencies.size());
+    results.push_back({prefix + "_p50", "us", percentile(latencies, 0.50), count});
+    results.push_back({prefix + "_p90", "us", percentile(latencies, 0.90), count});
+    results.push_back({prefix + "_p99", "us", percentile(latencies, 0.99), count});
+    results.push_back({prefix + "_max", "us", latencies.empty() ? 0.0 : latencies.back(), count});
+}
+
+std::string escapeJSON(const std::string& text)
+{
+    std::string escaped;
+    for(char c : text)
+    {
+        if(c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+
+    return escaped;
+}
+
+int main(int argc, char **argv)
+{
+    // Terminal command, pointer to value to modify, textual type name.
+    using argDefinitionTuple = std::tuple<std::string, void*, std::string>;
+    using argDefinitionVector = std::vector<argDefinitionTuple>;
+
+    std::string socketPath;
+    std::string inputFile;
+    std::string operation = "extract";
+    std::string outputFile;
+    Big blockSize = 4096LL;
+    Big startBlock = 0LL;
+    Big requestCount = 10000LL;
+    Big connectionCount = 1LL;
+    Big coldCount = 20LL;
+    Big seed = 1LL;
+    bool decompress = false;
+
+    argDefinitionVector argDefinitions = {
+                    argDefinitionTuple("--help", nullptr, "printHelp()"),
+                    argDefinitionTuple("--h", nullptr, "printHelp()"),
+
+                    argDefinitionTuple("-blocksize", &blockSize, "Big"),
+                    argDefinitionTuple("-cold", &coldCount, "Big"),
+                    argDefinitionTuple("-connections", &connectionCount, "Big"),
+                    argDefinitionTuple("-decompress", &decompress, "bool"),
+                    argDefinitionTuple("-input", &inputFile, "std::string"),
+                    argDefinitionTuple("-operation", &operation, "std::string"),
+                    argDefinitionTuple("-output", &outputFile, "std::string"),
+                    argDefinitionTuple("-requests", &requestCount, "Big"),
+                    argDefinitionTuple("-seed", &seed, "Big"),
+                    argDefinitionTuple("-socket", &socketPath, "std::string"),
+                    argDefinitionTuple("-startblock", &startBlock, "Big"),
+    };
+
+    std::vector<std::string> args(argv, argv+argc);
+    for(argDefinitionTuple argDefinition : argDefinitions)
+    {
+        std::string command = std::get<0>(argDefinition);
+        void* associatedVariable = std::get<1>(argDefinition);
+        std::string textualType = std::get<2>(argDefinition);
+
+        auto foundStringIt = std::find(args.begin(), args.end(), command);
+        if(foundStringIt == args.end())
+            continue;
+
+        if(textualType == "printHelp()")
+        {
+            printHelp();
+            return 0; // Quit
+        }
+
+        if(textualType == "bool")
+        {
+            *static_cast<bool*>(associatedVariable) = true;
+            continue;
+        }
+
+        if(foundStringIt + 1 == args.end())
+        {
+            std::cerr << "Missing value for '" + command + "'!" << std::endl;
+            return 1;
+        }
+
+        try
+        {
+            if(textualType == "std::string")
+                *static_cast<std::string*>(associatedVariable) = *(foundStringIt + 1);
+            else if(textualType == "Big")
+                *static_cast<Big*>(associatedVariable) = std::stoll(*(foundStringIt + 1));
+        } catch(const std::exception&)
+        {
+            std::cerr << "Invalid value for '" + command + "'!" << std::endl;
+            return 1;
+        }
+    }
+
+    if(socketPath.empty() || inputFile.empty())
+    {
+        std::cerr << "Error: you must specify the server's -socket and the -input file" << std::endl;
+        return 1;
+    }
+
+    if(operation != "lookup" && operation != "extract")
+    {
+        std::cerr << "Error: unknown operation '" << operation << "'!" << std::endl;
+        return 1;
+    }
+
+    if(requestCount < 1 || connectionCount < 1 || coldCount < 0 || blockSize < 1 || startBlock < 0)
+    {
+        std::cerr << "Error: counts, -blocksize and -startblock must be positive!" << std::endl;
+        return 1;
+    }
+
+    bool extract = operation == "extract";
+    RESX::ForkLocation location(inputFile, static_cast<unsigned int>(blockSize),
+                                static_cast<uint64_t>(startBlock), decompress);
+
+    // The keys to ask for, read here once.
+    RESX::File file(inputFile, static_cast<unsigned int>(blockSize));
+    std::vector<RESX::ResourceInfo> infos =
+        file.loadResourceFork(static_cast<unsigned int>(startBlock)).getResourcesInfo();
+    if(infos.empty())
+    {
+        std::cerr << "Error: no resources in '" << inputFile << "'!" << std::endl;
+        return 1;
+    }
+
+    std::vector<LoadResult> results;
+
+    // Same random keys for every run with the same seed.
+    std::mt19937 random(static_cast<unsigned int>(seed));
+    std::uniform_int_distribution<std::size_t> pick(0, infos.size() - 1);
+    std::vector<std::size_t> picks(static_cast<std::size_t>(requestCount));
+    for(std::size_t& picked : picks)
+        picked = pick(random);
+
+    // What every request costs without a server (but without starting a
+    // process either).
+    std::vector<double> latencies;
+    for(Big i = 0; i < coldCount; i++)
+    {
+        const RESX::ResourceInfo& info = infos[picks[static_cast<std::size_t>(i) % picks.size()]];
+        loadClock::time_point start = loadClock::now();
+        RESX::File coldFile(inputFile, static_cast<unsigned int>(blockSize));
+        RESX::ResourceFork resourceFork = coldFile.loadResourceFork(static_cast<unsigned int>(startBlock));
+        resourceFork.setDecompression(decompress);
+        RESX::ResourceInfo found;
+        if(resourceFork.getResourceInfo(RESX::ResourceKey(info.type, info.ID), &found) && extract)
+        {
+            std::size_t size;
+            resourceFork.getResourceData(found, &size);
+        }
+
+        latencies.push_back(secondsSince(start) * 1e6);
+    }
+
+    addLatencies(results, "cold", latencies);
+
+    // The first request opens the fork in the server.
+    {
+        RESX::Client client(socketPath);
+        RESX::RemoteResource resource;
+        loadClock::time_point start = loadClock::now();
+        RESX::Protocol::Status status = client.lookup(location, RESX::ResourceKey(infos[0].type, infos[0].ID),
+                                                      &resource);
+        results.push_back({"first_request", "us", secondsSince(start) * 1e6, 1});
+        if(status != RESX::Protocol::ok)
+        {
+            std::cerr << "Error: first request failed: " << RESX::Protocol::statusString(status) << std::endl;
+            return 1;
+        }
+    }
+
+    // Every connection takes the next request when its last one is done.
+    std::size_t connections = static_cast<std::size_t>(connectionCount);
+    std::vector<std::vector<double>> latenciesPerConnection(connections);
+    std::atomic<std::size_t> nextRequest(0);
+    std::atomic<std::size_t> errors(0);
+    std::atomic<std::size_t> bytes(0);
+
+    loadClock::time_point start = loadClock::now();
+    std::vector<std::thread> threads;
+    for(std::size_t i = 0; i < connections; i++)
+    {
+        threads.push_back(std::thread([&, i]()
+        {
+            RESX::Client client(socketPath);
+            RESX::RemoteResource resource;
+            RESX::Payload payload;
+            std::vector<double>& connectionLatencies = latenciesPerConnection[i];
+
+            for(std::size_t j = nextRequest++; j < picks.size(); j = nextRequest++)
+            {
+                const RESX::ResourceInfo& info = infos[picks[j]];
+                RESX::ResourceKey key(info.type, info.ID);
+
+                loadClock::time_point requestStart = loadClock::now();
+                RESX::Protocol::Status status = extract ? client.extract(location, key, &resource, &payload) :
+                                                          client.lookup(location, key, &resource);
+                connectionLatencies.push_back(secondsSince(requestStart) * 1e6);
+
+                if(status != RESX::Protocol::ok)
+                    errors++;
+                else if(extract)
+                    bytes += payload.size();
+            }
+        }));
+    }
+
+    for(std::thread& thread : threads)
+        thread.join();
+    double seconds = secondsSince(start);
+
+    latencies.clear();
+    for(const std::vector<double>& connectionLatencies : latenciesPerConnection)
+        latencies.insert(latencies.end(), connectionLatencies.begin(), connectionLatencies.end());
+
+    addLatencies(results, "server", latencies);
+    results.push_back({"server_throughput", "requests/s", latencies.size() / seconds,
+                       static_cast<Big>(latencies.size())});
+    if(extract)
+        results.push_back({"server_bandwidth", "MB/s", bytes / 1e6 / seconds, static_cast<Big>(latencies.size())});
+
+    std::ostringstream json;
+    json << "{" << std::endl;
+    json << "  \"fork\": {\"path\": \"" << escapeJSON(inputFile) << "\", \"resources\": " << infos.size() <<
+        "}," << std::endl;
+    json << "  \"operation\": \"" << operation << "\", \"connections\": " << connections <<
+        ", \"requests\": " << picks.size() << ", \"errors\": " << errors << "," << std::endl;
+    json << "  \"results\": [" << std::endl;
+    for(std::size_t i = 0; i < results.size(); i++)
+    {
+        const LoadResult& result = results[i];
+        json << "    {\"name\": \"" << result.name << "\", \"unit\": \"" << result.unit << "\", \"value\": " <<
+            result.value << ", \"operations\": " << result.operations << "}" <<
+            (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    json << "  ]" << std::endl << "}" << std::endl;
+
+    if(outputFile.empty())
+    {
+        std::cout << json.str();
+    } else
+    {
+        std::ofstream output(outputFile, std::ofstream::out | std::ofstream::trunc);
+        output << json.str();
+        if(output.fail())
+        {
+            std::cerr << "Error: writing to '" << outputFile << "' failed!" << std::endl;
+            return 1;
+        }
+    }
+
+    return errors == 0 ? 0 : 1;
+}
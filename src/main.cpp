@@ -24,14 +24,32 @@
 #include <memory>
 
 #include <string>
-#include <iomanip>
 #include <cstdint>
 #include <fstream>
+#include <cstdio> // For stdout
+
+#ifdef _WIN32
+#include <io.h> // For _setmode()
+#include <fcntl.h> // For _O_BINARY
+#else
+#include <csignal>
+#endif
 
 std::string gVersion = "v1.0";
 
 using Big = long long int;
 
+#ifndef _WIN32
+// For the signal handler to stop it.
+RESX::Server* gServer = nullptr;
+
+void stopServer(int)
+{
+    if(gServer)
+        gServer->stop();
+}
+#endif
+
 void printHelp()
 {
     std::cout <<
@@ -43,16 +61,115 @@ void printHelp()
         "Extracts a resource from a resource fork file (.rsrc)." << std::endl <<
         std::endl <<
         "Usage: ResExtractorCmdLine -input INPUT_FILE -resourceID ID -resourceType TYPE " << std::endl <<
-        "   [-blocksize BYTES] [-output OUTPUT_FILE] [-startblock BLOCK]" << std::endl <<
+        "   [-blocksize BYTES] [-output OUTPUT_FILE] [-startblock BLOCK | -extents EXTENTS] [-index INDEX_FILE]" << std::endl <<
+        "   [-dump hex|raw|base64] [-offsets] [-ascii]" << std::endl <<
+        "       ResExtractorCmdLine -input INPUT_FILE -all -outputDir OUTPUT_DIR" << std::endl <<
+        "   [-resourceType TYPE] [-blocksize BYTES] [-startblock BLOCK | -extents EXTENTS] [-index INDEX_FILE]" << std::endl <<
+        "   [-threads N]" << std::endl <<
+        "       ResExtractorCmdLine -input INPUT_FILE -compact OUTPUT_FILE" << std::endl <<
+        "   [-blocksize BYTES] [-startblock BLOCK | -extents EXTENTS] [-index INDEX_FILE]" << std::endl <<
+        "       ResExtractorCmdLine -input VOLUME_FILE -volume [-all -outputDir OUTPUT_DIR]" << std::endl <<
+        "   [-resourceType TYPE] [-threads N]" << std::endl <<
+        "       ResExtractorCmdLine -input IMAGE_FILE -scan [-all -outputDir OUTPUT_DIR]" << std::endl <<
+        "   [-alignment BYTES] [-resourceType TYPE] [-threads N]" << std::endl <<
+        "   Any of the above also takes [-stats text|json], and all but -compact [-decompress [-dcmp2table TABLE_FILE]]." << std::endl <<
+        "   Any but -volume and -scan also takes [-iouring [-direct]]." << std::endl <<
+        "       ResExtractorCmdLine -manifest MANIFEST_FILE" << std::endl <<
+        "   [-blocksize BYTES] [-decompress [-dcmp2table TABLE_FILE]] [-threads N] [-iouring [-direct]]" << std::endl <<
+        "       ResExtractorCmdLine -serve SOCKET_FILE [-root DIRECTORY] [-dcmp2table TABLE_FILE]" << std::endl <<
         std::endl <<
         " --help, --h                 display help" << std::endl <<
         std::endl <<
+        " -alignment                  with -scan, only look for resource forks at multiples of BYTES," << std::endl <<
+        "                             a power of two (512 for HFS volumes), 1 by default" << std::endl <<
+        " -all                        extract all resources (of -resourceType, if specified) to -outputDir" << std::endl <<
+        " -ascii                      with -dump hex, end lines with the bytes as ASCII ('.' if not printable)" << std::endl <<
         " -blocksize                  set block size in bytes, 4 KiB by default" << std::endl <<
+        " -compact                    rewrite the resource fork to a file without dead space," << std::endl <<
+        "                             resources sorted by type and ID" << std::endl <<
+        " -dcmp2table                 read the default 'dcmp' (2) table (256 big-endian words) from a file," << std::endl <<
+        "                             for compressed resources without their own" << std::endl <<
+        " -decompress                 expand compressed resources: 'dcmp' (0) and (1), and 'dcmp' (2)" << std::endl <<
+        "                             with their own table, or any with -dcmp2table" << std::endl <<
+        " -direct                     with -iouring, bypass the page cache (O_DIRECT)" << std::endl <<
+        " -dump                       set how to print the resource without -output: hex (default)," << std::endl <<
+        "                             raw bytes, or base64" << std::endl <<
+        " -extents                    set extents of a fragmented resource fork, in fork order," << std::endl <<
+        "                             as START_BLOCK:BLOCK_COUNT[,START_BLOCK:BLOCK_COUNT...]" << std::endl <<
+        " -index                      set sidecar index file, loaded instead of parsing the resource map," << std::endl <<
+        "                             (re)created if missing or out of date" << std::endl <<
         " -input                      set input file containing resource fork (.hfs or .rsrc)" << std::endl <<
+        " -iouring                    read batches through io_uring on Linux, with positional reads as fallback" << std::endl <<
+        " -manifest                   extract the resources listed in a file (- for stdin), one per line as" << std::endl <<
+        "                             INPUT_FILE<tab>START_BLOCK<tab>TYPE<tab>ID_OR_NAME<tab>OUTPUT_FILE," << std::endl <<
+        "                             opening each input file once" << std::endl <<
+        " -offsets                    with -dump hex, start lines with their offset in the resource" << std::endl <<
         " -output                     set output file, will print resource to cmdline if unspecified" << std::endl <<
+        " -outputDir                  set output directory for -all, files are named TYPE_ID_NAME" << std::endl <<
         " -resourceID                 set resource ID to extract" << std::endl <<
         " -resourceType               set resource type to extact" << std::endl <<
-        " -startblock                 set first block of resource fork, 0 by default" << std::endl;
+        " -root                       with -serve, only serve files under DIRECTORY (relative paths are relative" << std::endl <<
+        "                             to it), the current directory by default" << std::endl <<
+        " -scan                       look for resource forks anywhere in the input (a raw disk image) and list them," << std::endl <<
+        "                             or with -all, extract them all to OFFSET folders in -outputDir" << std::endl <<
+        " -serve                      answer lookups and extractions on a Unix domain socket until interrupted," << std::endl <<
+        "                             keeping the resource forks asked for open (see ResExtractorLoad)" << std::endl <<
+        " -startblock                 set first block of resource fork, 0 by default" << std::endl <<
+        " -stats                      print reads, allocations and time spent per phase to stderr, as text or json" << std::endl <<
+        "                             (zeros unless built with -DRESX_ENABLE_STATS=ON)" << std::endl <<
+        " -threads                    set number of threads for -all, 1 by default, 0 for one per core" << std::endl <<
+        " -volume                     treat input as an HFS+ volume and list the files with a resource fork," << std::endl <<
+        "                             or with -all, extract them all to FILEID_NAME folders in -outputDir" << std::endl;
+}
+
+// Memory-mapped (or positional reads), or io_uring if asked for.
+RESX::File openFile(const std::string& inputFile, Big blockSize, bool useIOUring, bool directIO)
+{
+    if(useIOUring)
+        return RESX::File(inputFile, blockSize, RESX::UringReader::open(inputFile, directIO));
+
+    return RESX::File(inputFile, blockSize);
+}
+
+// Prints stats to cerr, as format ("text" or "json"), if not empty.
+void printStats(const std::string& format, const RESX::Stats& stats)
+{
+    if(format == "json")
+        std::cerr << stats.toJSON() << std::endl;
+    else if(format == "text")
+        std::cerr << stats.toText();
+}
+
+// Parses "START:COUNT[,START:COUNT...]".
+bool parseExtents(const std::string& text, std::vector<RESX::Extent>& extents)
+{
+    std::size_t position = 0;
+    while(position < text.size())
+    {
+        std::size_t end = text.find(',', position);
+        if(end == std::string::npos)
+            end = text.size();
+
+        std::string extentText = text.substr(position, end - position);
+        std::size_t colon = extentText.find(':');
+        if(colon == std::string::npos)
+            return false;
+
+        try
+        {
+            RESX::Extent extent;
+            extent.startBlock = std::stoul(extentText.substr(0, colon));
+            extent.blockCount = std::stoul(extentText.substr(colon + 1));
+            extents.push_back(extent);
+        } catch(const std::exception&)
+        {
+            return false;
+        }
+
+        position = end + 1;
+    }
+
+    return !extents.empty();
 }
 
 int main(int argc, char **argv)
@@ -67,6 +184,26 @@ int main(int argc, char **argv)
 
     std::string inputFile;
     std::string outputFile;
+    std::string outputDirectory;
+    std::string extentsText;
+    std::string indexFile;
+    std::string compactFile;
+    std::string statsFormat;
+    std::string socketFile;
+    std::string rootDirectory = ".";
+    std::string manifestFile;
+    std::string dcmp2TableFile;
+    std::string dumpFormatText = "hex";
+    bool showOffsets = false;
+    bool showASCII = false;
+    bool decompress = false;
+    bool useIOUring = false;
+    bool directIO = false;
+    bool extractAll = false;
+    bool isVolume = false;
+    bool scanImage = false;
+    Big alignment = 1LL;
+    int threadCount = 1;
 
     int resourceID = -1;
     std::string resourceType;
@@ -76,12 +213,32 @@ int main(int argc, char **argv)
                     argDefinitionTuple("--help", nullptr, "printHelp()"),
                     argDefinitionTuple("--h", nullptr, "printHelp()"),
 
+                    argDefinitionTuple("-alignment", &alignment, "Big"),
+                    argDefinitionTuple("-all", &extractAll, "bool"),
+                    argDefinitionTuple("-ascii", &showASCII, "bool"),
                     argDefinitionTuple("-blocksize", &blockSize, "Big"),
+                    argDefinitionTuple("-compact", &compactFile, "std::string"),
+                    argDefinitionTuple("-dcmp2table", &dcmp2TableFile, "std::string"),
+                    argDefinitionTuple("-decompress", &decompress, "bool"),
+                    argDefinitionTuple("-direct", &directIO, "bool"),
+                    argDefinitionTuple("-dump", &dumpFormatText, "std::string"),
+                    argDefinitionTuple("-extents", &extentsText, "std::string"),
+                    argDefinitionTuple("-index", &indexFile, "std::string"),
                     argDefinitionTuple("-input", &inputFile, "std::string"),
+                    argDefinitionTuple("-iouring", &useIOUring, "bool"),
+                    argDefinitionTuple("-manifest", &manifestFile, "std::string"),
+                    argDefinitionTuple("-offsets", &showOffsets, "bool"),
                     argDefinitionTuple("-output", &outputFile, "std::string"),
+                    argDefinitionTuple("-outputDir", &outputDirectory, "std::string"),
                     argDefinitionTuple("-resourceID", &resourceID, "int"),
                     argDefinitionTuple("-resourceType", &resourceType, "std::string"),
+                    argDefinitionTuple("-root", &rootDirectory, "std::string"),
+                    argDefinitionTuple("-scan", &scanImage, "bool"),
+                    argDefinitionTuple("-serve", &socketFile, "std::string"),
                     argDefinitionTuple("-startblock", &startBlock, "Big"),
+                    argDefinitionTuple("-stats", &statsFormat, "std::string"),
+                    argDefinitionTuple("-threads", &threadCount, "int"),
+                    argDefinitionTuple("-volume", &isVolume, "bool"),
     };
 
     std::vector<std::string> args(argv, argv+argc);
@@ -123,6 +280,10 @@ int main(int argc, char **argv)
 
                 else if(textualType == "float")
                     *static_cast<float*>(associatedVariable) = std::stof(*(foundStringIt + 1));
+
+                // Flags take no value.
+                else if(textualType == "bool")
+                    *static_cast<bool*>(associatedVariable) = true;
                 else if(textualType == "printHelp()")
                 {
                     printHelp();
@@ -138,6 +299,72 @@ int main(int argc, char **argv)
         }
     }
 
+    if(!dcmp2TableFile.empty())
+    {
+        std::ifstream tableFile(dcmp2TableFile, std::ios::binary);
+        char table[RESX::Decompressor::dcmp2DefaultTableCount * 2];
+        if(!tableFile.read(table, sizeof(table)))
+        {
+            std::cerr << "Error: cannot read " << sizeof(table) << " bytes from '" << dcmp2TableFile << "'!" <<
+                std::endl;
+            return 1;
+        }
+
+        RESX::Decompressor::setDcmp2DefaultTable(table);
+    }
+
+    // Serves any file asked for, no -input
+    if(!socketFile.empty())
+    {
+#ifdef _WIN32
+        std::cerr << "Error: -serve needs Unix domain sockets, not available on Windows" << std::endl;
+        return 1;
+#else
+        RESX::Server server(socketFile, rootDirectory);
+        if(!server.isListening())
+            return 1;
+
+        gServer = &server;
+        std::signal(SIGINT, stopServer);
+        std::signal(SIGTERM, stopServer);
+
+        server.run();
+        gServer = nullptr;
+        return 0;
+#endif
+    }
+
+    // Input files are in the manifest
+    if(!manifestFile.empty())
+    {
+        RESX::ManifestExtractor manifestExtractor([blockSize, useIOUring, directIO](const std::string& path)
+        {
+            return openFile(path, blockSize, useIOUring, directIO);
+        });
+
+        std::ifstream manifest;
+        if(manifestFile != "-")
+        {
+            manifest.open(manifestFile);
+            if(!manifest.is_open())
+            {
+                std::cerr << "Error: cannot open manifest '" << manifestFile << "'!" << std::endl;
+                return 1;
+            }
+        }
+
+        if(!manifestExtractor.load(manifestFile == "-" ? std::cin : manifest))
+            return 1;
+
+        manifestExtractor.setThreadCount(threadCount < 0 ? 1 : threadCount);
+        manifestExtractor.setDecompression(decompress);
+
+        std::size_t extractedCount = manifestExtractor.extractAll();
+        std::cout << "Extracted " << extractedCount << " of " << manifestExtractor.recordCount() <<
+            " resources from " << manifestExtractor.inputCount() << " files." << std::endl;
+        return extractedCount == manifestExtractor.recordCount() ? 0 : 1;
+    }
+
     // Do errors:
     if(inputFile.empty())
     {
@@ -145,65 +372,207 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    if(resourceID == -1)
+    std::vector<RESX::Extent> extents;
+    if(!extentsText.empty() && !parseExtents(extentsText, extents))
     {
-        std::cerr << "Error: resource ID not specified, you must specify it with -resourceID" << std::endl;
+        std::cerr << "Invalid value for '-extents'!" << std::endl;
         return 1;
     }
 
-    if(resourceType.empty())
+    RESX::Dumper::Format dumpFormat;
+    if(!RESX::Dumper::parseFormat(dumpFormatText, &dumpFormat))
     {
-        std::cerr << "Error: resource type not specified, you must specify it with -resourceType" << std::endl;
+        std::cerr << "Invalid value for '-dump', must be hex, raw or base64!" << std::endl;
         return 1;
     }
 
-    RESX::File myFile(inputFile, blockSize);
-    std::size_t resourceSize;
-    std::unique_ptr<char, RESX::freeDelete> resourceData =
-        myFile.loadResourceFork(startBlock).getResourceData(resourceType, resourceID, &resourceSize);
+    if(!statsFormat.empty() && statsFormat != "text" && statsFormat != "json")
+    {
+        std::cerr << "Invalid value for '-stats', must be text or json!" << std::endl;
+        return 1;
+    }
 
-    // Print resource if outputFile is not specified.
-    if(outputFile.empty())
+    if(extractAll && outputDirectory.empty())
     {
-        // From https://stackoverflow.com/questions/7639656/getting-a-buffer-into-a-stringstream-in-hex-representation/7639754#7639754
-        std::cout << std::hex << std::setfill('0');
-        for(std::size_t i = 0; i < resourceSize; ++i)
+        std::cerr << "Error: output directory not specified, you must specify it with -outputDir" << std::endl;
+        return 1;
+    }
+
+    if(isVolume)
+    {
+        RESX::Volume volume(inputFile);
+        if(!volume.isValid())
+            return 1;
+
+        std::vector<RESX::VolumeFile> volumeFiles = volume.findResourceForks();
+        if(!extractAll)
+        {
+            for(const RESX::VolumeFile& volumeFile : volumeFiles)
+            {
+                std::cout << volumeFile.fileID << '\t' << volumeFile.resourceForkSize << '\t' <<
+                    volumeFile.resourceForkExtents.size() << '\t' << volumeFile.path << std::endl;
+            }
+
+            return 0;
+        }
+
+        // Each fork in its own folder: FILEID_NAME
+        std::size_t extractedCount = 0;
+        RESX::Stats stats;
+        for(const RESX::VolumeFile& volumeFile : volumeFiles)
         {
-            // Reinterpret casting to unsigned char to avoid << printing a negative hex value, while
-            // making sure we keep the exact same value bitwise.
-            // Casting to unsigned int to tell << we want a number, not an ASCII character.
-            //
-            // (Note: reinterpret_cast can only return reference or pointer, since it does not compile
-            // to any CPU instructions at all, and only exists for the compiler. Thus, it cannot return
-            // by value, but can only "return" a reference or pointer (which tells the compiler to use the
-            // variable as is, without any implicit conversions or compiler errors).)
-            std::cout << std::setw(2) << static_cast<unsigned>(reinterpret_cast<unsigned char&>(resourceData.get()[i]));
-
-            if((i+1)%8 == 0)
-                std::cout << "  ";
-            else
-                std::cout << ' ';
-
-            if((i+1)%16 == 0)
-                std::cout << std::endl;
+            std::string fileName = volumeFile.path.substr(volumeFile.path.rfind('/') + 1);
+            std::string forkDirectory = outputDirectory + "/" +
+                RESX::Extractor::safeFileName(std::to_string(volumeFile.fileID) + "_" + fileName);
+
+            RESX::ResourceFork resourceFork = volume.loadResourceFork(volumeFile);
+            resourceFork.setDecompression(decompress);
+            RESX::Extractor extractor(resourceFork, forkDirectory);
+            extractor.setThreadCount(threadCount < 0 ? 1 : threadCount);
+            extractedCount += resourceType.empty() ? extractor.extractAll() : extractor.extractAll(resourceType);
+            stats += resourceFork.getStats();
         }
 
-        std::cout << std::endl;
-    } else
+        std::cout << "Extracted " << extractedCount << " resources from " << volumeFiles.size() <<
+            " resource forks to '" << outputDirectory << "'." << std::endl;
+        printStats(statsFormat, stats);
+        return 0;
+    }
+
+    if(scanImage)
     {
-        std::ofstream file(outputFile, std::ofstream::out | std::ofstream::trunc);
+        if(alignment <= 0 || (alignment & (alignment - 1)) != 0)
+        {
+            std::cerr << "Invalid value for '-alignment', must be a power of two!" << std::endl;
+            return 1;
+        }
+
+        RESX::Scanner scanner(inputFile);
+        if(!scanner.isOpen())
+            return 1;
+
+        scanner.setAlignment(static_cast<std::size_t>(alignment));
+        scanner.setThreadCount(threadCount < 0 ? 1 : threadCount);
+        std::vector<RESX::FoundFork> forks = scanner.scan();
+        if(!extractAll)
+        {
+            for(const RESX::FoundFork& fork : forks)
+            {
+                std::cout << fork.offset << '\t' << fork.size << '\t' << fork.typeCount << '\t' <<
+                    fork.resourceCount << std::endl;
+            }
+
+            return 0;
+        }
+
+        // Each fork in its own folder: OFFSET
+        std::size_t extractedCount = 0;
+        RESX::Stats stats;
+        for(const RESX::FoundFork& fork : forks)
+        {
+            RESX::ResourceFork resourceFork = scanner.loadResourceFork(fork);
+            resourceFork.setDecompression(decompress);
+            RESX::Extractor extractor(resourceFork, outputDirectory + "/" + std::to_string(fork.offset));
+            extractor.setThreadCount(threadCount < 0 ? 1 : threadCount);
+            extractedCount += resourceType.empty() ? extractor.extractAll() : extractor.extractAll(resourceType);
+            stats += resourceFork.getStats();
+        }
+
+        std::cout << "Extracted " << extractedCount << " resources from " << forks.size() <<
+            " resource forks to '" << outputDirectory << "'." << std::endl;
+        printStats(statsFormat, stats);
+        return 0;
+    }
 
-        if(file.fail())
+    if(!compactFile.empty())
+    {
+        RESX::File myFile = openFile(inputFile, blockSize, useIOUring, directIO);
+        RESX::ResourceFork resourceFork = extents.empty() ? myFile.loadResourceFork(startBlock, indexFile) :
+                                                            myFile.loadResourceFork(extents, 0, indexFile);
+        if(!RESX::ResourceForkWriter::compact(resourceFork, compactFile))
         {
-            std::cerr << "Error: cannot open file '" << outputFile << "' for writing!" << std::endl;
+            std::cerr << "Error: could not compact resource fork!" << std::endl;
             return 1;
         }
 
-        file.write(resourceData.get(), resourceSize);
-        if(file.fail())
+        std::cout << "Compacted " << resourceFork.getResourcesInfo().size() << " resources to '" <<
+            compactFile << "'." << std::endl;
+        printStats(statsFormat, resourceFork.getStats());
+        return 0;
+    }
+
+    if(extractAll)
+    {
+        if(outputDirectory.empty())
         {
-            std::cerr << "Error: writing to  '" << outputFile << "' failed!" << std::endl;
+            std::cerr << "Error: output directory not specified, you must specify it with -outputDir" << std::endl;
             return 1;
         }
+
+        RESX::File myFile = openFile(inputFile, blockSize, useIOUring, directIO);
+        RESX::ResourceFork resourceFork = extents.empty() ? myFile.loadResourceFork(startBlock, indexFile) :
+                                                            myFile.loadResourceFork(extents, 0, indexFile);
+        resourceFork.setDecompression(decompress);
+        RESX::Extractor extractor(resourceFork, outputDirectory);
+        extractor.setThreadCount(threadCount < 0 ? 1 : threadCount);
+
+        std::size_t extractedCount = resourceType.empty() ? extractor.extractAll() :
+                                                            extractor.extractAll(resourceType);
+        std::cout << "Extracted " << extractedCount << " resources to '" << outputDirectory << "'." << std::endl;
+        printStats(statsFormat, resourceFork.getStats());
+        return 0;
+    }
+
+    if(resourceID == -1)
+    {
+        std::cerr << "Error: resource ID not specified, you must specify it with -resourceID" << std::endl;
+        return 1;
+    }
+
+    if(resourceType.empty())
+    {
+        std::cerr << "Error: resource type not specified, you must specify it with -resourceType" << std::endl;
+        return 1;
     }
+
+    RESX::File myFile = openFile(inputFile, blockSize, useIOUring, directIO);
+    RESX::ResourceFork resourceFork = extents.empty() ? myFile.loadResourceFork(startBlock, indexFile) :
+                                                        myFile.loadResourceFork(extents, 0, indexFile);
+    resourceFork.setDecompression(decompress);
+
+    // Streamed by chunks (or copied inside the kernel), never loaded whole.
+    RESX::ResourceInfo resourceInfo;
+    if(!resourceFork.getResourceInfo(RESX::ResourceKey(resourceType, resourceID), &resourceInfo))
+    {
+        std::cerr << "Error: could not extract resource!" << std::endl;
+        return 1;
+    }
+
+    // Print resource if outputFile is not specified.
+    if(outputFile.empty())
+    {
+#ifdef _WIN32
+        // Or every '\n' byte becomes "\r\n".
+        if(dumpFormat == RESX::Dumper::Format::raw)
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+        RESX::Dumper dumper(stdout, dumpFormat, showOffsets, showASCII);
+        resourceFork.streamResource(resourceInfo, [&dumper](const char* chunk, std::size_t chunkSize)
+        {
+            return dumper.write(chunk, chunkSize);
+        });
+
+        if(!dumper.finish())
+        {
+            std::cerr << "Error: writing the resource to stdout failed!" << std::endl;
+            return 1;
+        }
+    } else if(!RESX::Extractor::writeResource(resourceFork, resourceInfo, outputFile))
+    {
+        std::cerr << "Error: writing to '" << outputFile << "' failed!" << std::endl;
+        return 1;
+    }
+
+    printStats(statsFormat, resourceFork.getStats());
 }
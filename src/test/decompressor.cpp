@@ -0,0 +1,138 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of ResExtractor.
+//
+// ResExtractor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ResExtractor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ResExtractor. If not, see <http://www.gnu.org/licenses/>.
+
+// Decompresses each NAME.compressed of the fixture directory and compares
+// it with NAME.expanded. The fixtures are compressed resources, header
+// included:
+//  - dcmp0: literals, remembered literals in all three forms, table words,
+//    and every extended tag (0xFE): jump table, byte and word runs, word
+//    and long deltas.
+//  - dcmp1: short and long literals, remembered literals in both forms,
+//    table words and a byte run.
+//  - dcmp2-tagged and dcmp2-untagged: resources with their own table,
+//    each of odd length, so ending with a lone byte.
+// Also checks that truncated data, a jump table without entries and
+// 'dcmp' (2) without a default table are refused.
+
+#include "ResExtractor.hpp"
+
+#include <algorithm> // For copy()
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory> // For smart pointers
+#include <string>
+#include <vector>
+
+namespace
+{
+    const char* const fixtureNames[] = {"dcmp0", "dcmp1", "dcmp2-tagged", "dcmp2-untagged"};
+
+    bool readFile(const std::string& path, std::vector<char>* data)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if(!file)
+        {
+            std::cerr << "Could not open '" << path << "'!" << std::endl;
+            return false;
+        }
+
+        data->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    // Returns false if data does not decompress, or not to expanded.
+    bool expandsTo(const std::vector<char>& data, const std::vector<char>& expanded)
+    {
+        RESX::Decompressor::Header header;
+        if(!RESX::Decompressor::parseHeader(data.data(), data.size(), &header) ||
+           header.decompressedLength != expanded.size())
+        {
+            return false;
+        }
+
+        std::vector<char> output(header.decompressedLength);
+        return RESX::Decompressor::decompress(header, data.data(), data.size(), output.data()) &&
+            output == expanded;
+    }
+
+    bool check(bool condition, const std::string& what)
+    {
+        if(!condition)
+            std::cerr << "FAILED: " << what << std::endl;
+
+        return condition;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc != 2)
+    {
+        std::cerr << "Usage: ResExtractorTest FIXTURE_DIRECTORY" << std::endl;
+        return 1;
+    }
+
+    std::string directory = argv[1];
+    bool passed = true;
+
+    for(const char* name : fixtureNames)
+    {
+        std::vector<char> compressed, expanded;
+        if(!readFile(directory + "/" + name + ".compressed", &compressed) ||
+           !readFile(directory + "/" + name + ".expanded", &expanded))
+        {
+            return 1;
+        }
+
+        passed &= check(expandsTo(compressed, expanded), std::string(name) + " expands as expected");
+
+        std::vector<char> truncated(compressed.begin(), compressed.end() - 2);
+        passed &= check(!expandsTo(truncated, expanded), std::string(name) + " refused when truncated");
+    }
+
+    // Header for 'dcmp' (0) and 14 bytes, then a jump table claiming no entries.
+    const unsigned char emptyJumpTable[] = {
+        0xA8, 0x9F, 0x65, 0x72, 0x00, 0x12, 0x08, 0x01, 0x00, 0x00, 0x00, 0x0E,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x01, 0x00, 0x00, 0xFE, 0x00, 0x01, 0x00, 0x10, 0xFF
+    };
+    std::vector<char> data(emptyJumpTable, emptyJumpTable + sizeof(emptyJumpTable));
+    passed &= check(!expandsTo(data, std::vector<char>(14)), "jump table without entries refused");
+
+    // The untagged fixture, pointing at the default table instead of its own.
+    std::vector<char> untagged, untaggedExpanded;
+    if(!readFile(directory + "/dcmp2-untagged.compressed", &untagged) ||
+       !readFile(directory + "/dcmp2-untagged.expanded", &untaggedExpanded))
+    {
+        return 1;
+    }
+
+    std::vector<char> ownTable(untagged.begin() + 18, untagged.begin() + 24);
+    untagged.erase(untagged.begin() + 18, untagged.begin() + 24);
+    untagged[16] = static_cast<char>(0xFF); // Table count - 1, ignored
+    untagged[17] = 0; // Untagged, default table
+    passed &= check(!expandsTo(untagged, untaggedExpanded), "dcmp2 without a default table refused");
+
+    std::vector<char> defaultTable(RESX::Decompressor::dcmp2DefaultTableCount * 2);
+    std::copy(ownTable.begin(), ownTable.end(), defaultTable.begin());
+    RESX::Decompressor::setDcmp2DefaultTable(defaultTable.data());
+    passed &= check(expandsTo(untagged, untaggedExpanded), "dcmp2 with a default table expands as expected");
+
+    std::cout << (passed ? "All decompression fixtures passed" : "Some decompression fixtures failed") << std::endl;
+    return passed ? 0 : 1;
+}